@@ -32,6 +32,9 @@
 #define LED_METER_SIZE 15               // The number of LEDs in each of our meters.
 #define LED_METER_START_INDEX 0         // The start index of the first LED of the first meter.
 #define LED_METER_COUNT 3               // The number of meters we have.
+#define VU_REFERENCE_LEVEL -18          // dBFS of a sine reading 0 VU (EBU R68 alignment).
+#define BALANCE_METER_RANGE 12          // dB either way, at the ends of the balance meter.
+#define BALANCE_METER_OFFSET 24         // Balance is sent with this subtracted, correlation with 1.
 
 // Arrays of hue (colour) values and dB values for each LED for the different meter types. Values start at bottom of meter.
 // Because of the way things work, we need LED_METER_SIZE+1 elements in these arrays.
@@ -48,6 +51,9 @@ const int lufs_abs_meter_vals[16] = {-35, -31, -27, -25, -23, -21, -19, -17, -15
 const int lufs_rel_meter_hue[15] = {130, 130, 130, 130, 130, 130, 130, 130, 130, 114, 30, 0, 0, 0, 0};
 const int lufs_rel_meter_vals[16] = {-18, -16, -14, -12, -10, -8, -6, -4, -2, 0, 2, 4, 6, 8, 10, 12};
 
+const int vu_meter_hue[15] = {112, 111, 110, 109, 108, 107, 106, 89, 88, 87, 86, 64, 0, 0, 0};
+const int vu_meter_vals[16] = {-20, -15, -12, -10, -8, -7, -6, -5, -4, -3, -2, -1, 0, 1, 2, 3};
+
 /////////////////////////////////////////////////////////////////////////////
 // local variables
 /////////////////////////////////////////////////////////////////////////////
@@ -162,17 +168,69 @@ void DC_METERS_GetLevelStringFromMeterData(char *output_string, char *meter_data
         output_string[strlen(output_string) - 1] = 0;
 }
 
+float DC_METERS_GetMeterValue(char *meter_data, int index)
+{
+    return -((float)meter_data[index] + (float)(meter_data[index + 1] / 100.0f));
+}
+
 void DC_METERS_UpdateLedMeter(char meter_index, char *meter_data, dc_meter_data_index_t data_index, bool is_peak_meter)
 {
     int led, values_per_led;
     int *led_val_list;
     int *led_hue_list;
     float h, v;
+    int max_index = data_index == PEAK_R ? MAX_R : MAX_L;
+    bool has_max = is_peak_meter;
+    bool is_vu_meter = false;
+
+    // A bar set to a meter type in the plugin shows that instead of the mode's meter.
+    // Correlation (red when out of phase) and balance are centre zero, for both channels.
+    dc_meter_type_t meter_type = (dc_meter_type_t)meter_data[METER_TYPE_BAR_1 + meter_index];
+    if (meter_type == METER_TYPE_CORRELATION)
+    {
+        DC_METERS_UpdateCentreLedMeter(meter_index, DC_METERS_GetMeterValue(meter_data, CORRELATION) + 1.0f, 112, 0);
+        return;
+    }
+    if (meter_type == METER_TYPE_BALANCE)
+    {
+        float balance = DC_METERS_GetMeterValue(meter_data, BALANCE) + BALANCE_METER_OFFSET;
+        DC_METERS_UpdateCentreLedMeter(meter_index, balance / BALANCE_METER_RANGE, 130, 130);
+        return;
+    }
+
+    // Bars 1 and 2 are left and right, bar 3 the louder of the two. All these values have 3dB
+    // subtracted like true peak, and right follows left in the meter data.
+    if (meter_type != METER_TYPE_AUTO)
+    {
+        int hold_index;
+
+        switch (meter_type)
+        {
+            case METER_TYPE_SAMPLE_PEAK:    data_index = SAMPLE_PEAK_L; hold_index = SAMPLE_PEAK_HOLD_L; break;
+            case METER_TYPE_RMS:            data_index = RMS_L; hold_index = -1; break;
+            case METER_TYPE_VU:             data_index = VU_L; hold_index = -1; break;
+            case METER_TYPE_PPM:            data_index = PPM_L; hold_index = PPM_HOLD_L; break;
+            default:                        data_index = PEAK_L; hold_index = MAX_L; break;
+        }
+
+        bool is_right = meter_index == 1 ||
+            (meter_index == 2 && DC_METERS_GetMeterValue(meter_data, data_index + 2) > DC_METERS_GetMeterValue(meter_data, data_index));
+
+        if (is_right)
+        {
+            data_index = data_index + 2;
+            if (hold_index >= 0)
+                hold_index = hold_index + 2;
+        }
 
-    float value = -((float)meter_data[data_index] + (float)(meter_data[data_index + 1] / 100.0f));
+        is_peak_meter = true;
+        is_vu_meter = meter_type == METER_TYPE_VU;
+        has_max = hold_index >= 0;
+        max_index = hold_index;
+    }
 
-    float max_l = -((float)meter_data[MAX_L] + (float)(meter_data[MAX_L + 1] / 100.0f)) + 3.0f;
-    float max_r = -((float)meter_data[MAX_R] + (float)(meter_data[MAX_R + 1] / 100.0f)) + 3.0f;
+    float value = DC_METERS_GetMeterValue(meter_data, data_index);
+    float max = has_max ? DC_METERS_GetMeterValue(meter_data, max_index) + 3.0f : 0.0f;
 
     if (!is_peak_meter && is_lufs_relative)
         value = value - current_lufs_target;
@@ -182,7 +240,13 @@ void DC_METERS_UpdateLedMeter(char meter_index, char *meter_data, dc_meter_data_
     if (is_peak_meter)
         value = value + 3.0f;
 
-    if (is_peak_meter && !is_1db_scale)
+    if (is_vu_meter)
+    {
+        led_hue_list = vu_meter_hue;
+        led_val_list = vu_meter_vals;
+        value = value - VU_REFERENCE_LEVEL;
+    }
+    else if (is_peak_meter && !is_1db_scale)
     {
         led_hue_list = peak_3db_meter_hue;
         led_val_list = peak_3db_meter_vals;
@@ -224,18 +288,53 @@ void DC_METERS_UpdateLedMeter(char meter_index, char *meter_data, dc_meter_data_
         WS2812_LED_SetHSV(LED_METER_START_INDEX + (LED_METER_SIZE * meter_index) + LED_METER_SIZE - 1 - led, h, 1.0, v);
     }
 
-    if (is_peak_meter)
+    if (has_max)
     {
+        // Max (or hold) marker.
         for (led = 0; led < LED_METER_SIZE; led++)
         {
-            float max = data_index == PEAK_L ? max_l : data_index == PEAK_R ? max_r : max_l;
-
             if (led > 0 && max > led_val_list[led - 1] && max <= led_val_list[led])
                 WS2812_LED_SetHSV(LED_METER_START_INDEX + (LED_METER_SIZE * meter_index) + LED_METER_SIZE - 1 - led, 0, 1.0, LED_BRIGHTNESS / 2.0f);
         }
     }
 }
 
+void DC_METERS_UpdateCentreLedMeter(char meter_index, float value, int positive_hue, int negative_hue)
+{
+    // Value -1 to +1: LEDs are lit from the centre LED (always lit, dimmed, as the zero mark) up
+    // or down to the value, the last one partly.
+    int led;
+    int centre = LED_METER_SIZE / 2;
+    float v;
+
+    if (value > 1.0f)
+        value = 1.0f;
+    if (value < -1.0f)
+        value = -1.0f;
+
+    for (led = 0; led < LED_METER_SIZE; led++)
+    {
+        float position = (float)(led - centre) / (float)centre;     // -1 to +1, where the LED ends.
+        float lit;
+
+        if (led == centre)
+            lit = 0.5f;
+        else if (led > centre)
+            lit = (value - position) * centre + 1.0f;
+        else
+            lit = (position - value) * centre + 1.0f;
+
+        if (lit > 1.0f)
+            lit = 1.0f;
+        if (lit < 0.0f)
+            lit = 0.0f;
+        v = lit * LED_BRIGHTNESS;
+
+        WS2812_LED_SetHSV(LED_METER_START_INDEX + (LED_METER_SIZE * meter_index) + LED_METER_SIZE - 1 - led,
+            (float)(led >= centre ? positive_hue : negative_hue), 1.0, v);
+    }
+}
+
 void DC_METERS_SetMeterMode(bool isLufs)
 {
     is_lufs_mode = isLufs;
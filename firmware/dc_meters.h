@@ -36,9 +36,36 @@ typedef enum {
     MAX_R = 20,
     MAX_TOTAL = 22,
     CLIP_L = 24,
-    CLIP_R = 26
+    CLIP_R = 25,
+    SAMPLE_PEAK_L = 26,
+    SAMPLE_PEAK_R = 28,
+    RMS_L = 30,
+    RMS_R = 32,
+    VU_L = 34,
+    VU_R = 36,
+    PPM_L = 38,
+    PPM_R = 40,
+    SAMPLE_PEAK_HOLD_L = 42,
+    SAMPLE_PEAK_HOLD_R = 44,
+    PPM_HOLD_L = 46,
+    PPM_HOLD_R = 48,
+    METER_TYPE_BAR_1 = 50,
+    CORRELATION = 53,
+    BALANCE = 55
 } dc_meter_data_index_t;
 
+// What an LED bar shows, set per bar in the plugin. Same order as the plugin's meterBarType.
+typedef enum {
+    METER_TYPE_AUTO = 0,
+    METER_TYPE_TRUE_PEAK = 1,
+    METER_TYPE_SAMPLE_PEAK = 2,
+    METER_TYPE_RMS = 3,
+    METER_TYPE_VU = 4,
+    METER_TYPE_PPM = 5,
+    METER_TYPE_CORRELATION = 6,
+    METER_TYPE_BALANCE = 7
+} dc_meter_type_t;
+
 /////////////////////////////////////////////////////////////////////////////
 // Prototypes
 /////////////////////////////////////////////////////////////////////////////
@@ -52,8 +79,10 @@ extern void DC_METERS_SetPeak3rdMeterMode(bool isMomentary);
 extern void DC_METERS_SetRelativeMode(bool isRelative);
 extern void DC_METERS_Set1dBScaleMode(bool isActive);
 
+float DC_METERS_GetMeterValue(char *meter_data, int index);
 void DC_METERS_GetLevelStringFromMeterData(char* output_string, char *meter_data, dc_meter_data_index_t index, bool is_true_peak);
 void DC_METERS_UpdateLedMeter(char meter_index, char *meter_data, dc_meter_data_index_t index, bool is_true_peak);
+void DC_METERS_UpdateCentreLedMeter(char meter_index, float value, int positive_hue, int negative_hue);
 
 /////////////////////////////////////////////////////////////////////////////
 // Exported variables
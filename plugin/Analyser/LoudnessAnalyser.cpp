@@ -0,0 +1,163 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*
+*  Offline loudness analyser. Measures audio files with the same engine as the
+*  plugin meters, and prints integrated loudness, loudness range, max momentary
+*  and short-term loudness and true peak for each file, plus a summary.
+*
+*  Folders are searched (recursively) for audio files. Files are measured in
+*  parallel, one per CPU core unless --jobs is given.
+*
+*  Usage: DreamControlLoudnessAnalyser [--json] [--jobs <n>] [--chunk-size <samples>] <file or folder> ...
+*/
+
+#include <cstdio>
+#include <vector>
+
+#include <JuceHeader.h>
+
+#include "BatchLoudnessAnalyser.h"
+
+#define AUDIO_FILE_WILDCARD "*.wav;*.wave;*.aif;*.aiff;*.flac"
+
+static void printUsage()
+{
+	printf("Usage: DreamControlLoudnessAnalyser [--json] [--jobs <n>] [--chunk-size <samples>] <file or folder> ...\n");
+}
+
+static var resultToJson(const FileLoudnessAnalyser::Result& result)
+{
+	DynamicObject::Ptr item = new DynamicObject();
+	item->setProperty("file", result.fileName);
+	item->setProperty("ok", result.ok);
+
+	if (!result.ok)
+	{
+		item->setProperty("error", result.error);
+		return var(item.get());
+	}
+
+	item->setProperty("sampleRate", result.sampleRate);
+	item->setProperty("channels", result.numChannels);
+	item->setProperty("durationSeconds", result.durationSeconds);
+	item->setProperty("integratedLufs", result.integrated);
+	item->setProperty("loudnessRangeLu", result.loudnessRange);
+	item->setProperty("maxMomentaryLufs", result.maxMomentary);
+	item->setProperty("maxShortTermLufs", result.maxShortTerm);
+	item->setProperty("truePeakDbtp", result.truePeak);
+	return var(item.get());
+}
+
+static void printResult(const FileLoudnessAnalyser::Result& result)
+{
+	if (!result.ok)
+		printf("%8s %8s %8s %8s %8s  %s (%s)\n", "-", "-", "-", "-", "-", result.fileName.toRawUTF8(), result.error.toRawUTF8());
+	else
+		printf("%8.1f %8.1f %8.1f %8.1f %8.1f  %s\n", result.integrated, result.loudnessRange, result.maxMomentary,
+			result.maxShortTerm, result.truePeak, result.fileName.toRawUTF8());
+}
+
+static var summaryToJson(const BatchLoudnessAnalyser::Summary& summary, double wallSeconds)
+{
+	DynamicObject::Ptr item = new DynamicObject();
+	item->setProperty("files", summary.numFiles);
+	item->setProperty("failed", summary.numFailed);
+	item->setProperty("totalDurationSeconds", summary.totalDurationSeconds);
+	item->setProperty("minIntegratedLufs", summary.minIntegrated);
+	item->setProperty("maxIntegratedLufs", summary.maxIntegrated);
+	item->setProperty("maxTruePeakDbtp", summary.maxTruePeak);
+	item->setProperty("wallSeconds", wallSeconds);
+	return var(item.get());
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+	bool json = false;
+	int chunkSize = FILE_LOUDNESS_ANALYSER_DEFAULT_CHUNK_SIZE;
+	int numJobs = SystemStats::getNumCpus();
+	Array<File> files;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const String arg(argv[i]);
+
+		if (arg == "--json")
+			json = true;
+		else if (arg == "--chunk-size" && i + 1 < argc)
+			chunkSize = jmax(1, String(argv[++i]).getIntValue());
+		else if (arg == "--jobs" && i + 1 < argc)
+			numJobs = jmax(1, String(argv[++i]).getIntValue());
+		else if (arg == "--help" || arg.startsWith("--"))
+		{
+			printUsage();
+			return arg == "--help" ? 0 : 1;
+		}
+		else
+		{
+			const File file = File::getCurrentWorkingDirectory().getChildFile(arg);
+
+			if (file.isDirectory())
+			{
+				Array<File> folderFiles;
+				file.findChildFiles(folderFiles, File::findFiles, true, AUDIO_FILE_WILDCARD);
+				folderFiles.sort();
+				files.addArray(folderFiles);
+			}
+			else
+				files.add(file);
+		}
+	}
+
+	if (files.isEmpty())
+	{
+		printUsage();
+		return 1;
+	}
+
+	BatchLoudnessAnalyser analyser(numJobs, chunkSize);
+
+	const double startMs = Time::getMillisecondCounterHiRes();
+	const std::vector<FileLoudnessAnalyser::Result> results = analyser.analyse(files);
+	const double wallSeconds = (Time::getMillisecondCounterHiRes() - startMs) / 1000.0;
+
+	const BatchLoudnessAnalyser::Summary summary = BatchLoudnessAnalyser::summarise(results);
+
+	if (json)
+	{
+		var jsonResults;
+		for (const auto& result : results)
+			jsonResults.append(resultToJson(result));
+
+		DynamicObject::Ptr root = new DynamicObject();
+		root->setProperty("files", jsonResults);
+		root->setProperty("summary", summaryToJson(summary, wallSeconds));
+		printf("%s\n", JSON::toString(var(root.get())).toRawUTF8());
+	}
+	else
+	{
+		printf("%8s %8s %8s %8s %8s  %s\n", "I LUFS", "LRA LU", "M max", "S max", "TP dBTP", "file");
+
+		for (const auto& result : results)
+			printResult(result);
+
+		printf("\n%d files, %d failed, %.1f s of audio in %.1f s (%.0fx realtime)\n", summary.numFiles, summary.numFailed,
+			summary.totalDurationSeconds, wallSeconds, wallSeconds > 0.0 ? summary.totalDurationSeconds / wallSeconds : 0.0);
+
+		if (summary.numFiles > summary.numFailed)
+			printf("Integrated %.1f to %.1f LUFS, max true peak %.1f dBTP\n", summary.minIntegrated, summary.maxIntegrated, summary.maxTruePeak);
+	}
+
+	return summary.numFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,563 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*
+*  DSP kernel benchmark. Runs each kernel on a synthetic signal over a sweep of
+*  block sizes, sample rates and channel counts, and reports ns per sample frame
+*  and real-time factor (seconds of audio processed per second of CPU).
+*
+*  Timings are only worth having for a meter engine that measures correctly, so the
+*  quick EBU conformance checks (see LoudnessConformance) run first, and nothing is
+*  timed if they fail. The full conformance matrix and the other correctness checks
+*  are in DreamControlTests.
+*
+*  --silence times each kernel on silence after a signal, when IIR filter tails decay
+*  towards denormals. It must cost no more than the signal did. Denormals aren't flushed
+*  to zero by the benchmark, so the kernels have to cope on their own, as they do on a
+*  host thread that doesn't set FTZ/DAZ.
+*
+*  Usage: DreamControlBenchmark [--json] [--quick] [--kernel <name>] [--min-time <seconds>]
+*                               [--no-check] [--silence]
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <JuceHeader.h>
+
+#include "BallisticMeterProcessor.h"
+#include "LufsProcessor.h"
+#include "TruePeakProcessor.h"
+#include "LinearPhaseCrossover.h"
+#include "MultibandCrossover.h"
+#include "LoudnessEqProcessor.h"
+#include "RoomCorrectionProcessor.h"
+#include "LoudnessConformance.h"
+
+#define BENCHMARK_SIGNAL_LENGTH 65536					// Samples per pass: 16 blocks at the largest block size.
+#define BENCHMARK_DEFAULT_MIN_TIME_SECONDS 0.1
+#define BENCHMARK_MAX_CHANNELS 2						// LufsProcessor and TruePeak are stereo at most.
+#define BENCHMARK_SILENCE_SAMPLE_RATE 48000.0
+#define BENCHMARK_SILENCE_BLOCK_SIZE 512
+#define BENCHMARK_SILENCE_SECONDS 4.0					// After one second of signal, timed in windows.
+#define BENCHMARK_SILENCE_WINDOW_SECONDS 0.25
+#define BENCHMARK_SILENCE_MAX_RATIO 3.0					// Worst silence window against the signal, per sample. Denormals cost 10x or more.
+
+const int benchmarkBlockSizes[] = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+const double benchmarkSampleRates[] = { 44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0 };
+
+//==============================================================================
+/**
+	A DSP kernel to benchmark.
+*/
+class BenchmarkKernel
+{
+public:
+	virtual ~BenchmarkKernel() {}
+
+	virtual String getName() const = 0;
+	virtual void prepare(double sampleRate, int numChannels, int blockSize) = 0;
+	virtual void process(AudioSampleBuffer& block) = 0;
+
+	// Kernels that change the signal get a fresh copy of it before every pass.
+	virtual bool modifiesSignal() const { return true; }
+};
+
+class TruePeakKernel : public BenchmarkKernel
+{
+public:
+	String getName() const override { return "truePeak"; }
+	void prepare(double, int, int) override { truePeak.reset(); }
+	void process(AudioSampleBuffer& block) override { result = truePeak.process(block); }
+	bool modifiesSignal() const override { return false; }
+
+private:
+	AudioProcessing::TruePeak truePeak;
+	AudioProcessing::TruePeak::LinearValue result;
+};
+
+// All meters ("lufs"), or loudness only ("lufsLoudness"), as when nothing shows true peak.
+class LufsKernel : public BenchmarkKernel
+{
+public:
+	LufsKernel(const String& name = "lufs", int meters = LufsProcessor::AllMeters) : name(name), meters(meters) {}
+
+	String getName() const override { return name; }
+
+	void prepare(double sampleRate, int, int blockSize) override
+	{
+		// Always stereo, as in the plugin. Mono blocks are processed as such.
+		lufsProcessor = std::make_unique<LufsProcessor>(LUFS_TP_MAX_NB_CHANNELS);
+		lufsProcessor->prepareToPlay(sampleRate, blockSize);
+		lufsProcessor->setMeters(meters);
+	}
+
+	void process(AudioSampleBuffer& block) override { lufsProcessor->processBlock(block); }
+	bool modifiesSignal() const override { return false; }
+
+private:
+	String name;
+	int meters;
+	std::unique_ptr<LufsProcessor> lufsProcessor;
+};
+
+class BallisticKernel : public BenchmarkKernel
+{
+public:
+	String getName() const override { return "ballistic"; }
+
+	void prepare(double sampleRate, int numChannels, int) override
+	{
+		ballisticMeters.prepareToPlay(sampleRate, numChannels);
+		ballisticMeters.setHoldTime(1.0f);
+		ballisticMeters.setEnabled(true);
+	}
+
+	void process(AudioSampleBuffer& block) override { ballisticMeters.process(block); }
+	bool modifiesSignal() const override { return false; }
+
+private:
+	BallisticMeterProcessor ballisticMeters;
+};
+
+// Two inner bands soloed out of six, as when auditioning the mids: eight biquads per channel.
+class MultibandKernel : public BenchmarkKernel
+{
+public:
+	String getName() const override { return "multiband"; }
+
+	void prepare(double sampleRate, int numChannels, int) override
+	{
+		const float frequencies[] = { 80.0f, 250.0f, 800.0f, 2500.0f, 8000.0f };
+
+		crossover.setNumBands(6);
+		for (int i = 0; i < numElementsInArray(frequencies); i++)
+			crossover.setCrossoverFrequency(i, frequencies[i]);
+		crossover.prepareToPlay(sampleRate, numChannels);
+	}
+
+	void process(AudioSampleBuffer& block) override { crossover.process(block, (1 << 2) | (1 << 3)); }
+
+private:
+	MultibandCrossover crossover;
+};
+
+// One band soloed out of four: a full convolution, where none or all soloed is only a delay.
+class LinearPhaseKernel : public BenchmarkKernel
+{
+public:
+	String getName() const override { return "linearPhase"; }
+
+	void prepare(double sampleRate, int numChannels, int) override
+	{
+		crossover.prepareToPlay(sampleRate, numChannels, 4);
+		crossover.setNumBands(4);
+		crossover.setCrossoverFrequency(0, 100.0f);
+		crossover.setCrossoverFrequency(1, 400.0f);
+		crossover.setCrossoverFrequency(2, 4000.0f);
+		crossover.update();
+	}
+
+	void process(AudioSampleBuffer& block) override { crossover.process(block, 1 << 1); }
+
+private:
+	LinearPhaseCrossover crossover;
+};
+
+class LoudnessEqKernel : public BenchmarkKernel
+{
+public:
+	String getName() const override { return "loudnessEq"; }
+	void prepare(double sampleRate, int numChannels, int) override
+	{
+		loudnessEq.prepareToPlay(sampleRate, numChannels);
+		loudnessEq.setLevel(-20.0f);
+	}
+	void process(AudioSampleBuffer& block) override { loudnessEq.process(block); }
+
+private:
+	LoudnessEqProcessor loudnessEq;
+};
+
+// A 64k tap stereo impulse response: exponentially decaying noise, as a room's tail.
+class RoomCorrectionKernel : public BenchmarkKernel
+{
+public:
+	String getName() const override { return "roomCorrection"; }
+
+	void prepare(double sampleRate, int numChannels, int) override
+	{
+		roomCorrection.prepareToPlay(sampleRate, numChannels);
+
+		AudioSampleBuffer impulseResponse(numChannels, 65536);
+		Random random(1);
+		for (int chan = 0; chan < numChannels; chan++)
+			for (int tap = 0; tap < impulseResponse.getNumSamples(); tap++)
+				impulseResponse.setSample(chan, tap, (random.nextFloat() - 0.5f) * std::exp(-tap / 8192.0f));
+
+		roomCorrection.setImpulseResponse(0, impulseResponse, sampleRate);
+		roomCorrection.setSpeakerSet(0);
+	}
+	void process(AudioSampleBuffer& block) override { roomCorrection.process(block); }
+
+private:
+	RoomCorrectionProcessor roomCorrection;
+};
+
+//==============================================================================
+struct BenchmarkResult
+{
+	String kernel;
+	double sampleRate;
+	int numChannels;
+	int blockSize;
+	int passes;
+	double nsPerSample;
+	double realTimeFactor;
+	double worstBlockUs;			// The slowest block: what has to fit in the audio callback, not just on average.
+};
+
+// Pink-ish programme: white noise at -20 dBFS plus a 997 Hz tone at -12 dBFS, decorrelated between channels.
+static void fillTestSignal(AudioSampleBuffer& signal, double sampleRate)
+{
+	Random random(1234);
+	const float noiseGain = Decibels::decibelsToGain(-20.0f);
+	const float toneGain = Decibels::decibelsToGain(-12.0f);
+
+	for (int chan = 0; chan < signal.getNumChannels(); chan++)
+	{
+		float* data = signal.getWritePointer(chan);
+		for (int sample = 0; sample < signal.getNumSamples(); sample++)
+		{
+			const double phase = 2.0 * double_Pi * 997.0 * sample / sampleRate + chan;
+			data[sample] = noiseGain * (2.0f * random.nextFloat() - 1.0f) + toneGain * (float)std::sin(phase);
+		}
+	}
+}
+
+static BenchmarkResult runBenchmark(BenchmarkKernel& kernel, const AudioSampleBuffer& signal, double sampleRate, int blockSize, double minTimeSeconds)
+{
+	const int numChannels = signal.getNumChannels();
+	const int numSamples = signal.getNumSamples();
+	AudioSampleBuffer work(numChannels, numSamples);
+
+	kernel.prepare(sampleRate, numChannels, blockSize);
+
+	int64 totalTicks = 0;
+	int passes = -1;		// First pass is a warm-up.
+
+	// Each block's best time over the passes, so the worst isn't just the thread being preempted. The signal
+	// is a whole number of every block size and partition, so a block does the same work every pass.
+	std::vector<int64> blockTicks((size_t)(numSamples / blockSize), std::numeric_limits<int64>::max());
+
+	while (passes < 1 || Time::highResolutionTicksToSeconds(totalTicks) < minTimeSeconds)
+	{
+		if (passes < 0 || kernel.modifiesSignal())
+			work.makeCopyOf(signal, true);
+
+		const int64 start = Time::getHighResolutionTicks();
+
+		for (int pos = 0; pos + blockSize <= numSamples; pos += blockSize)
+		{
+			AudioSampleBuffer block(work.getArrayOfWritePointers(), numChannels, pos, blockSize);
+			const int64 blockStart = Time::getHighResolutionTicks();
+			kernel.process(block);
+
+			if (passes >= 0)
+				blockTicks[pos / blockSize] = jmin(blockTicks[pos / blockSize], Time::getHighResolutionTicks() - blockStart);
+		}
+
+		const int64 ticks = Time::getHighResolutionTicks() - start;
+
+		if (passes >= 0)
+			totalTicks += ticks;
+		passes++;
+	}
+
+	const double seconds = Time::highResolutionTicksToSeconds(totalTicks);
+	const double samplesProcessed = (double)passes * (double)numSamples;
+
+	BenchmarkResult result;
+	result.kernel = kernel.getName();
+	result.sampleRate = sampleRate;
+	result.numChannels = numChannels;
+	result.blockSize = blockSize;
+	result.passes = passes;
+	result.nsPerSample = seconds * 1.0e9 / samplesProcessed;
+	result.realTimeFactor = (samplesProcessed / sampleRate) / seconds;
+	result.worstBlockUs = Time::highResolutionTicksToSeconds(*std::max_element(blockTicks.begin(), blockTicks.end())) * 1.0e6;
+	return result;
+}
+
+struct SilenceResult
+{
+	String kernel;
+	double signalNsPerSample;
+	double silenceNsPerSample;		// Worst window.
+	double ratio;
+	bool flat;
+};
+
+static double timeBlocks(BenchmarkKernel& kernel, AudioSampleBuffer& work, int start, int numSamples, int blockSize)
+{
+	const int64 startTicks = Time::getHighResolutionTicks();
+
+	for (int pos = start; pos + blockSize <= start + numSamples; pos += blockSize)
+	{
+		AudioSampleBuffer block(work.getArrayOfWritePointers(), work.getNumChannels(), pos, blockSize);
+		kernel.process(block);
+	}
+
+	return Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks) * 1.0e9 / numSamples;
+}
+
+static SilenceResult runSilenceBenchmark(BenchmarkKernel& kernel)
+{
+	const double sampleRate = BENCHMARK_SILENCE_SAMPLE_RATE;
+	const int signalLength = (int)sampleRate;
+	const int windowLength = (int)(BENCHMARK_SILENCE_WINDOW_SECONDS * sampleRate);
+	const int numWindows = (int)(BENCHMARK_SILENCE_SECONDS / BENCHMARK_SILENCE_WINDOW_SECONDS);
+
+	AudioSampleBuffer work(BENCHMARK_MAX_CHANNELS, signalLength + numWindows * windowLength);
+	work.clear();
+
+	AudioSampleBuffer signal(BENCHMARK_MAX_CHANNELS, signalLength);
+	fillTestSignal(signal, sampleRate);
+	for (int chan = 0; chan < BENCHMARK_MAX_CHANNELS; chan++)
+		work.copyFrom(chan, 0, signal, chan, 0, signalLength);
+
+	kernel.prepare(sampleRate, BENCHMARK_MAX_CHANNELS, BENCHMARK_SILENCE_BLOCK_SIZE);
+
+	// The first half of the signal warms up, the second half is the reference.
+	timeBlocks(kernel, work, 0, signalLength / 2, BENCHMARK_SILENCE_BLOCK_SIZE);
+
+	SilenceResult result;
+	result.kernel = kernel.getName();
+	result.signalNsPerSample = timeBlocks(kernel, work, signalLength / 2, signalLength / 2, BENCHMARK_SILENCE_BLOCK_SIZE);
+	result.silenceNsPerSample = 0.0;
+
+	for (int window = 0; window < numWindows; window++)
+		result.silenceNsPerSample = jmax(result.silenceNsPerSample, timeBlocks(kernel, work, signalLength + window * windowLength, windowLength, BENCHMARK_SILENCE_BLOCK_SIZE));
+
+	result.ratio = result.silenceNsPerSample / result.signalNsPerSample;
+	result.flat = result.ratio <= BENCHMARK_SILENCE_MAX_RATIO;
+	return result;
+}
+
+static var resultsToJson(const std::vector<BenchmarkResult>& results)
+{
+	DynamicObject::Ptr root = new DynamicObject();
+	root->setProperty("benchmark", "DreamControl DSP");
+	root->setProperty("signalLength", BENCHMARK_SIGNAL_LENGTH);
+
+	var resultArray;
+	for (const auto& result : results)
+	{
+		DynamicObject::Ptr item = new DynamicObject();
+		item->setProperty("kernel", result.kernel);
+		item->setProperty("sampleRate", result.sampleRate);
+		item->setProperty("channels", result.numChannels);
+		item->setProperty("blockSize", result.blockSize);
+		item->setProperty("passes", result.passes);
+		item->setProperty("nsPerSample", result.nsPerSample);
+		item->setProperty("realTimeFactor", result.realTimeFactor);
+		item->setProperty("worstBlockUs", result.worstBlockUs);
+		resultArray.append(var(item.get()));
+	}
+
+	root->setProperty("results", resultArray);
+	return var(root.get());
+}
+
+static var conformanceToJson(const std::vector<LoudnessConformance::Result>& results)
+{
+	var resultArray;
+	for (const auto& result : results)
+	{
+		DynamicObject::Ptr item = new DynamicObject();
+		item->setProperty("signal", result.signal);
+		item->setProperty("measurement", LoudnessConformance::getMeasurementName(result.measurement));
+		item->setProperty("sampleRate", result.sampleRate);
+		item->setProperty("blockSize", result.blockSize);
+		item->setProperty("expected", result.expected);
+		item->setProperty("measured", result.measured);
+		item->setProperty("passed", result.passed);
+		resultArray.append(var(item.get()));
+	}
+
+	return resultArray;
+}
+
+// The quick checks, before timing. Prints failures only. Returns true if all passed.
+static bool runConformance(bool json)
+{
+	const std::vector<LoudnessConformance::Result> results = LoudnessConformance::quick().run();
+	const bool passed = LoudnessConformance::allPassed(results);
+
+	if (json)
+	{
+		if (!passed)
+		{
+			DynamicObject::Ptr root = new DynamicObject();
+			root->setProperty("conformance", conformanceToJson(results));
+			root->setProperty("passed", passed);
+			printf("%s\n", JSON::toString(var(root.get())).toRawUTF8());
+		}
+		return passed;
+	}
+
+	int numFailed = 0;
+	for (const auto& result : results)
+	{
+		if (!result.passed)
+			numFailed++;
+
+		if (!result.passed)
+			printf("%-40s %-9s %6.0f %5d %8.2f %8.2f  %s\n", result.signal.toRawUTF8(),
+				LoudnessConformance::getMeasurementName(result.measurement).toRawUTF8(), result.sampleRate,
+				result.blockSize, result.expected, result.measured, result.passed ? "ok" : "FAILED");
+	}
+
+	printf("Conformance: %d checks, %d failed\n\n", (int)results.size(), numFailed);
+	return passed;
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+	StringArray args;
+	for (int i = 1; i < argc; i++)
+		args.add(argv[i]);
+
+	const bool json = args.contains("--json");
+	const bool quick = args.contains("--quick");
+	const String kernelFilter = args.indexOf("--kernel") >= 0 ? args[args.indexOf("--kernel") + 1] : String();
+	const double minTimeSeconds = args.indexOf("--min-time") >= 0 ? args[args.indexOf("--min-time") + 1].getDoubleValue() : BENCHMARK_DEFAULT_MIN_TIME_SECONDS;
+
+	if (args.contains("--help"))
+	{
+		printf("Usage: DreamControlBenchmark [--json] [--quick] [--kernel truePeak|lufs|lufsLoudness|ballistic|multiband|linearPhase|loudnessEq|roomCorrection] [--min-time <seconds>] [--no-check] [--silence]\n");
+		return 0;
+	}
+
+	if (args.contains("--silence"))
+	{
+		std::vector<std::unique_ptr<BenchmarkKernel>> kernels;
+		kernels.push_back(std::make_unique<TruePeakKernel>());
+		kernels.push_back(std::make_unique<LufsKernel>());
+		kernels.push_back(std::make_unique<BallisticKernel>());
+		kernels.push_back(std::make_unique<MultibandKernel>());
+		kernels.push_back(std::make_unique<LinearPhaseKernel>());
+		kernels.push_back(std::make_unique<LoudnessEqKernel>());
+		kernels.push_back(std::make_unique<RoomCorrectionKernel>());
+
+		bool flat = true;
+		var resultArray;
+
+		if (!json)
+			printf("%-12s %14s %15s %8s\n", "kernel", "signal ns/smp", "silence ns/smp", "ratio");
+
+		for (auto& kernel : kernels)
+		{
+			if (kernelFilter.isNotEmpty() && kernel->getName() != kernelFilter)
+				continue;
+
+			const SilenceResult result = runSilenceBenchmark(*kernel);
+			flat = flat && result.flat;
+
+			if (json)
+			{
+				DynamicObject::Ptr item = new DynamicObject();
+				item->setProperty("kernel", result.kernel);
+				item->setProperty("signalNsPerSample", result.signalNsPerSample);
+				item->setProperty("silenceNsPerSample", result.silenceNsPerSample);
+				item->setProperty("ratio", result.ratio);
+				item->setProperty("flat", result.flat);
+				resultArray.append(var(item.get()));
+			}
+			else
+			{
+				printf("%-12s %14.2f %15.2f %8.2f  %s\n", result.kernel.toRawUTF8(), result.signalNsPerSample,
+					result.silenceNsPerSample, result.ratio, result.flat ? "ok" : "SPIKE");
+			}
+		}
+
+		if (json)
+		{
+			DynamicObject::Ptr root = new DynamicObject();
+			root->setProperty("silence", resultArray);
+			root->setProperty("passed", flat);
+			printf("%s\n", JSON::toString(var(root.get())).toRawUTF8());
+		}
+
+		return flat ? 0 : 1;
+	}
+
+	if (!args.contains("--no-check") && !runConformance(json))
+	{
+		fprintf(stderr, "Meter engine fails conformance, not benchmarking it.\n");
+		return 1;
+	}
+
+	std::vector<std::unique_ptr<BenchmarkKernel>> kernels;
+	kernels.push_back(std::make_unique<TruePeakKernel>());
+	kernels.push_back(std::make_unique<LufsKernel>());
+	kernels.push_back(std::make_unique<LufsKernel>("lufsLoudness", LufsProcessor::AllMeters & ~LufsProcessor::TruePeakMeter));
+	kernels.push_back(std::make_unique<BallisticKernel>());
+	kernels.push_back(std::make_unique<MultibandKernel>());
+	kernels.push_back(std::make_unique<LinearPhaseKernel>());
+	kernels.push_back(std::make_unique<LoudnessEqKernel>());
+	kernels.push_back(std::make_unique<RoomCorrectionKernel>());
+
+	std::vector<BenchmarkResult> results;
+
+	if (!json)
+		printf("%-12s %9s %3s %6s %12s %12s %12s\n", "kernel", "rate", "ch", "block", "ns/sample", "x realtime", "worst us");
+
+	for (auto& kernel : kernels)
+	{
+		if (kernelFilter.isNotEmpty() && kernel->getName() != kernelFilter)
+			continue;
+
+		for (double sampleRate : benchmarkSampleRates)
+		{
+			// Quick mode: just the two common rates.
+			if (quick && sampleRate != 48000.0 && sampleRate != 96000.0)
+				continue;
+
+			for (int numChannels = 1; numChannels <= BENCHMARK_MAX_CHANNELS; numChannels++)
+			{
+				AudioSampleBuffer signal(numChannels, BENCHMARK_SIGNAL_LENGTH);
+				fillTestSignal(signal, sampleRate);
+
+				for (int blockSize : benchmarkBlockSizes)
+				{
+					const BenchmarkResult result = runBenchmark(*kernel, signal, sampleRate, blockSize, minTimeSeconds);
+					results.push_back(result);
+
+					if (!json)
+						printf("%-12s %9.0f %3d %6d %12.2f %12.1f %12.1f\n", result.kernel.toRawUTF8(), result.sampleRate,
+							result.numChannels, result.blockSize, result.nsPerSample, result.realTimeFactor, result.worstBlockUs);
+				}
+			}
+		}
+	}
+
+	if (json)
+		printf("%s\n", JSON::toString(resultsToJson(results)).toRawUTF8());
+
+	return 0;
+}
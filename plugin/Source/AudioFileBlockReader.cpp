@@ -0,0 +1,79 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "AudioFileBlockReader.h"
+
+AudioFileBlockReader::AudioFileBlockReader(AudioFormatManager& formatManager, const File& file, int blockSize)
+	: mappedReader(nullptr), blockSize(jmax(1, blockSize)), position(0), endPosition(0), failed(false)
+{
+	if (AudioFormat* format = formatManager.findFormatForFileExtension(file.getFileExtension()))
+	{
+		mappedReader = format->createMemoryMappedReader(file);
+		reader.reset(mappedReader);
+	}
+
+	if (reader == nullptr)
+		reader.reset(formatManager.createReaderFor(file));
+
+	if (reader != nullptr)
+	{
+		endPosition = reader->lengthInSamples;
+		buffer.setSize((int)reader->numChannels, this->blockSize);
+	}
+}
+
+void AudioFileBlockReader::setSampleRange(int64 start, int64 end)
+{
+	if (reader == nullptr)
+		return;
+
+	endPosition = jlimit((int64)0, reader->lengthInSamples, end);
+	position = jlimit((int64)0, endPosition, start);
+}
+
+AudioSampleBuffer* AudioFileBlockReader::readNextBlock()
+{
+	if (reader == nullptr || failed || position >= endPosition)
+		return nullptr;
+
+	const int numSamples = (int)jmin((int64)blockSize, endPosition - position);
+
+	if (mappedReader != nullptr && !mapSectionFor(position, numSamples))
+	{
+		failed = true;
+		return nullptr;
+	}
+
+	if (!reader->read(&buffer, 0, numSamples, position, true, true))
+	{
+		failed = true;
+		return nullptr;
+	}
+
+	block.setDataToReferTo(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), numSamples);
+	position += numSamples;
+	return &block;
+}
+
+bool AudioFileBlockReader::mapSectionFor(int64 start, int numSamples)
+{
+	const Range<int64> needed(start, start + numSamples);
+
+	if (mappedReader->getMappedSection().contains(needed))
+		return true;
+
+	const int64 end = jmin(endPosition, start + jmax((int64)AUDIO_FILE_BLOCK_READER_MAP_WINDOW, (int64)numSamples));
+	return mappedReader->mapSectionOfFile(Range<int64>(start, end)) && mappedReader->getMappedSection().contains(needed);
+}
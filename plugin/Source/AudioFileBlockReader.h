@@ -0,0 +1,67 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <memory>
+
+#include <JuceHeader.h>
+
+#define AUDIO_FILE_BLOCK_READER_MAP_WINDOW (1 << 22)		// Sample frames mapped at a time, so long files don't need lots of address space.
+
+//==============================================================================
+/**
+	Reads an audio file block by block, for offline measurement.
+
+	WAV and AIFF files are memory mapped, so samples are converted straight from
+	the mapped file into the block buffer, with no file sized buffers and no
+	stream reads. Other formats (e.g. FLAC) fall back to a normal streaming reader.
+	Either way, memory use only depends on the block size.
+*/
+class AudioFileBlockReader
+{
+public:
+	AudioFileBlockReader(AudioFormatManager& formatManager, const File& file, int blockSize);
+
+	bool isOpen() const							{ return reader != nullptr; }
+	bool isMemoryMapped() const					{ return mappedReader != nullptr; }
+	AudioFormatReader* getReader() const		{ return reader.get(); }
+
+	// Reads the next block into a buffer owned by this reader, which stays valid until the next call.
+	// The last block may be shorter. Returns nullptr at the end of the file, or if the file can't be mapped or read (see hasFailed()).
+	AudioSampleBuffer* readNextBlock();
+
+	bool hasFailed() const						{ return failed; }
+	int64 getPosition() const					{ return position; }
+
+	// Reads only samples from start to end, instead of the whole file.
+	void setSampleRange(int64 start, int64 end);
+
+private:
+	bool mapSectionFor(int64 start, int numSamples);
+
+	std::unique_ptr<AudioFormatReader> reader;
+	MemoryMappedAudioFormatReader* mappedReader;		// Same object as reader, if the file is mapped.
+
+	int blockSize;
+	int64 position;
+	int64 endPosition;
+	bool failed;
+
+	AudioSampleBuffer buffer;
+	AudioSampleBuffer block;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioFileBlockReader)
+};
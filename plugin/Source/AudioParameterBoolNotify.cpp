@@ -13,5 +13,29 @@ AudioParameterBoolNotify::AudioParameterBoolNotify(const String& parameterID, co
 
 void AudioParameterBoolNotify::valueChanged(bool newValue)
 {
-	myValueChangedFunction(paramID, newValue);
+	if (!notificationsSuspended)
+		myValueChangedFunction(paramID, newValue);
+}
+
+void AudioParameterBoolNotify::suspendNotifications()
+{
+	if (!notificationsSuspended)
+		valueWhenSuspended = get();
+
+	notificationsSuspended = true;
+}
+
+bool AudioParameterBoolNotify::resumeNotifications()
+{
+	if (!notificationsSuspended)
+		return false;
+
+	notificationsSuspended = false;
+
+	return get() != valueWhenSuspended;
+}
+
+void AudioParameterBoolNotify::notifyValueChanged()
+{
+	myValueChangedFunction(paramID, get());
 }
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <functional>
-#include "../JuceLibraryCode/JuceHeader.h"
+#include <JuceHeader.h>
 
 class AudioParameterBoolNotify : public AudioParameterBool
 {
@@ -14,6 +14,16 @@ public:
 
 	void valueChanged(bool newValue) override;
 
+	// While suspended, value changes don't call the notify function. Resuming doesn't call it either, it returns
+	// whether the value changed, so the owner can apply a batch of changes at once.
+	void suspendNotifications();
+	bool resumeNotifications();
+
+	// Calls the notify function with the current value.
+	void notifyValueChanged();
+
 private:
 	std::function<void(const String&, bool)> myValueChangedFunction;
-};
\ No newline at end of file
+	bool notificationsSuspended = false;
+	bool valueWhenSuspended = false;
+};
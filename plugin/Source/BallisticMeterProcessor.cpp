@@ -0,0 +1,264 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "BallisticMeterProcessor.h"
+#include "DspUtils.h"
+
+// The states are flushed every this many samples of the stream, counted across blocks, so where the
+// host splits the audio into blocks doesn't change the readings.
+#define BALLISTIC_METER_FLUSH_SAMPLES 64
+
+// A held level stays until a higher one, or its time is up, then follows the meter down. Written
+// without branches, as it runs for every meter on every sample.
+static inline void updateHold(float meter, float& hold, int& holdSamplesRemaining, int holdSamples)
+{
+	const bool higher = meter >= hold;
+	hold = higher || holdSamplesRemaining <= 0 ? meter : hold;
+	holdSamplesRemaining = higher ? holdSamples : holdSamplesRemaining - (holdSamplesRemaining > 0 ? 1 : 0);
+}
+
+BallisticMeterProcessor::BallisticMeterProcessor()
+	: stereoCoefficient(1.0f), correlation(0.0f), balance(0.0f),
+	peakFall(0.0f), rmsCoefficient(1.0f), vuCoefficient(1.0f), ppmAttack(1.0f), ppmFall(0.0f),
+	sampleRate(44100.0), numChannels(0), enabled(false), wasEnabled(false), holdSeconds(0.0f),
+	correlationMs(BALLISTIC_METER_DEFAULT_CORRELATION_MS), stageTiming(nullptr)
+{
+	reset();
+}
+
+void BallisticMeterProcessor::prepareToPlay(double newSampleRate, int newNumChannels)
+{
+	sampleRate = newSampleRate;
+	numChannels = jmin(newNumChannels, BALLISTIC_METER_MAX_CHANNELS);
+
+	// Falls are a constant number of dB per second, so a constant factor per sample.
+	peakFall = Decibels::decibelsToGain((float)(-BALLISTIC_METER_PEAK_FALL_DB_PER_SECOND / sampleRate));
+	ppmFall = Decibels::decibelsToGain((float)(-BALLISTIC_METER_PPM_FALL_DB_PER_SECOND / sampleRate));
+
+	// One pole lowpasses: y += c * (x - y).
+	rmsCoefficient = (float)(1.0 - std::exp(-1000.0 / (BALLISTIC_METER_RMS_MS * sampleRate)));
+	vuCoefficient = (float)(1.0 - std::exp(-1000.0 / (BALLISTIC_METER_VU_MS * sampleRate)));
+	ppmAttack = (float)(1.0 - std::exp(-1000.0 / (BALLISTIC_METER_PPM_ATTACK_MS * sampleRate)));
+
+	reset();
+}
+
+void BallisticMeterProcessor::reset()
+{
+	for (int chan = 0; chan < BALLISTIC_METER_MAX_CHANNELS; chan++)
+	{
+		ChannelState& state = channelStates[chan];
+		state.peak = state.meanSquare = state.vuAverage = state.vuLevel = state.ppm = 0.0f;
+		state.samplesToFlush = BALLISTIC_METER_FLUSH_SAMPLES;
+
+		for (int ballistics = 0; ballistics < numBallistics; ballistics++)
+		{
+			state.hold[ballistics] = 0.0f;
+			state.holdSamplesRemaining[ballistics] = 0;
+			levels[chan][ballistics] = BALLISTIC_METER_MIN_DB;
+			holds[chan][ballistics] = BALLISTIC_METER_MIN_DB;
+		}
+	}
+
+	stereoState.leftSquare = stereoState.rightSquare = stereoState.product = 0.0f;
+	correlation = 0.0f;
+	balance = 0.0f;
+}
+
+void BallisticMeterProcessor::process(const AudioSampleBuffer& buffer)
+{
+	if (!enabled.load(std::memory_order_relaxed))
+	{
+		wasEnabled = false;
+		return;
+	}
+
+	STAGE_TIMING_SCOPE(stageTiming, StageTiming::ballisticMeters);
+
+	// The decays end up in denormals on silence. The plugin flushes them already, the meter analysis thread doesn't.
+	const ScopedNoDenormals noDenormals;
+
+	if (!wasEnabled)
+	{
+		reset();
+		wasEnabled = true;
+	}
+
+	const int holdSamples = (int)(holdSeconds.load(std::memory_order_relaxed) * sampleRate);
+	const int numSamples = buffer.getNumSamples();
+	const int numChannelsToProcess = jmin(numChannels, buffer.getNumChannels());
+	stereoCoefficient = (float)(1.0 - std::exp(-1000.0 / (jmax(1.0f, correlationMs.load(std::memory_order_relaxed)) * sampleRate)));
+
+	if (numChannelsToProcess > 0)
+		processChannel<false>(channelStates[0], buffer.getReadPointer(0), nullptr, numSamples, holdSamples, levels[0], holds[0]);
+
+	if (numChannelsToProcess > 1)
+	{
+		processChannel<true>(channelStates[1], buffer.getReadPointer(1), buffer.getReadPointer(0), numSamples, holdSamples, levels[1], holds[1]);
+		updateStereo();
+	}
+}
+
+template <bool measureStereo>
+void BallisticMeterProcessor::processChannel(ChannelState& state, const float* data, const float* left, int numSamples, int holdSamples, std::atomic<float>* channelLevels, std::atomic<float>* channelHolds)
+{
+	// One pass for all four meters and their holds, and for the right channel, the stereo means. Each
+	// is a recursion from one sample to the next, so they can't be vectorised across samples; the state
+	// is copied to locals so it stays in registers. Holds are per sample and flushing is at fixed points
+	// in the stream, so the readings at the end of a block don't depend on how the audio was split.
+	float peak = state.peak;
+	float meanSquare = state.meanSquare;
+	float vuAverage = state.vuAverage;
+	float vuLevel = state.vuLevel;
+	float ppm = state.ppm;
+	float maxMeanSquare = 0.0f;
+	float maxVuLevel = 0.0f;
+	float maxPpm = 0.0f;
+	float maxPeak = 0.0f;
+	float leftSquare = stereoState.leftSquare;
+	float rightSquare = stereoState.rightSquare;
+	float product = stereoState.product;
+	float peakHold = state.hold[BallisticMeterProcessor::samplePeak];
+	float rmsHold = state.hold[BallisticMeterProcessor::rms];
+	float vuHold = state.hold[BallisticMeterProcessor::vu];
+	float ppmHold = state.hold[BallisticMeterProcessor::ppm];
+	int peakHoldRemaining = state.holdSamplesRemaining[BallisticMeterProcessor::samplePeak];
+	int rmsHoldRemaining = state.holdSamplesRemaining[BallisticMeterProcessor::rms];
+	int vuHoldRemaining = state.holdSamplesRemaining[BallisticMeterProcessor::vu];
+	int ppmHoldRemaining = state.holdSamplesRemaining[BallisticMeterProcessor::ppm];
+
+	for (int start = 0; start < numSamples;)
+	{
+		const int end = start + jmin(numSamples - start, state.samplesToFlush);
+
+		for (int sample = start; sample < end; sample++)
+		{
+			const float x = data[sample];
+			const float rectified = std::abs(x);
+
+			// Sample peak: instant attack.
+			peak = jmax(rectified, peak * peakFall);
+
+			// RMS: exponentially weighted mean square.
+			meanSquare += rmsCoefficient * (x * x - meanSquare);
+
+			// VU: full wave average, through two lowpasses for the needle.
+			vuAverage += vuCoefficient * (rectified - vuAverage);
+			vuLevel += vuCoefficient * (vuAverage - vuLevel);
+
+			// PPM: quasi peak, charged quickly by peaks above it.
+			ppm = rectified > ppm ? ppm + ppmAttack * (rectified - ppm) : ppm * ppmFall;
+
+			updateHold(peak, peakHold, peakHoldRemaining, holdSamples);
+			updateHold(meanSquare, rmsHold, rmsHoldRemaining, holdSamples);
+			updateHold(vuLevel, vuHold, vuHoldRemaining, holdSamples);
+			updateHold(ppm, ppmHold, ppmHoldRemaining, holdSamples);
+
+			maxPeak = jmax(maxPeak, peak);
+			maxMeanSquare = jmax(maxMeanSquare, meanSquare);
+			maxVuLevel = jmax(maxVuLevel, vuLevel);
+			maxPpm = jmax(maxPpm, ppm);
+
+			if (measureStereo)
+			{
+				const float l = left[sample];
+				leftSquare += stereoCoefficient * (l * l - leftSquare);
+				rightSquare += stereoCoefficient * (x * x - rightSquare);
+				product += stereoCoefficient * (l * x - product);
+			}
+		}
+
+		state.samplesToFlush -= end - start;
+		start = end;
+
+		if (state.samplesToFlush == 0)
+		{
+			snapToZero(peak);
+			snapToZero(meanSquare);
+			snapToZero(vuAverage);
+			snapToZero(vuLevel);
+			snapToZero(ppm);
+
+			if (measureStereo)
+			{
+				snapToZero(leftSquare);
+				snapToZero(rightSquare);
+				snapToZero(product);
+			}
+
+			state.samplesToFlush = BALLISTIC_METER_FLUSH_SAMPLES;
+		}
+	}
+
+	if (measureStereo)
+	{
+		stereoState.leftSquare = leftSquare;
+		stereoState.rightSquare = rightSquare;
+		stereoState.product = product;
+	}
+
+	state.peak = peak;
+	state.meanSquare = meanSquare;
+	state.vuAverage = vuAverage;
+	state.vuLevel = vuLevel;
+	state.ppm = ppm;
+
+	const float blockMaxima[numBallistics] = { maxPeak, maxMeanSquare, maxVuLevel, maxPpm };
+	const float holdValues[numBallistics] = { peakHold, rmsHold, vuHold, ppmHold };
+	const int holdRemaining[numBallistics] = { peakHoldRemaining, rmsHoldRemaining, vuHoldRemaining, ppmHoldRemaining };
+
+	for (int ballistics = 0; ballistics < numBallistics; ballistics++)
+	{
+		state.hold[ballistics] = holdValues[ballistics];
+		state.holdSamplesRemaining[ballistics] = holdRemaining[ballistics];
+
+		channelLevels[ballistics].store(toDecibels((Ballistics)ballistics, blockMaxima[ballistics]), std::memory_order_relaxed);
+		channelHolds[ballistics].store(toDecibels((Ballistics)ballistics, holdValues[ballistics]), std::memory_order_relaxed);
+	}
+}
+
+// AES-17 scaling: RMS 3 dB up, and the average of a rectified sine is 2/pi of its peak.
+float BallisticMeterProcessor::toDecibels(Ballistics ballistics, float value)
+{
+	switch (ballistics)
+	{
+		case rms:	return Decibels::gainToDecibels(std::sqrt(2.0f * value), BALLISTIC_METER_MIN_DB);
+		case vu:	return Decibels::gainToDecibels(0.5f * float_Pi * value, BALLISTIC_METER_MIN_DB);
+		default:	return Decibels::gainToDecibels(value, BALLISTIC_METER_MIN_DB);
+	}
+}
+
+void BallisticMeterProcessor::updateStereo()
+{
+	const float leftSquare = stereoState.leftSquare;
+	const float rightSquare = stereoState.rightSquare;
+
+	// Silence has no correlation or balance. One silent channel is uncorrelated and all the way over.
+	float newCorrelation = 0.0f;
+	float newBalance = 0.0f;
+
+	if (leftSquare > 0.0f && rightSquare > 0.0f)
+	{
+		newCorrelation = jlimit(-1.0f, 1.0f, stereoState.product / std::sqrt(leftSquare * rightSquare));
+		newBalance = jlimit(-BALLISTIC_METER_MAX_BALANCE_DB, BALLISTIC_METER_MAX_BALANCE_DB, 10.0f * std::log10(rightSquare / leftSquare));
+	}
+	else if (leftSquare > 0.0f || rightSquare > 0.0f)
+	{
+		newBalance = leftSquare > 0.0f ? -BALLISTIC_METER_MAX_BALANCE_DB : BALLISTIC_METER_MAX_BALANCE_DB;
+	}
+
+	correlation.store(newCorrelation, std::memory_order_relaxed);
+	balance.store(newBalance, std::memory_order_relaxed);
+}
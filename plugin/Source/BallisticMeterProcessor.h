@@ -0,0 +1,139 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+
+#include <JuceHeader.h>
+#include "StageTiming.h"
+
+#define BALLISTIC_METER_MAX_CHANNELS 2
+#define BALLISTIC_METER_MIN_DB -100.0f
+#define BALLISTIC_METER_PEAK_FALL_DB_PER_SECOND (20.0 / 1.7)	// Sample peak (IEC 60268-18): falls 20 dB in 1.7 s.
+#define BALLISTIC_METER_RMS_MS 300.0							// RMS averaging time constant.
+#define BALLISTIC_METER_VU_MS 45.2								// Two in series reach 99% of a step in 300 ms, as a VU needle does.
+#define BALLISTIC_METER_PPM_ATTACK_MS 2.5						// PPM (IEC 60268-10 type II): a 10 ms 5 kHz burst reads 2 dB low...
+#define BALLISTIC_METER_PPM_FALL_DB_PER_SECOND (24.0 / 2.8)	// ...and it falls 24 dB in 2.8 s.
+#define BALLISTIC_METER_DEFAULT_CORRELATION_MS 300.0f
+#define BALLISTIC_METER_MAX_BALANCE_DB 24.0f
+
+//==============================================================================
+/**
+	Sample peak, RMS, VU and PPM meters with peak hold, and stereo correlation and
+	balance, for the surface's LED bars.
+
+	All four are measured in the same pass over each channel, and correlation and
+	balance in the right channel's pass, from running means of L*L, R*R and L*R. Levels are in dBFS,
+	scaled as AES-17 does, so a sine reads its peak level on every meter: 0 VU is
+	wherever the surface puts it (the EBU's -18 dBFS). BBC and EBU PPMs have the
+	same ballistics, only their scales differ.
+
+	process() is called on one thread (the audio or meter analysis thread), the
+	levels are read on any other.
+*/
+class BallisticMeterProcessor
+{
+public:
+	enum Ballistics
+	{
+		samplePeak,
+		rms,
+		vu,
+		ppm,
+		numBallistics
+	};
+
+	BallisticMeterProcessor();
+
+	void prepareToPlay(double sampleRate, int numChannels);
+
+	// Any thread. Nothing is measured until enabled, and meters start from silence when it is.
+	void setEnabled(bool shouldBeEnabled) { enabled = shouldBeEnabled; }
+
+	// Any thread. Levels are held this long before falling, 0 for no hold.
+	void setHoldTime(float seconds) { holdSeconds = seconds; }
+
+	// Any thread. Time constant of the correlation and balance means.
+	void setCorrelationTime(float ms) { correlationMs = ms; }
+
+	void process(const AudioSampleBuffer& buffer);
+
+	// Highest level in the last block, and the held level, in dBFS.
+	float getLevel(int channel, Ballistics ballistics) const { return levels[channel][ballistics].load(std::memory_order_relaxed); }
+	float getHold(int channel, Ballistics ballistics) const { return holds[channel][ballistics].load(std::memory_order_relaxed); }
+
+	// -1 (out of phase) to +1 (mono), 0 on silence or a single channel.
+	float getCorrelation() const { return correlation.load(std::memory_order_relaxed); }
+
+	// Right level over left in dB, within +/- BALLISTIC_METER_MAX_BALANCE_DB.
+	float getBalance() const { return balance.load(std::memory_order_relaxed); }
+
+	inline void setStageTiming(StageTiming* timing) { stageTiming = timing; }
+
+private:
+	// Linear ballistic state of one channel, and the held values (linear too: peak, mean square, VU
+	// needle, PPM) with the samples left to hold them.
+	struct ChannelState
+	{
+		float peak;
+		float meanSquare;
+		float vuAverage;
+		float vuLevel;
+		float ppm;
+		float hold[numBallistics];
+		int holdSamplesRemaining[numBallistics];
+		int samplesToFlush;
+	};
+
+	// Running means for correlation and balance.
+	struct StereoState
+	{
+		float leftSquare;
+		float rightSquare;
+		float product;
+	};
+
+	void reset();
+	static float toDecibels(Ballistics ballistics, float value);
+	template <bool measureStereo>
+	void processChannel(ChannelState& state, const float* data, const float* left, int numSamples, int holdSamples, std::atomic<float>* channelLevels, std::atomic<float>* channelHolds);
+	void updateStereo();
+
+	ChannelState channelStates[BALLISTIC_METER_MAX_CHANNELS];
+	std::atomic<float> levels[BALLISTIC_METER_MAX_CHANNELS][numBallistics];
+	std::atomic<float> holds[BALLISTIC_METER_MAX_CHANNELS][numBallistics];
+
+	StereoState stereoState;
+	float stereoCoefficient;
+	std::atomic<float> correlation;
+	std::atomic<float> balance;
+
+	float peakFall;
+	float rmsCoefficient;
+	float vuCoefficient;
+	float ppmAttack;
+	float ppmFall;
+
+	double sampleRate;
+	int numChannels;
+	std::atomic<bool> enabled;
+	bool wasEnabled;
+	std::atomic<float> holdSeconds;
+	std::atomic<float> correlationMs;
+	StageTiming* stageTiming;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BallisticMeterProcessor)
+};
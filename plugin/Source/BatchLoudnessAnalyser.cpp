@@ -0,0 +1,177 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include <limits>
+#include <memory>
+
+#include "BatchLoudnessAnalyser.h"
+#include "LufsProcessor.h"
+
+BatchLoudnessAnalyser::BatchLoudnessAnalyser(int numWorkers, int chunkSize)
+	: numWorkers(jmax(1, numWorkers)), chunkSize(chunkSize), nextSegment(0)
+{
+}
+
+std::vector<FileLoudnessAnalyser::Result> BatchLoudnessAnalyser::analyse(const Array<File>& filesToAnalyse)
+{
+	std::vector<FileLoudnessAnalyser::Result> batchResults(filesToAnalyse.size());
+
+	files = &filesToAnalyse;
+	results = &batchResults;
+	planSegments();
+	nextSegment = 0;
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	for (int i = 0; i < jmin(numWorkers, (int)segments.size()); i++)
+	{
+		workers.push_back(std::make_unique<Worker>(*this));
+		workers.back()->startThread();
+	}
+
+	for (auto& worker : workers)
+		worker->waitForThreadToExit(-1);
+
+	mergeSegments();
+
+	segments.clear();
+	segmentResults.clear();
+	segmentStates.clear();
+	files = nullptr;
+	results = nullptr;
+	return batchResults;
+}
+
+void BatchLoudnessAnalyser::planSegments()
+{
+	segments.clear();
+
+	// Files are split when there are several workers, and when they are long compared
+	// to what each worker would get with whole files. Files too long for one LufsProcessor
+	// are always split.
+	std::vector<int> numPositions(files->size(), -1);
+	int64 totalPositions = 0;
+	FileLoudnessAnalyser analyser(chunkSize);
+
+	for (int i = 0; i < files->size(); i++)
+	{
+		numPositions[i] = analyser.getNumPositions((*files)[i]);
+		totalPositions += jmax(0, numPositions[i]);
+	}
+
+	const int64 segmentPositions = numWorkers > 1
+		? jmax((int64)BATCH_LOUDNESS_MIN_SEGMENT_SECONDS * 10, totalPositions / (numWorkers * BATCH_LOUDNESS_SEGMENTS_PER_WORKER))
+		: std::numeric_limits<int>::max();
+	const int maxSegmentPositions = LUFS_MAX_POSITIONS - LUFS_SEGMENT_WARM_UP_POSITIONS;
+	int numParts = 0;
+
+	for (int i = 0; i < files->size(); i++)
+	{
+		const int numSegments = (int)jmax((int64)1, jmax(numPositions[i] / segmentPositions,
+			((int64)numPositions[i] + maxSegmentPositions - 1) / maxSegmentPositions));
+
+		if (numSegments == 1)
+		{
+			segments.push_back({ i, 0, 0, -1 });
+			continue;
+		}
+
+		for (int j = 0; j < numSegments; j++)
+		{
+			const int first = (int)((int64)numPositions[i] * j / numSegments);
+			const int end = (int)((int64)numPositions[i] * (j + 1) / numSegments);
+			segments.push_back({ i, first, end, numParts++ });
+		}
+	}
+
+	segmentResults.assign(numParts, FileLoudnessAnalyser::Result());
+	segmentStates.assign(numParts, LufsGatingState());
+}
+
+void BatchLoudnessAnalyser::mergeSegments()
+{
+	// Segments of a file are next to each other.
+	for (size_t i = 0; i < segments.size(); i++)
+	{
+		const Segment& first = segments[i];
+		if (first.partIndex < 0)
+			continue;
+
+		FileLoudnessAnalyser::Result& result = (*results)[first.fileIndex];
+		result = segmentResults[first.partIndex];
+		LufsGatingState& gatingState = segmentStates[first.partIndex];
+
+		for (; i + 1 < segments.size() && segments[i + 1].fileIndex == first.fileIndex; i++)
+		{
+			const int partIndex = segments[i + 1].partIndex;
+
+			if (result.ok && !segmentResults[partIndex].ok)
+				result = segmentResults[partIndex];
+
+			gatingState.merge(segmentStates[partIndex]);
+		}
+
+		if (result.ok)
+			FileLoudnessAnalyser::setMeasurements(result, gatingState);
+	}
+}
+
+BatchLoudnessAnalyser::Summary BatchLoudnessAnalyser::summarise(const std::vector<FileLoudnessAnalyser::Result>& results)
+{
+	Summary summary;
+	summary.numFiles = (int)results.size();
+	summary.minIntegrated = summary.maxIntegrated = summary.maxTruePeak = DEFAULT_MIN_VOLUME;
+
+	bool first = true;
+	for (const auto& result : results)
+	{
+		if (!result.ok)
+		{
+			summary.numFailed++;
+			continue;
+		}
+
+		summary.totalDurationSeconds += result.durationSeconds;
+		summary.minIntegrated = first ? result.integrated : jmin(summary.minIntegrated, result.integrated);
+		summary.maxIntegrated = first ? result.integrated : jmax(summary.maxIntegrated, result.integrated);
+		summary.maxTruePeak = jmax(summary.maxTruePeak, result.truePeak);
+		first = false;
+	}
+
+	return summary;
+}
+
+//==============================================================================
+BatchLoudnessAnalyser::Worker::Worker(BatchLoudnessAnalyser& owner)
+	: Thread("Loudness analyser"), owner(owner), analyser(owner.chunkSize)
+{
+}
+
+void BatchLoudnessAnalyser::Worker::run()
+{
+	for (;;)
+	{
+		const int index = owner.nextSegment++;
+		if (index >= (int)owner.segments.size() || threadShouldExit())
+			break;
+
+		const Segment& segment = owner.segments[index];
+		const File file = (*owner.files)[segment.fileIndex];
+
+		if (segment.partIndex < 0)
+			(*owner.results)[segment.fileIndex] = analyser.analyse(file);
+		else
+			owner.segmentResults[segment.partIndex] = analyser.analyseSegment(file, segment.firstPosition, segment.endPosition, owner.segmentStates[segment.partIndex]);
+	}
+}
@@ -0,0 +1,97 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include <JuceHeader.h>
+#include "FileLoudnessAnalyser.h"
+
+#define BATCH_LOUDNESS_MIN_SEGMENT_SECONDS 60		// Shorter files are never split.
+#define BATCH_LOUDNESS_SEGMENTS_PER_WORKER 2
+
+//==============================================================================
+/**
+	Measures many files in parallel.
+
+	Files much longer than their share of the batch are split into segments, so a
+	single long file (a film, a day of broadcast) uses all the workers too. Files too
+	long for one LufsProcessor (LUFS_MAX_POSITIONS) are split even with one worker.
+	Segment gating states are merged, so the numbers are the same as measuring the file
+	in one go.
+
+	Each worker has its own FileLoudnessAnalyser, so memory use is bounded per
+	worker (one chunk buffer and one LufsProcessor) whatever the number or length
+	of the files. Idle workers take the next file or segment, so a few long files
+	don't leave the other cores waiting.
+*/
+class BatchLoudnessAnalyser
+{
+public:
+	struct Summary
+	{
+		int numFiles = 0;
+		int numFailed = 0;
+		double totalDurationSeconds = 0.0;
+		float minIntegrated = 0.0f;
+		float maxIntegrated = 0.0f;
+		float maxTruePeak = 0.0f;
+	};
+
+	BatchLoudnessAnalyser(int numWorkers, int chunkSize = FILE_LOUDNESS_ANALYSER_DEFAULT_CHUNK_SIZE);
+
+	// Results are in the same order as the files.
+	std::vector<FileLoudnessAnalyser::Result> analyse(const Array<File>& files);
+
+	static Summary summarise(const std::vector<FileLoudnessAnalyser::Result>& results);
+
+private:
+	struct Segment
+	{
+		int fileIndex;
+		int firstPosition;
+		int endPosition;
+		int partIndex;									// Index in segmentResults and segmentStates, -1 if the file isn't split.
+	};
+
+	void planSegments();
+	void mergeSegments();
+
+	class Worker : public Thread
+	{
+	public:
+		Worker(BatchLoudnessAnalyser& owner);
+		void run() override;
+
+	private:
+		BatchLoudnessAnalyser& owner;
+		FileLoudnessAnalyser analyser;
+	};
+
+	int numWorkers;
+	int chunkSize;
+
+	// Current batch, shared with the workers.
+	const Array<File>* files = nullptr;
+	std::vector<FileLoudnessAnalyser::Result>* results = nullptr;
+	std::vector<Segment> segments;
+	std::vector<FileLoudnessAnalyser::Result> segmentResults;
+	std::vector<LufsGatingState> segmentStates;
+	std::atomic<int> nextSegment;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BatchLoudnessAnalyser)
+};
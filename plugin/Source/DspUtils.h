@@ -0,0 +1,32 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+// Filter and meter states decay towards zero on silence, and end up in denormals, which are very slow
+// on x86. The audio thread sets FTZ/DAZ, but offline analysis and the meter analysis thread don't, so
+// the DSP flushes its own state. The threshold is about -300 dB: far below anything measured or heard
+// (the ballistic meters' mean square is a squared level), but far above denormals.
+inline void snapToZero(float& n)
+{
+	if (!(n < -1.0e-15f || n > 1.0e-15f))
+		n = 0.0f;
+}
+
+inline void snapToZero(double& n)
+{
+	if (!(n < -1.0e-15 || n > 1.0e-15))
+		n = 0.0;
+}
@@ -0,0 +1,174 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include <cstdlib>
+
+#include "FaderBridge.h"
+
+#define FADER_BRIDGE_DEFAULT_RATE_HZ 200.0f
+#define FADER_BRIDGE_ECHO_WINDOW_MS 300.0			// How long after sending a value we treat the same value coming back as an echo.
+#define FADER_BRIDGE_ECHO_TOLERANCE 1				// Float conversion in the DAW can round the value by 1.
+
+FaderBridge::FaderBridge(std::function<void(int value)> sendToDaw, std::function<void(int value)> sendToHardware)
+	: sendToDawFunction(sendToDaw), sendToHardwareFunction(sendToHardware), touched(false)
+{
+	setMaxRate(FADER_BRIDGE_DEFAULT_RATE_HZ);
+	reset();
+}
+
+void FaderBridge::setMaxRate(float rateHz)
+{
+	const SpinLock::ScopedLockType sl(lock);
+	minIntervalMs = rateHz > 0.0f ? 1000.0 / rateHz : 0.0;
+}
+
+void FaderBridge::setTouched(bool isTouched)
+{
+	touched = isTouched;
+
+	// When released, send the latest DAW value straight away so the motor follows automation again.
+	if (!isTouched)
+		flush();
+}
+
+void FaderBridge::faderMoved(int value)
+{
+	int valueToSend;
+	bool send = false;
+	const double nowMs = Time::getMillisecondCounterHiRes();
+	value = jlimit(0, FADER_BRIDGE_MAX_VALUE, value);
+
+	{
+		const SpinLock::ScopedLockType sl(lock);
+
+		// If the fader isn't being touched, this is the motor reporting the position we just sent it.
+		if (!touched && std::abs(value - toHardware.lastSentValue) <= FADER_BRIDGE_ECHO_TOLERANCE
+			&& nowMs - toHardware.lastSendTimeMs < FADER_BRIDGE_ECHO_WINDOW_MS)
+			return;
+
+		toDaw.pendingValue = value;
+		send = takeIfDue(toDaw, nowMs, valueToSend);
+		if (send) rememberSentToDaw(valueToSend, nowMs);
+	}
+
+	if (send && sendToDawFunction != nullptr)
+		sendToDawFunction(valueToSend);
+}
+
+void FaderBridge::dawVolumeChanged(int value)
+{
+	int valueToSend;
+	bool send = false;
+	const double nowMs = Time::getMillisecondCounterHiRes();
+	value = jlimit(0, FADER_BRIDGE_MAX_VALUE, value);
+
+	{
+		const SpinLock::ScopedLockType sl(lock);
+
+		if (isEcho(value, nowMs))
+			return;
+
+		toHardware.pendingValue = value;
+		if (!touched)
+			send = takeIfDue(toHardware, nowMs, valueToSend);
+	}
+
+	if (send && sendToHardwareFunction != nullptr)
+		sendToHardwareFunction(valueToSend);
+}
+
+void FaderBridge::flush()
+{
+	int dawValue, hardwareValue;
+	bool sendDaw, sendHardware = false;
+	const double nowMs = Time::getMillisecondCounterHiRes();
+
+	{
+		const SpinLock::ScopedLockType sl(lock);
+
+		sendDaw = takeIfDue(toDaw, nowMs, dawValue);
+		if (sendDaw) rememberSentToDaw(dawValue, nowMs);
+
+		if (!touched)
+			sendHardware = takeIfDue(toHardware, nowMs, hardwareValue);
+	}
+
+	if (sendDaw && sendToDawFunction != nullptr)
+		sendToDawFunction(dawValue);
+
+	if (sendHardware && sendToHardwareFunction != nullptr)
+		sendToHardwareFunction(hardwareValue);
+}
+
+void FaderBridge::reset()
+{
+	const SpinLock::ScopedLockType sl(lock);
+
+	toDaw = Direction();
+	toHardware = Direction();
+
+	for (int i = 0; i < FADER_BRIDGE_ECHO_HISTORY; i++)
+	{
+		sentToDawHistory[i] = -1;
+		sentToDawHistoryTimeMs[i] = 0.0;
+	}
+	sentToDawHistoryIndex = 0;
+}
+
+//==============================================================================
+// Must be called with the lock held.
+
+bool FaderBridge::isEcho(int value, double nowMs) const
+{
+	// The DAW can echo back several of our values late during fast moves, so check all recent ones.
+	for (int i = 0; i < FADER_BRIDGE_ECHO_HISTORY; i++)
+	{
+		if (sentToDawHistory[i] != -1
+			&& std::abs(value - sentToDawHistory[i]) <= FADER_BRIDGE_ECHO_TOLERANCE
+			&& nowMs - sentToDawHistoryTimeMs[i] < FADER_BRIDGE_ECHO_WINDOW_MS)
+			return true;
+	}
+
+	return false;
+}
+
+bool FaderBridge::takeIfDue(Direction& direction, double nowMs, int& valueToSend)
+{
+	if (direction.pendingValue == -1)
+		return false;
+
+	// Nothing changed since the last send.
+	if (direction.pendingValue == direction.lastSentValue)
+	{
+		direction.pendingValue = -1;
+		return false;
+	}
+
+	if (nowMs - direction.lastSendTimeMs < minIntervalMs)
+		return false;
+
+	valueToSend = direction.pendingValue;
+	direction.lastSentValue = valueToSend;
+	direction.lastSendTimeMs = nowMs;
+	direction.pendingValue = -1;
+	return true;
+}
+
+void FaderBridge::rememberSentToDaw(int value, double nowMs)
+{
+	sentToDawHistory[sentToDawHistoryIndex] = value;
+	sentToDawHistoryTimeMs[sentToDawHistoryIndex] = nowMs;
+	sentToDawHistoryIndex = (sentToDawHistoryIndex + 1) % FADER_BRIDGE_ECHO_HISTORY;
+}
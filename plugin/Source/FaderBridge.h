@@ -0,0 +1,82 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+#include <JuceHeader.h>
+
+#define FADER_BRIDGE_MAX_VALUE 16383				// Fader values are 14-bit, as sent/received using NRPN.
+#define FADER_BRIDGE_ECHO_HISTORY 8					// Number of recently sent values remembered for echo suppression.
+
+//==============================================================================
+/**
+	Coalescing bridge between our motorised fader and the DAW track volume.
+
+	Only the latest value is kept for each direction, and values are sent no faster
+	than the configured maximum rate - anything in between is simply dropped.
+	Values coming back from the DAW that match one we have just sent are treated as
+	echoes and ignored, and nothing is sent to the motor while the fader is touched,
+	so the motor doesn't fight the user's finger.
+
+	The fader*() and dawVolume*() methods can be called from any thread. flush() should
+	be called regularly from a timer, to send values held back by the rate limit.
+*/
+class FaderBridge
+{
+public:
+	FaderBridge(std::function<void(int value)> sendToDaw, std::function<void(int value)> sendToHardware);
+
+	void setMaxRate(float rateHz);
+	void setTouched(bool isTouched);
+	bool isTouched() const { return touched; }
+
+	void faderMoved(int value);						// Hardware fader moved, value to go to DAW.
+	void dawVolumeChanged(int value);				// DAW volume changed, value to go to motor fader.
+
+	void flush();
+	void reset();
+
+private:
+	struct Direction
+	{
+		int pendingValue = -1;						// Latest value not yet sent, -1 if none.
+		int lastSentValue = -1;
+		double lastSendTimeMs = 0.0;
+	};
+
+	bool isEcho(int value, double nowMs) const;
+	bool takeIfDue(Direction& direction, double nowMs, int& valueToSend);
+	void rememberSentToDaw(int value, double nowMs);
+
+	std::function<void(int)> sendToDawFunction;
+	std::function<void(int)> sendToHardwareFunction;
+
+	Direction toDaw;
+	Direction toHardware;
+
+	int sentToDawHistory[FADER_BRIDGE_ECHO_HISTORY];
+	double sentToDawHistoryTimeMs[FADER_BRIDGE_ECHO_HISTORY];
+	int sentToDawHistoryIndex;
+
+	double minIntervalMs;							// Guarded by lock, like the directions.
+	std::atomic<bool> touched;
+
+	SpinLock lock;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FaderBridge)
+};
@@ -0,0 +1,127 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include <limits>
+#include <memory>
+
+#include "FileLoudnessAnalyser.h"
+#include "AudioFileBlockReader.h"
+
+FileLoudnessAnalyser::FileLoudnessAnalyser(int chunkSize)
+	: chunkSize(chunkSize)
+{
+	formatManager.registerBasicFormats();
+}
+
+FileLoudnessAnalyser::Result FileLoudnessAnalyser::analyse(const File& file)
+{
+	LufsGatingState gatingState;
+	Result result = analyseSegment(file, 0, std::numeric_limits<int>::max(), gatingState);
+
+	if (result.ok)
+		setMeasurements(result, gatingState);
+
+	return result;
+}
+
+int FileLoudnessAnalyser::getNumPositions(const File& file)
+{
+	std::unique_ptr<AudioFormatReader> reader(formatManager.createReaderFor(file));
+
+	if (reader == nullptr || reader->sampleRate <= 0.0)
+		return -1;
+
+	// Same 100 ms as LufsProcessor.
+	const int positionSize = (int)(reader->sampleRate / 10.0);
+	return (int)jmin(reader->lengthInSamples / positionSize, (int64)std::numeric_limits<int>::max());
+}
+
+FileLoudnessAnalyser::Result FileLoudnessAnalyser::analyseSegment(const File& file, int firstPosition, int endPosition, LufsGatingState& gatingState)
+{
+	Result result;
+	result.fileName = file.getFullPathName();
+
+	AudioFileBlockReader blockReader(formatManager, file, chunkSize);
+	const AudioFormatReader* reader = blockReader.getReader();
+
+	if (reader == nullptr)
+	{
+		result.error = "Can't read file";
+		return result;
+	}
+
+	result.sampleRate = reader->sampleRate;
+	result.numChannels = (int)reader->numChannels;
+	result.durationSeconds = reader->sampleRate > 0.0 ? reader->lengthInSamples / reader->sampleRate : 0.0;
+
+	// LufsProcessor's true peak and per channel meters are stereo only.
+	if (result.numChannels < 1 || result.numChannels > LUFS_TP_MAX_NB_CHANNELS)
+	{
+		result.error = "Only mono and stereo files are supported";
+		return result;
+	}
+
+	if (reader->sampleRate <= 0.0)
+	{
+		result.error = "Invalid sample rate";
+		return result;
+	}
+
+	// Positions are counted from the start of the file, so the warm up keeps them on the
+	// same 100 ms boundaries as when measuring the whole file.
+	const int positionSize = (int)(reader->sampleRate / 10.0);
+	const int warmUpPositions = jmin(firstPosition, LUFS_SEGMENT_WARM_UP_POSITIONS);
+
+	// LufsProcessor stops storing positions when it's full, so longer spans would be cut short.
+	const int64 filePositions = reader->lengthInSamples / positionSize;
+	if (jmin((int64)endPosition, filePositions) - firstPosition + warmUpPositions > LUFS_MAX_POSITIONS)
+	{
+		result.error = "File longer than " + String(LUFS_MAX_POSITIONS / 36000.0, 1) + " hours, measure it in segments";
+		return result;
+	}
+
+	blockReader.setSampleRange((int64)(firstPosition - warmUpPositions) * positionSize, (int64)endPosition * positionSize);
+
+	LufsProcessor lufsProcessor(result.numChannels);
+	lufsProcessor.prepareToPlay(reader->sampleRate, chunkSize);
+	lufsProcessor.setGatingStartPosition(warmUpPositions);
+
+	while (AudioSampleBuffer* block = blockReader.readNextBlock())
+		lufsProcessor.processBlock(*block);
+
+	if (blockReader.hasFailed())
+	{
+		result.error = "Read error";
+		return result;
+	}
+
+	lufsProcessor.update();
+
+	gatingState = lufsProcessor.getGatingState();
+	result.ok = true;
+	return result;
+}
+
+void FileLoudnessAnalyser::setMeasurements(Result& result, const LufsGatingState& gatingState)
+{
+	float rangeMin, rangeMax;
+	gatingState.getRange(rangeMin, rangeMax);
+
+	result.integrated = gatingState.getIntegratedVolume();
+	result.loudnessRange = rangeMax - rangeMin;
+	result.maxMomentary = gatingState.getMaxMomentaryVolume();
+	result.maxShortTerm = gatingState.getMaxShortTermVolume();
+	result.truePeak = gatingState.getTruePeak();
+}
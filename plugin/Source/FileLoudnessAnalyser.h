@@ -0,0 +1,79 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "LufsProcessor.h"
+
+#define FILE_LOUDNESS_ANALYSER_DEFAULT_CHUNK_SIZE 4096
+
+//==============================================================================
+/**
+	Measures the loudness of an audio file, using the same LufsProcessor engine as
+	the plugin meters, so the numbers match what the plugin shows.
+
+	The file is read in fixed size chunks (see AudioFileBlockReader), so memory use
+	doesn't depend on the length of the file. One analyser can be reused for many files, but only
+	from one thread at a time.
+
+	Long files can also be measured in segments of 100 ms positions (e.g. on several
+	threads, see BatchLoudnessAnalyser). Each segment starts LUFS_SEGMENT_WARM_UP_POSITIONS
+	early to fill the filters and meter windows, and the gating states of all the segments
+	are merged to give the same numbers as analyse().
+*/
+class FileLoudnessAnalyser
+{
+public:
+	struct Result
+	{
+		String fileName;
+		bool ok = false;
+		String error;
+
+		double sampleRate = 0.0;
+		int numChannels = 0;
+		double durationSeconds = 0.0;
+
+		float integrated = 0.0f;				// LUFS
+		float loudnessRange = 0.0f;				// LU
+		float maxMomentary = 0.0f;				// LUFS
+		float maxShortTerm = 0.0f;				// LUFS
+		float truePeak = 0.0f;					// dBTP
+	};
+
+	FileLoudnessAnalyser(int chunkSize = FILE_LOUDNESS_ANALYSER_DEFAULT_CHUNK_SIZE);
+
+	// Supports any format JUCE's basic formats can read (WAV, AIFF, FLAC, ...).
+	// WAV and AIFF files are memory mapped. Fails for files longer than LUFS_MAX_POSITIONS,
+	// which have to be measured in segments.
+	Result analyse(const File& file);
+
+	// Number of 100 ms positions in the file, or -1 if it can't be read.
+	int getNumPositions(const File& file);
+
+	// Measures positions firstPosition to endPosition into gatingState. The result has
+	// everything but the measurements, which are set from the merged state of all the segments.
+	// Segments (with their warm up) can be up to LUFS_MAX_POSITIONS long.
+	Result analyseSegment(const File& file, int firstPosition, int endPosition, LufsGatingState& gatingState);
+
+	static void setMeasurements(Result& result, const LufsGatingState& gatingState);
+
+private:
+	AudioFormatManager formatManager;
+	int chunkSize;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FileLoudnessAnalyser)
+};
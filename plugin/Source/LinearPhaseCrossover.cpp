@@ -0,0 +1,250 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "LinearPhaseCrossover.h"
+
+#define LINEAR_PHASE_CROSSOVER_DEFAULT_FREQUENCY 1000.0f
+
+LinearPhaseCrossover::LinearPhaseCrossover()
+	: position(0), spectraPosition(0), delayPartition(0), requestedKernels(0), activeKernels(0), designedNumBands(0),
+	sampleRate(44100.0), numBands(2), maxBands(2), numPartitions(1), firLength(1), latencySamples(0)
+{
+	kernelBands[0] = kernelBands[1] = 0;
+}
+
+void LinearPhaseCrossover::prepareToPlay(double newSampleRate, int numChannels, int newMaxBands)
+{
+	const CriticalSection::ScopedLockType sl(designLock);
+
+	sampleRate = newSampleRate;
+	maxBands = newMaxBands;
+	numBands = jmin(numBands, maxBands);
+
+	const int partitionSize = LINEAR_PHASE_CROSSOVER_PARTITION_SIZE;
+	convolution.prepare(partitionSize);
+	fftData.assign(convolution.getWorkSize(), 0.0f);
+	accumulator.assign(convolution.getNumBins(), Bin());
+
+	// An odd number of taps, so the centre (and the delay) is a whole number of samples.
+	numPartitions = jmax(2, (int)std::ceil(LINEAR_PHASE_CROSSOVER_FIR_MS * sampleRate / (1000.0 * partitionSize)));
+	firLength = numPartitions * partitionSize - 1;
+	const int firDelay = (firLength - 1) / 2;
+	latencySamples = partitionSize + firDelay;
+
+	channels.resize(numChannels);
+	for (Channel& channel : channels)
+	{
+		channel.input.assign(2 * partitionSize, 0.0f);
+		channel.output.assign(partitionSize, 0.0f);
+		channel.spectra.assign(numPartitions, std::vector<Bin>(partitionSize + 1));
+	}
+
+	// The delay is a unit impulse, which lands in one partition.
+	std::vector<float> impulse(partitionSize, 0.0f);
+	impulse[firDelay % partitionSize] = 1.0f;
+	std::vector<std::vector<Bin>> impulseSpectra(1);
+	transformPartitions(impulse, impulseSpectra);
+	delaySpectrum = impulseSpectra[0];
+	delayPartition = firDelay / partitionSize;
+
+	frequencies.resize(jmax(0, maxBands - 1), LINEAR_PHASE_CROSSOVER_DEFAULT_FREQUENCY);
+	for (auto& set : kernels)
+		set.assign(maxBands, std::vector<std::vector<Bin>>(numPartitions, std::vector<Bin>(partitionSize + 1)));
+
+	design(kernels[0]);
+	kernelBands[0] = kernelBands[1] = numBands;
+	designedFrequencies = frequencies;
+	designedNumBands = numBands;
+	requestedKernels = 0;
+	activeKernels = 0;
+
+	reset();
+}
+
+void LinearPhaseCrossover::reset()
+{
+	for (Channel& channel : channels)
+	{
+		std::fill(channel.input.begin(), channel.input.end(), 0.0f);
+		std::fill(channel.output.begin(), channel.output.end(), 0.0f);
+		for (auto& spectrum : channel.spectra)
+			std::fill(spectrum.begin(), spectrum.end(), Bin());
+	}
+
+	position = 0;
+	spectraPosition = 0;
+}
+
+void LinearPhaseCrossover::setNumBands(int newNumBands)
+{
+	const CriticalSection::ScopedLockType sl(designLock);
+
+	numBands = jlimit(1, jmax(1, maxBands), newNumBands);
+}
+
+void LinearPhaseCrossover::setCrossoverFrequency(int crossover, float frequency)
+{
+	const CriticalSection::ScopedLockType sl(designLock);
+
+	if (crossover < (int)frequencies.size())
+		frequencies[crossover] = frequency;
+}
+
+void LinearPhaseCrossover::update()
+{
+	const CriticalSection::ScopedLockType sl(designLock);
+
+	if (frequencies == designedFrequencies && numBands == designedNumBands)
+		return;
+
+	// The audio thread is still on the old set until its next block: the new one waits for the next update.
+	const int active = activeKernels.load(std::memory_order_acquire);
+	if (requestedKernels.load(std::memory_order_relaxed) != active)
+		return;
+
+	design(kernels[1 - active]);
+	kernelBands[1 - active] = numBands;
+	designedFrequencies = frequencies;
+	designedNumBands = numBands;
+	requestedKernels.store(1 - active, std::memory_order_release);
+}
+
+void LinearPhaseCrossover::design(std::vector<std::vector<std::vector<Bin>>>& bandSpectra)
+{
+	const int firDelay = (firLength - 1) / 2;
+	std::vector<double> previousLowpass(firLength, 0.0);
+	std::vector<double> lowpass(firLength);
+	std::vector<float> band(numPartitions * LINEAR_PHASE_CROSSOVER_PARTITION_SIZE, 0.0f);
+
+	for (int bandIndex = 0; bandIndex < numBands; bandIndex++)
+	{
+		if (bandIndex < numBands - 1)
+		{
+			// Blackman windowed sinc, normalised to unity gain at DC.
+			const double cutoff = jlimit(1.0, 0.49 * sampleRate, (double)frequencies[bandIndex]) / sampleRate;
+			double sum = 0.0;
+
+			for (int tap = 0; tap < firLength; tap++)
+			{
+				const double x = tap - firDelay;
+				const double sinc = x == 0.0 ? 2.0 * cutoff : std::sin(2.0 * double_Pi * cutoff * x) / (double_Pi * x);
+				const double phase = 2.0 * double_Pi * tap / (firLength - 1);
+				lowpass[tap] = sinc * (0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase));
+				sum += lowpass[tap];
+			}
+
+			for (auto& tap : lowpass)
+				tap /= sum;
+		}
+		else
+		{
+			// Everything above the top crossover: the delay less the lowpass below it.
+			std::fill(lowpass.begin(), lowpass.end(), 0.0);
+			lowpass[firDelay] = 1.0;
+		}
+
+		for (int tap = 0; tap < firLength; tap++)
+			band[tap] = (float)(lowpass[tap] - previousLowpass[tap]);
+
+		transformPartitions(band, bandSpectra[bandIndex]);
+		std::swap(lowpass, previousLowpass);
+	}
+}
+
+void LinearPhaseCrossover::transformPartitions(const std::vector<float>& impulse, std::vector<std::vector<Bin>>& spectra)
+{
+	const int partitionSize = LINEAR_PHASE_CROSSOVER_PARTITION_SIZE;
+
+	for (int partition = 0; partition < (int)spectra.size(); partition++)
+	{
+		spectra[partition].resize(convolution.getNumBins());
+		convolution.transformPartition(impulse.data() + partition * partitionSize, partitionSize, spectra[partition].data());
+	}
+}
+
+void LinearPhaseCrossover::process(AudioSampleBuffer& buffer, int soloMask)
+{
+	// Pick up a new design, if there is one. update() won't touch this set until the next one is picked up.
+	const int kernelSet = requestedKernels.load(std::memory_order_acquire);
+	activeKernels.store(kernelSet, std::memory_order_release);
+	const auto& bandSpectra = kernels[kernelSet];
+
+	const int partitionSize = LINEAR_PHASE_CROSSOVER_PARTITION_SIZE;
+	const int numSamples = buffer.getNumSamples();
+	const int numChannels = jmin(buffer.getNumChannels(), (int)channels.size());
+
+	// Samples go into the partition being filled, and come out of the last one processed.
+	for (int done = 0; done < numSamples;)
+	{
+		const int count = jmin(numSamples - done, partitionSize - position);
+
+		for (int chan = 0; chan < numChannels; chan++)
+		{
+			float* data = buffer.getWritePointer(chan, done);
+			FloatVectorOperations::copy(channels[chan].input.data() + partitionSize + position, data, count);
+			FloatVectorOperations::copy(data, channels[chan].output.data() + position, count);
+		}
+
+		position += count;
+		done += count;
+
+		if (position == partitionSize)
+		{
+			spectraPosition = (spectraPosition + 1) % numPartitions;
+			for (int chan = 0; chan < numChannels; chan++)
+				processPartition(channels[chan], bandSpectra, kernelBands[kernelSet], soloMask);
+			position = 0;
+		}
+	}
+}
+
+void LinearPhaseCrossover::processPartition(Channel& channel, const std::vector<std::vector<std::vector<Bin>>>& bandSpectra, int numKernelBands, int soloMask)
+{
+	const int partitionSize = LINEAR_PHASE_CROSSOVER_PARTITION_SIZE;
+	const int numBins = convolution.getNumBins();
+
+	// One forward transform per channel, shared by all the bands.
+	FloatVectorOperations::copy(fftData.data(), channel.input.data(), 2 * partitionSize);
+	convolution.forwardTransform(fftData.data(), channel.spectra[spectraPosition].data());
+
+	FloatVectorOperations::copy(channel.input.data(), channel.input.data() + partitionSize, partitionSize);
+
+	// Each partition of a band's FIR meets the input that many partitions back.
+	std::fill(accumulator.begin(), accumulator.end(), Bin());
+	const int allBands = (1 << numKernelBands) - 1;
+	soloMask &= allBands;
+
+	if (soloMask == 0 || soloMask == allBands)
+	{
+		const int delayed = (spectraPosition - delayPartition + numPartitions) % numPartitions;
+		PartitionedConvolution::multiplyAdd(accumulator.data(), channel.spectra[delayed].data(), delaySpectrum.data(), numBins);
+	}
+	else
+	{
+		for (int band = 0; band < numKernelBands; band++)
+		{
+			if ((soloMask & (1 << band)) == 0)
+				continue;
+
+			for (int partition = 0; partition < numPartitions; partition++)
+			{
+				const int delayed = (spectraPosition - partition + numPartitions) % numPartitions;
+				PartitionedConvolution::multiplyAdd(accumulator.data(), channel.spectra[delayed].data(), bandSpectra[band][partition].data(), numBins);
+			}
+		}
+	}
+
+	convolution.inverseTransform(accumulator.data(), fftData.data(), channel.output.data());
+}
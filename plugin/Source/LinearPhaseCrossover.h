@@ -0,0 +1,112 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include <JuceHeader.h>
+
+#include "PartitionedConvolution.h"
+
+#define LINEAR_PHASE_CROSSOVER_PARTITION_SIZE 128		// Samples: the latency of the convolution itself, 2.7 ms at 48 kHz.
+#define LINEAR_PHASE_CROSSOVER_FIR_MS 120.0				// FIR length. The filters add half of it as latency.
+
+//==============================================================================
+/**
+	Linear phase crossover for band solo: soloed bands are summed with no phase
+	shift between them, unlike the IIR Linkwitz-Riley crossovers.
+
+	Each crossover is a Blackman windowed sinc lowpass, and each band the difference
+	of the lowpasses either side of it, so the bands always sum to a pure delay.
+	They are applied by uniformly partitioned convolution (PartitionedConvolution, with
+	a frequency domain delay line): each partition of input is transformed once per
+	channel, multiplied by every soloed band's partitions, and transformed back once.
+	With no bands soloed, or all of them, the input is just delayed by the same amount.
+
+	Latency is one partition plus half the FIR, whatever is soloed, so it can be
+	reported to the host once.
+
+	New crossover frequencies are designed off the audio thread, into the kernel set
+	the audio thread isn't using, which it picks up at its next block.
+*/
+class LinearPhaseCrossover
+{
+public:
+	LinearPhaseCrossover();
+
+	// Not real-time. Kernels are allocated for up to maxBands.
+	void prepareToPlay(double sampleRate, int numChannels, int maxBands);
+
+	// Audio thread. Clears the convolution history, e.g. when the crossover is switched back in.
+	void reset();
+
+	// Not real-time, any thread but the audio thread, after prepareToPlay. The bands are redesigned
+	// by update(), if anything changed and the audio thread has picked up the last design.
+	void setNumBands(int numBands);
+	void setCrossoverFrequency(int crossover, float frequency);
+	void update();
+
+	// Audio thread. Bit n of soloMask is band n.
+	void process(AudioSampleBuffer& buffer, int soloMask);
+
+	int getLatencySamples() const { return latencySamples; }
+
+private:
+	typedef PartitionedConvolution::Bin Bin;
+
+	struct Channel
+	{
+		std::vector<float> input;				// The last two partitions of input, oldest first.
+		std::vector<float> output;				// The last partition of output, read out as the next fills.
+		std::vector<std::vector<Bin>> spectra;	// Frequency domain delay line: transformed inputs, one per partition.
+	};
+
+	void design(std::vector<std::vector<std::vector<Bin>>>& bandSpectra);
+	void transformPartitions(const std::vector<float>& impulse, std::vector<std::vector<Bin>>& spectra);
+	void processPartition(Channel& channel, const std::vector<std::vector<std::vector<Bin>>>& bandSpectra, int numKernelBands, int soloMask);
+
+	PartitionedConvolution convolution;
+	std::vector<float> fftData;
+	std::vector<Bin> accumulator;
+	std::vector<Channel> channels;
+	int position;								// Samples into the current partition.
+	int spectraPosition;						// Newest input in the delay line.
+
+	// The delay with no bands soloed: one partition's spectrum, so many partitions back.
+	std::vector<Bin> delaySpectrum;
+	int delayPartition;
+
+	// Two kernel sets, [band][partition][bin]: the audio thread uses one, update() designs into the other.
+	std::vector<std::vector<std::vector<Bin>>> kernels[2];
+	int kernelBands[2];
+	std::atomic<int> requestedKernels;
+	std::atomic<int> activeKernels;
+
+	CriticalSection designLock;
+	std::vector<float> frequencies;
+	std::vector<float> designedFrequencies;
+	int designedNumBands;
+
+	double sampleRate;
+	int numBands;
+	int maxBands;
+	int numPartitions;
+	int firLength;
+	int latencySamples;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LinearPhaseCrossover)
+};
@@ -0,0 +1,253 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include <complex>
+
+#include "LoudnessEqProcessor.h"
+
+#define LOUDNESS_EQ_NUM_FREQUENCIES 29
+#define LOUDNESS_EQ_FIT_ITERATIONS 4			// Peak filters don't quite add up in dB, so the fit is refined a few times.
+
+// ISO 226:2003 table 1: frequency, exponent for loudness perception, magnitude of the
+// linear transfer function normalised at 1 kHz, and threshold of hearing.
+const double loudnessEqFrequencies[LOUDNESS_EQ_NUM_FREQUENCIES] = {
+	20.0, 25.0, 31.5, 40.0, 50.0, 63.0, 80.0, 100.0, 125.0, 160.0, 200.0, 250.0, 315.0, 400.0, 500.0,
+	630.0, 800.0, 1000.0, 1250.0, 1600.0, 2000.0, 2500.0, 3150.0, 4000.0, 5000.0, 6300.0, 8000.0, 10000.0, 12500.0 };
+const double loudnessEqExponents[LOUDNESS_EQ_NUM_FREQUENCIES] = {
+	0.532, 0.506, 0.480, 0.455, 0.432, 0.409, 0.387, 0.367, 0.349, 0.330, 0.315, 0.301, 0.288, 0.276, 0.267,
+	0.259, 0.253, 0.250, 0.246, 0.244, 0.243, 0.243, 0.243, 0.242, 0.242, 0.245, 0.254, 0.271, 0.301 };
+const double loudnessEqTransferDb[LOUDNESS_EQ_NUM_FREQUENCIES] = {
+	-31.6, -27.2, -23.0, -19.1, -15.9, -13.0, -10.3, -8.1, -6.2, -4.5, -3.1, -2.0, -1.1, -0.4, 0.0,
+	0.3, 0.5, 0.0, -2.7, -4.1, -1.0, 1.7, 2.5, 1.2, -2.1, -7.1, -11.2, -10.7, -3.1 };
+const double loudnessEqThresholdDb[LOUDNESS_EQ_NUM_FREQUENCIES] = {
+	78.5, 68.7, 59.5, 51.1, 44.0, 37.5, 31.5, 26.5, 22.1, 17.9, 14.4, 11.4, 8.6, 6.2, 4.4,
+	3.0, 2.2, 2.4, 3.5, 1.7, -1.3, -4.2, -6.0, -5.4, -1.5, 6.0, 12.6, 13.9, 12.3 };
+
+enum loudnessEqBandType {
+	LOW_SHELF,
+	PEAK,
+	HIGH_SHELF
+};
+
+// The filters: shelves for the bass, which rises smoothly below 500 Hz, peaks for the dip around 3 kHz, and a shelf for the top.
+struct LoudnessEqBand
+{
+	loudnessEqBandType type;
+	double frequency;
+	double q;
+};
+
+const LoudnessEqBand loudnessEqBands[LOUDNESS_EQ_NUM_BANDS] = {
+	{ LOW_SHELF, 40.0, 0.7 }, { LOW_SHELF, 150.0, 0.7 }, { LOW_SHELF, 500.0, 0.7 }, { PEAK, 2000.0, 1.0 },
+	{ PEAK, 4000.0, 1.0 }, { PEAK, 7000.0, 1.0 }, { HIGH_SHELF, 11000.0, 0.7 } };
+
+static IIRCoefficients makeBand(double sampleRate, const LoudnessEqBand& band, double gainDb)
+{
+	const float gain = Decibels::decibelsToGain((float)gainDb);
+
+	switch (band.type)
+	{
+	case LOW_SHELF:
+		return IIRCoefficients::makeLowShelf(sampleRate, band.frequency, band.q, gain);
+	case HIGH_SHELF:
+		return IIRCoefficients::makeHighShelf(sampleRate, band.frequency, band.q, gain);
+	default:
+		return IIRCoefficients::makePeakFilter(sampleRate, band.frequency, band.q, gain);
+	}
+}
+
+// Magnitude in dB of a biquad at a frequency.
+static double getMagnitudeDb(const IIRCoefficients& filter, double frequency, double sampleRate)
+{
+	const float* c = filter.coefficients;
+	const std::complex<double> z1 = std::polar(1.0, -2.0 * double_Pi * frequency / sampleRate);
+	const std::complex<double> z2 = z1 * z1;
+
+	const std::complex<double> numerator = (double)c[0] + (double)c[1] * z1 + (double)c[2] * z2;
+	const std::complex<double> denominator = 1.0 + (double)c[3] * z1 + (double)c[4] * z2;
+	return 20.0 * std::log10(std::abs(numerator / denominator));
+}
+
+LoudnessEqProcessor::LoudnessEqProcessor()
+	: level(0.0f), appliedLevel(0.0f)
+{
+}
+
+double LoudnessEqProcessor::getEqualLoudnessSpl(int frequencyIndex, double phon)
+{
+	const double exponent = loudnessEqExponents[frequencyIndex];
+	const double transferDb = loudnessEqTransferDb[frequencyIndex];
+	const double thresholdDb = loudnessEqThresholdDb[frequencyIndex];
+
+	const double a = 4.47e-3 * (std::pow(10.0, 0.025 * phon) - 1.15)
+		+ std::pow(0.4 * std::pow(10.0, (thresholdDb + transferDb) / 10.0 - 9.0), exponent);
+
+	return 10.0 / exponent * std::log10(a) - transferDb + 94.0;
+}
+
+void LoudnessEqProcessor::prepareToPlay(double sampleRate, int numChannels)
+{
+	curves.resize(LOUDNESS_EQ_NUM_LEVELS * LOUDNESS_EQ_NUM_BANDS);
+	for (int i = 0; i < LOUDNESS_EQ_NUM_LEVELS; i++)
+		designCurve(sampleRate, LOUDNESS_EQ_MIN_LEVEL_DB + i, &curves[i * LOUDNESS_EQ_NUM_BANDS]);
+
+	filters.resize(numChannels);
+	for (auto& channelFilters : filters)
+	{
+		channelFilters.resize(LOUDNESS_EQ_NUM_BANDS);
+		for (auto& filter : channelFilters)
+			filter = std::make_unique<IIRFilter>();
+	}
+
+	applyLevel();
+}
+
+void LoudnessEqProcessor::designCurve(double sampleRate, double levelDb, IIRCoefficients* curve) const
+{
+	// How much more each frequency needs than 1 kHz at the listening level, over what it needs at the reference.
+	const double referencePhon = LOUDNESS_EQ_REFERENCE_PHON;
+	const double listeningPhon = referencePhon + levelDb;
+
+	double target[LOUDNESS_EQ_NUM_FREQUENCIES];
+	for (int i = 0; i < LOUDNESS_EQ_NUM_FREQUENCIES; i++)
+		target[i] = (getEqualLoudnessSpl(i, listeningPhon) - listeningPhon) - (getEqualLoudnessSpl(i, referencePhon) - referencePhon);
+
+	// Each filter's response at the ISO frequencies, per dB of gain, at a small gain where it's near enough linear.
+	const double unitDb = 1.0;
+	double response[LOUDNESS_EQ_NUM_FREQUENCIES][LOUDNESS_EQ_NUM_BANDS];
+	for (int band = 0; band < LOUDNESS_EQ_NUM_BANDS; band++)
+	{
+		const IIRCoefficients unit = makeBand(sampleRate, loudnessEqBands[band], unitDb);
+		for (int i = 0; i < LOUDNESS_EQ_NUM_FREQUENCIES; i++)
+			response[i][band] = getMagnitudeDb(unit, loudnessEqFrequencies[i], sampleRate) / unitDb;
+	}
+
+	// Least squares: the normal equations, refined against the real response of the gains so far.
+	double gains[LOUDNESS_EQ_NUM_BANDS] = {};
+	double error[LOUDNESS_EQ_NUM_FREQUENCIES];
+	std::copy(target, target + LOUDNESS_EQ_NUM_FREQUENCIES, error);
+
+	for (int iteration = 0; iteration < LOUDNESS_EQ_FIT_ITERATIONS; iteration++)
+	{
+		// [row][column], the last column being the right hand side.
+		double normal[LOUDNESS_EQ_NUM_BANDS][LOUDNESS_EQ_NUM_BANDS + 1] = {};
+		for (int row = 0; row < LOUDNESS_EQ_NUM_BANDS; row++)
+		{
+			for (int i = 0; i < LOUDNESS_EQ_NUM_FREQUENCIES; i++)
+			{
+				for (int column = 0; column < LOUDNESS_EQ_NUM_BANDS; column++)
+					normal[row][column] += response[i][row] * response[i][column];
+				normal[row][LOUDNESS_EQ_NUM_BANDS] += response[i][row] * error[i];
+			}
+		}
+
+		// Gaussian elimination with partial pivoting, then back substitution.
+		for (int pivot = 0; pivot < LOUDNESS_EQ_NUM_BANDS; pivot++)
+		{
+			int largest = pivot;
+			for (int row = pivot + 1; row < LOUDNESS_EQ_NUM_BANDS; row++)
+				if (std::abs(normal[row][pivot]) > std::abs(normal[largest][pivot]))
+					largest = row;
+			std::swap(normal[pivot], normal[largest]);
+
+			for (int row = pivot + 1; row < LOUDNESS_EQ_NUM_BANDS; row++)
+			{
+				const double factor = normal[row][pivot] / normal[pivot][pivot];
+				for (int column = pivot; column <= LOUDNESS_EQ_NUM_BANDS; column++)
+					normal[row][column] -= factor * normal[pivot][column];
+			}
+		}
+
+		double step[LOUDNESS_EQ_NUM_BANDS];
+		for (int row = LOUDNESS_EQ_NUM_BANDS - 1; row >= 0; row--)
+		{
+			double sum = normal[row][LOUDNESS_EQ_NUM_BANDS];
+			for (int column = row + 1; column < LOUDNESS_EQ_NUM_BANDS; column++)
+				sum -= normal[row][column] * step[column];
+			step[row] = sum / normal[row][row];
+		}
+
+		for (int band = 0; band < LOUDNESS_EQ_NUM_BANDS; band++)
+		{
+			gains[band] += step[band];
+			curve[band] = makeBand(sampleRate, loudnessEqBands[band], gains[band]);
+		}
+
+		for (int i = 0; i < LOUDNESS_EQ_NUM_FREQUENCIES; i++)
+		{
+			error[i] = target[i];
+			for (int band = 0; band < LOUDNESS_EQ_NUM_BANDS; band++)
+				error[i] -= getMagnitudeDb(curve[band], loudnessEqFrequencies[i], sampleRate);
+		}
+	}
+}
+
+void LoudnessEqProcessor::reset()
+{
+	for (auto& channelFilters : filters)
+		for (auto& filter : channelFilters)
+			filter->reset();
+}
+
+void LoudnessEqProcessor::setLevel(float levelDb)
+{
+	level = jlimit((float)LOUDNESS_EQ_MIN_LEVEL_DB, 0.0f, levelDb);
+}
+
+void LoudnessEqProcessor::applyLevel()
+{
+	// Between the curves either side of the level. A mix of two stable biquads is stable too, as
+	// the stable region of their denominators is a triangle, so this can't blow up.
+	const float position = level - (float)LOUDNESS_EQ_MIN_LEVEL_DB;
+	const int lower = jmin((int)position, LOUDNESS_EQ_NUM_LEVELS - 2);
+	const float fraction = position - (float)lower;
+
+	for (int band = 0; band < LOUDNESS_EQ_NUM_BANDS; band++)
+	{
+		const float* below = curves[lower * LOUDNESS_EQ_NUM_BANDS + band].coefficients;
+		const float* above = curves[(lower + 1) * LOUDNESS_EQ_NUM_BANDS + band].coefficients;
+
+		IIRCoefficients coefficients;
+		for (int i = 0; i < numElementsInArray(coefficients.coefficients); i++)
+			coefficients.coefficients[i] = below[i] + fraction * (above[i] - below[i]);
+
+		for (auto& channelFilters : filters)
+			channelFilters[band]->setCoefficients(coefficients);
+	}
+
+	appliedLevel = level;
+}
+
+void LoudnessEqProcessor::process(AudioSampleBuffer& buffer)
+{
+	// Only when the level has moved: the filter states carry on through the new coefficients.
+	if (level != appliedLevel)
+		applyLevel();
+
+	const int numChannels = jmin(buffer.getNumChannels(), (int)filters.size());
+
+	const int numSamples = buffer.getNumSamples();
+
+	// processSamples() only flushes denormals from the filter state at the end of each block,
+	// so its output depends on the block size. processSingleSampleRaw() flushes on every sample.
+	for (int chan = 0; chan < numChannels; chan++)
+	{
+		float* const samples = buffer.getWritePointer(chan);
+
+		for (auto& filter : filters[chan])
+			for (int sample = 0; sample < numSamples; sample++)
+				samples[sample] = filter->processSingleSampleRaw(samples[sample]);
+	}
+}
@@ -0,0 +1,67 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <JuceHeader.h>
+
+#define LOUDNESS_EQ_NUM_BANDS 7
+#define LOUDNESS_EQ_REFERENCE_PHON 83.0			// Listening level at 0 dB monitor level: the usual film and broadcast mixing level.
+#define LOUDNESS_EQ_MIN_LEVEL_DB -60				// Lowest monitor level with its own curve (23 phon). Lower levels use it too.
+#define LOUDNESS_EQ_NUM_LEVELS (1 - LOUDNESS_EQ_MIN_LEVEL_DB)	// One curve per dB, from the lowest level to 0 dB.
+
+//==============================================================================
+/**
+	'Loud' mode EQ: equal loudness compensation, from the ISO 226:2003 contours.
+	Turned down from the reference level, the ear loses bass and some treble; the EQ
+	adds back the difference between the contour at the listening level and the one at
+	the reference, so the balance sounds as it would at the reference level.
+
+	The curve is a fixed cascade of shelf and peak filters, least squares fitted to the
+	difference at the ISO 226 frequencies. Every monitor level from the lowest to
+	0 dB is fitted in prepareToPlay(), one per dB, and the audio thread only
+	interpolates the coefficients of the two nearest when the level changes.
+*/
+class LoudnessEqProcessor
+{
+public:
+	LoudnessEqProcessor();
+
+	// Not real-time: designs the curves for every level.
+	void prepareToPlay(double sampleRate, int numChannels);
+	void reset();
+
+	// Monitor level in dB, 0 dB being the reference. Used from the next block.
+	void setLevel(float levelDb);
+
+	void process(AudioSampleBuffer& buffer);
+
+private:
+	// The ISO 226:2003 sound pressure level for a loudness, at one of its frequencies.
+	static double getEqualLoudnessSpl(int frequencyIndex, double phon);
+
+	void designCurve(double sampleRate, double levelDb, IIRCoefficients* curve) const;
+	void applyLevel();
+
+	std::vector<std::vector<std::unique_ptr<IIRFilter>>> filters;		// [channel][band]
+	std::vector<IIRCoefficients> curves;								// [level][band], from the lowest level up.
+	float level;
+	float appliedLevel;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LoudnessEqProcessor)
+};
@@ -21,14 +21,13 @@
 
 
 
-#include "LufsProcessor.h"
+#include <limits>
 
-#define LUFS_PROCESSOR_NB_MEMORY_VALUES 4
+#include "LufsProcessor.h"
+#include "AudioFileBlockReader.h"
 
 void DEBUGPLUGIN_output( const char * _text, ...);
 
-double LufsProcessor::ms_log10 = log( 10.0 );
-
 float getDecibelVolumeFromLinearVolume(float _linearVolume )
 {
     static const float log10dividedBy20 = 0.1151292546497f;
@@ -39,73 +38,87 @@ float getDecibelVolumeFromLinearVolume(float _linearVolume )
     return logf( _linearVolume ) / log10dividedBy20;
 }
 
+static bool needsLoudness( const int meters )
+{
+    return ( meters & ( LufsProcessor::MomentaryMeter | LufsProcessor::ShortTermMeter | LufsProcessor::IntegratedMeter | LufsProcessor::LoudnessRangeMeter ) ) != 0;
+}
+
+// kSpeakerArr51 is "L R C Lfe Ls Rs", channels after these aren't measured
+static float getChannelWeighting( const int channel )
+{
+    switch ( channel )
+    {
+    case 0: // L
+    case 1: // R
+    case 2: // C
+        return 1.f;
+    case 4: // Ls
+    case 5: // Rs
+        return 1.414213f; // 1.41 (~ +1.5 dB) for left and right surround channels 
+    default: // Lfe
+        return 0.f;
+    }
+}
+
 float LufsProcessor::testTruePeak(const juce::File & input , const double sampleRate, int bufferSize)
 {
     juce::AudioFormatManager audioFormatManager;
     audioFormatManager.registerBasicFormats();
 
-    juce::AudioFormatReader * reader = audioFormatManager.createReaderFor( input );
+    AudioFileBlockReader blockReader( audioFormatManager, input, bufferSize );
+    juce::AudioFormatReader * reader = blockReader.getReader();
 
     float truePeakDecibelValue = -100.f; 
 
     if ( reader != nullptr )
     {
-        // read file
-        juce::AudioSampleBuffer buffer( (int)reader->numChannels, (int)reader->lengthInSamples );
-        reader->read( &buffer, 0, (int)reader->lengthInSamples, 0, true, true );
-
         LufsProcessor processor(reader->numChannels);
         processor.prepareToPlay(sampleRate, bufferSize);
 
-        int offset = 0;
-        while (offset + bufferSize < (int)reader->lengthInSamples)
+        while ( juce::AudioSampleBuffer * block = blockReader.readNextBlock() )
         {
-            juce::AudioSampleBuffer calcBuffer( buffer.getArrayOfWritePointers(), reader->numChannels, offset, bufferSize );
-
-            processor.processBlock(calcBuffer);
-            offset += bufferSize;
+            processor.processBlock(*block);
 
-            for (int i = 0 ; i < calcBuffer.getNumChannels() ; ++i)
+            for (int i = 0 ; i < block->getNumChannels() ; ++i)
             {
                 if (truePeakDecibelValue < processor.getTruePeakChannelMax(i))
                     truePeakDecibelValue = processor.getTruePeakChannelMax(i);
             }
         }
-
-        delete reader;
     }
 
+    if ( reader == nullptr || blockReader.hasFailed() )
+        return std::numeric_limits<float>::quiet_NaN();
+
     return truePeakDecibelValue;
 }
 
 LufsProcessor::LufsProcessor( const int nbChannels )
-    : m_block( nbChannels, 0 )
-    , m_volumeMemory( nbChannels, 0 )
-    , m_truePeakMemory( nbChannels, 0 )
-    , m_sampleRate( 0.0 )
+    : m_sampleRate( 0.0 )
     , m_nbChannels( nbChannels )
     , m_maxSize( 0 )
     , m_processSize( 0 )
     , m_validSize( 0 )
-    , m_memorySize( 0 )
+    , m_positionSampleCount( 0 )
     , m_sampleSize100ms( 0 ) 
     , m_squaredInputArray( NULL )
     , m_momentaryVolumeArray( NULL )
     , m_shortTermVolumeArray( NULL )
     , m_integratedVolumeArray( NULL )
     , m_truePeakArray( NULL )
-    , m_tempBlock( 1, 4096 )
+    , m_gatingStartPosition( 0 )
+    , m_stageTiming( NULL )
+    , m_meters( AllMeters )
     , m_paused( false )
 {
     DEBUGPLUGIN_output("LufsProcessor::LufsProcessor %d channels", nbChannels);
 
     for ( int i = 0 ; i < nbChannels ; ++i )
     {
-        m_shelveFilterArray.add( BiquadProcessor() );
-        m_highPassFilterArray.add( BiquadProcessor() );
+        m_channelStateArray.add( ChannelState() );
     }
 
-    m_maxSize = 256 * 1024; // more than 7 hours
+    m_maxSize = LUFS_MAX_POSITIONS;
     jassert( m_maxSize * 4 < 0x80000000 );
     m_squaredInputArray = (float*)malloc( m_maxSize * sizeof( float ) );
     m_momentaryVolumeArray = (float*)malloc( m_maxSize * sizeof( float ) );
@@ -113,18 +126,12 @@ LufsProcessor::LufsProcessor( const int nbChannels )
     m_integratedVolumeArray = (float*)malloc( m_maxSize * sizeof( float ) );
     m_truePeakArray = (float*)malloc( m_maxSize * sizeof( float ) );
 
-    m_memArray = (float**)malloc( nbChannels * sizeof( float* ) );
-
-    for ( int i = 0 ; i < nbChannels ; ++i )
+    // all true peak channels are written, even for mono
+    for ( int i = 0 ; i < LUFS_TP_MAX_NB_CHANNELS ; ++i )
     {
-        m_memArray[ i ] = (float*)malloc( LUFS_PROCESSOR_NB_MEMORY_VALUES * sizeof( float ) );
-        memset( m_memArray[ i ], 0, LUFS_PROCESSOR_NB_MEMORY_VALUES * sizeof( float ) );
-
         m_truePeakPerChannelArray[ i ] = (float*)malloc( m_maxSize * sizeof( float ) );
         memset( m_truePeakPerChannelArray[ i ], 0, m_maxSize * sizeof( float ) );
     }
-    memset( m_maxLinArray, 0, nbChannels * sizeof( float ) );
-
     memset( m_truePeakMaxPerChannelArray, 0, nbChannels * sizeof( float ) );
 
     reset();
@@ -140,12 +147,10 @@ LufsProcessor::~LufsProcessor()
     free( m_integratedVolumeArray );
     free( m_truePeakArray );
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
+    for ( int i = 0 ; i < LUFS_TP_MAX_NB_CHANNELS ; ++i )
     {
-        free( m_memArray[ i ] );
         free( m_truePeakPerChannelArray[ i ] );
     }
-    free( m_memArray );
 }
 
 void LufsProcessor::reset()
@@ -156,20 +161,22 @@ void LufsProcessor::reset()
 
     m_processSize = 0;
     m_validSize = 0;
-    m_memorySize = 0;
+    m_positionSampleCount = 0;
 
     m_integratedVolume = DEFAULT_MIN_VOLUME;
     m_rangeMin = DEFAULT_MIN_VOLUME;
     m_rangeMax = DEFAULT_MIN_VOLUME;
     m_maxTruePeak = DEFAULT_MIN_VOLUME;
-    m_truePeakProcessor.reset();
 
-    m_sum400ms70.reset();
-    m_sum3s70.reset();
+    m_gatingState.reset();
 
     for ( int i = 0 ; i < m_nbChannels ; ++i )
     {
-        m_maxLinArray[ i ]  = 0.f;
+        ChannelState & state = m_channelStateArray.getReference( i );
+        state.m_squaredSum = 0.f;
+        state.m_truePeakMax = 0.f;
+        state.m_truePeak.reset();
+
         m_truePeakMaxPerChannelArray[ i ] = DEFAULT_MIN_VOLUME;
     }
 
@@ -188,156 +195,168 @@ void LufsProcessor::prepareToPlay(const double sampleRate, int samplesPerBlock)
 
     for ( int i = 0 ; i < m_nbChannels ; ++i )
     {
-        m_shelveFilterArray.getReference( i ).setFilterParams( (float)sampleRate, BiquadProcessor::HighShelf, 1500.f, 0.5f, 4.f );
-        m_highPassFilterArray.getReference( i ).setFilterParams( (float)sampleRate, BiquadProcessor::HighPass, 60.f, 0.5f, 0.f );
+        ChannelState & state = m_channelStateArray.getReference( i );
+        state.m_shelveFilter.setFilterParams( (float)sampleRate, BiquadProcessor::HighShelf, 1500.f, 0.5f, 4.f );
+        state.m_highPassFilter.setFilterParams( (float)sampleRate, BiquadProcessor::HighPass, 60.f, 0.5f, 0.f );
     }
 
-    m_block.setSize( m_nbChannels, 2 * samplesPerBlock );
-    m_volumeMemory.setSize( m_nbChannels, 2 * (int)sampleRate );
-    m_truePeakMemory.setSize( m_nbChannels, 2 * (int)sampleRate );
     m_sampleRate = sampleRate;
     m_sampleSize100ms = (int)( m_sampleRate / 10.0 );
+
+    // samplesPerBlock isn't needed: blocks are processed as they come, nothing is buffered
     reset();
 }
 
-void LufsProcessor::processBlock( juce::AudioSampleBuffer& buffer )
+void LufsProcessor::setMeters( const int meters )
 {
-    jassert( buffer.getNumChannels() <= m_nbChannels );
-    //DEBUGPLUGIN_output("LufsProcessor::processBlock buffer size %.d", buffer.getNumSamples());
-
-    if ( m_paused )
+    if ( meters == m_meters )
         return;
 
     const juce::SpinLock::ScopedLockType scopedLock( m_locker );
 
-    // copy to internal buffer m_block to apply filters, and then copy at the end of m_volumeMemory
-    bool keepExistingContent = false;
-    bool clearExtraSpace = false;
-    bool avoidReallocating = true;
-    m_block.setSize( m_nbChannels, buffer.getNumSamples(), keepExistingContent, clearExtraSpace, avoidReallocating );
+    // stages turned back on start from silence, not from where they were stopped 
+    const bool startLoudness = needsLoudness( meters ) && ! needsLoudness( m_meters );
+    const bool startTruePeak = ( meters & TruePeakMeter ) != 0 && ( m_meters & TruePeakMeter ) == 0;
 
     for ( int i = 0 ; i < m_nbChannels ; ++i )
     {
-        if ( i >= buffer.getNumChannels() )
-            continue;
-
-        // copy to internal buffer
-        m_block.copyFrom( i, 0, buffer, i, 0, buffer.getNumSamples() );
+        ChannelState & state = m_channelStateArray.getReference( i );
 
-        // apply high shelf
-        m_shelveFilterArray.getReference( i ).process( m_block.getWritePointer( i ), m_block.getNumSamples() );
-        
-        // apply high pass
-        m_highPassFilterArray.getReference( i ).process( m_block.getWritePointer( i ), m_block.getNumSamples() );
+        if ( startLoudness )
+        {
+            state.m_shelveFilter.reset();
+            state.m_highPassFilter.reset();
+        }
 
-        // copy block at the end of m_volumeMemory 
-        m_volumeMemory.copyFrom( i, m_memorySize, m_block, i, 0, m_block.getNumSamples() );
+        if ( startTruePeak )
+            state.m_truePeak.reset();
     }
 
-    // copy buffer to m_truePeakMemory 
+    m_meters = meters;
+}
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
-    {
-        if ( i >= buffer.getNumChannels() )
-            continue;
+void LufsProcessor::processBlock( juce::AudioSampleBuffer& buffer )
+{
+    jassert( buffer.getNumChannels() <= m_nbChannels );
+    //DEBUGPLUGIN_output("LufsProcessor::processBlock buffer size %.d", buffer.getNumSamples());
 
-        m_truePeakMemory.copyFrom( i, m_memorySize, buffer, i, 0, buffer.getNumSamples() );
-    }
+    if ( m_paused )
+        return;
+
+    const juce::SpinLock::ScopedLockType scopedLock( m_locker );
 
-    m_memorySize += buffer.getNumSamples();
+    // flush denormals to zero in the filters and true peak (the plugin does it too, but offline 
+    // analysis threads don't)
+    const juce::ScopedNoDenormals noDenormals;
 
-    if ( m_memorySize < m_sampleSize100ms )
-    {
-        // we don't have enough data in m_volumeMemory/m_truePeakMemory to process 100 ms
-        return;
-    }
+    jassert( m_sampleSize100ms > 0 ); // prepareToPlay not called
 
+    if ( m_sampleSize100ms <= 0 )
+        return;
 
-    // process chunks of 100 ms of data 
+    const int numChannels = juce::jmin( buffer.getNumChannels(), m_nbChannels );
 
-    int sizeDone = 0 ;
+    // hosts may send blocks of any size, even bigger than announced in prepareToPlay: 
+    // they are processed up to each 100 ms boundary, so nothing is buffered, 
+    // and the measurements are the same however the audio is split 
 
-    int nbChannels = m_nbChannels > 6 ? 6 : m_nbChannels;
-    while ( m_memorySize - sizeDone >= m_sampleSize100ms )
+    for ( int start = 0 ; start < buffer.getNumSamples() ; )
     {
-        float sum = 0.f;
-        
-        for ( int i = 0 ; i < nbChannels ; ++i )
-        {
-            if ( i >= buffer.getNumChannels() )
-                continue;
+        const int numSamples = juce::jmin( buffer.getNumSamples() - start, m_sampleSize100ms - m_positionSampleCount );
 
-            float weightingCoef = 0.f; 
-            
-            // kSpeakerArr51 is "L R C Lfe Ls Rs";
-            switch ( i )
-            {
-            case 0: // L
-            case 1: // R
-            case 2: // C
-                weightingCoef = 1.f;
-                break;
-            case 3: // Lfe
-                weightingCoef = 0.f;
-                break;
-            case 4: // Ls
-            case 5: // Rs
-                weightingCoef = 1.414213f; // 1.41 (~ +1.5 dB) for left and right surround channels 
-                break;
-            }
+        processSamples( buffer, start, numSamples, numChannels );
 
-            const float * data = &( m_volumeMemory.getReadPointer( i )[ sizeDone ] );
+        start += numSamples;
+        m_positionSampleCount += numSamples;
 
-            for ( int s = 0 ; s < m_sampleSize100ms ; ++s )
-            {
-                const float value = *data;
-                sum += value * value * weightingCoef;
-                ++data;
-            }
+        if ( m_positionSampleCount == m_sampleSize100ms )
+        {
+            addPosition( numChannels );
+            m_positionSampleCount = 0;
         }
+    }
+}
 
-        // process peak
-        const juce::AudioSampleBuffer hundredMillisecondBuffer( m_truePeakMemory.getArrayOfWritePointers(), m_truePeakMemory.getNumChannels(), sizeDone, m_sampleSize100ms );
-        AudioProcessing::TruePeak::LinearValue truePeakValue = m_truePeakProcessor.process( hundredMillisecondBuffer );
-
-        addSquaredInputAndTruePeak( sum / m_sampleSize100ms, truePeakValue, buffer.getNumChannels() );
+void LufsProcessor::processSamples( const juce::AudioSampleBuffer& buffer, const int start, const int numSamples, const int numChannels )
+{
+    STAGE_TIMING_SCOPE( m_stageTiming, StageTiming::lufsMeters );
 
-        sizeDone += m_sampleSize100ms;
+    const bool measureLoudness = needsLoudness( m_meters );
+    const bool measureTruePeak = ( m_meters & TruePeakMeter ) != 0;
 
-        if ( ( sizeDone + m_sampleSize100ms ) > m_memorySize )
-            break;
+    for ( int i = 0 ; i < numChannels ; ++i )
+    {
+        ChannelState & state = m_channelStateArray.getReference( i );
+        const float * data = buffer.getReadPointer( i, start );
+
+        if ( measureLoudness && measureTruePeak )
+            processChannel<true, true>( state, data, numSamples );
+        else if ( measureLoudness )
+            processChannel<true, false>( state, data, numSamples );
+        else if ( measureTruePeak )
+            processChannel<false, true>( state, data, numSamples );
     }
+}
 
-    // copy remaining samples to beginning of m_volumeMemory 
+template <bool measureLoudness, bool measureTruePeak> 
+void LufsProcessor::processChannel( ChannelState & state, const float * data, const int numSamples )
+{
+    // a single pass over the host samples: each one is K weighted and squared for the volume, 
+    // and oversampled for the true peak. filters and sums are copied to locals so they stay in 
+    // registers, the host buffer can't alias them
 
-    const int remaining = m_memorySize - sizeDone;
-    jassert( remaining >= 0 );
+    BiquadProcessor shelveFilter = state.m_shelveFilter;
+    BiquadProcessor highPassFilter = state.m_highPassFilter;
+    AudioProcessing::TruePeakChannel & truePeak = state.m_truePeak;
+    float squaredSum = state.m_squaredSum;
+    float truePeakMax = state.m_truePeakMax;
 
-    for ( int i = 0 ; i < m_nbChannels ; ++i )
+    for ( int s = 0 ; s < numSamples ; ++s )
     {
-        float * dest = m_volumeMemory.getWritePointer( i );
-        float * src = &dest[ sizeDone ];
+        const float x = data[ s ];
+
+        if ( measureLoudness )
+        {
+            const float y = highPassFilter.processSample( shelveFilter.processSample( x ) );
+            squaredSum += y * y;
+        }
 
-        for ( int s = 0 ; s < remaining ; ++s )
+        if ( measureTruePeak )
         {
-            *dest++ = *src++;
+            const float absMax = truePeak.process( x );
+            if ( absMax > truePeakMax )
+                truePeakMax = absMax;
         }
     }
 
-    // copy remaining samples to beginning of m_truePeakMemory too
+    state.m_shelveFilter = shelveFilter;
+    state.m_highPassFilter = highPassFilter;
+    state.m_squaredSum = squaredSum;
+    state.m_truePeakMax = truePeakMax;
+}
+
+void LufsProcessor::addPosition( const int numChannels )
+{
+    float sum = 0.f;
+    AudioProcessing::TruePeak::LinearValue truePeakValue;
 
     for ( int i = 0 ; i < m_nbChannels ; ++i )
     {
-        float * dest = m_truePeakMemory.getWritePointer( i );
-        float * src = &dest[ sizeDone ];
+        ChannelState & state = m_channelStateArray.getReference( i );
 
-        for ( int s = 0 ; s < remaining ; ++s )
+        if ( i < numChannels )
         {
-            *dest++ = *src++;
+            sum += state.m_squaredSum * getChannelWeighting( i );
+
+            if ( i < LUFS_TP_MAX_NB_CHANNELS )
+                truePeakValue.m_channelArray[ i ] = state.m_truePeakMax;
         }
+
+        state.m_squaredSum = 0.f;
+        state.m_truePeakMax = 0.f;
     }
 
-    m_memorySize = remaining;
+    addSquaredInputAndTruePeak( sum / m_sampleSize100ms, truePeakValue, juce::jmin( numChannels, LUFS_TP_MAX_NB_CHANNELS ) );
 }
 
 void LufsProcessor::addSquaredInputAndTruePeak( const float squaredInput, const AudioProcessing::TruePeak::LinearValue& value, const int numChannels )
@@ -377,21 +396,39 @@ void LufsProcessor::update()
 
     int size = m_processSize;
 
+    if ( m_validSize >= size )
+        return;
+
+    const int firstPosition = m_validSize;
+
     while ( m_validSize < size )
     {
         updatePosition( m_validSize );
         ++m_validSize;
     }
+
+    // gated volumes are computed once per update, not for every position: 
+    // catching up on a long file would scan the histograms thousands of times
+
+    m_integratedVolume = m_gatingState.getIntegratedVolume();
+    m_gatingState.getRange( m_rangeMin, m_rangeMax );
+
+    for ( int position = firstPosition ; position < size ; ++position )
+    {
+        m_integratedVolumeArray[ position ] = ( position >= 4 ) ? m_integratedVolume : DEFAULT_MIN_VOLUME;
+    }
 }
 
 void LufsProcessor::updatePosition( int position )
 {
     //DEBUGPLUGIN_output("LufsProcessor::updatePosition position %d", position);
 
-    // m_momentaryVolume 
-    m_integratedVolumeArray[ position ] = DEFAULT_MIN_VOLUME;
+    const bool isGated = ( position >= m_gatingStartPosition );
+    const int meters = m_meters;
+
+    // m_momentaryVolume, also needed for integrated volume
 
-    if ( position >= 4 )
+    if ( position >= 4 && ( meters & ( MomentaryMeter | IntegratedMeter ) ) != 0 )
     {
         // momentary, abbreviated M (400 ms)
 
@@ -404,35 +441,8 @@ void LufsProcessor::updatePosition( int position )
 
         m_momentaryVolumeArray[ position ] = juce::jmax( float(-0.691 + 10.*std::log10( sum ) ), DEFAULT_MIN_VOLUME );
         
-        if ( m_momentaryVolumeArray[ position ] > -70.f )
-        {
-            //DBG( juce::String( "Adding 1 " ) + juce::String( sum ) );
-            m_sum400ms70.addLufs( sum );
-        }
-
-        if ( m_sum400ms70.size() )
-        {
-            const float absoluteSum = m_sum400ms70.getSum() / (float) m_sum400ms70.size();
-            const float absoluteThresholdVolume = getLufsVolume( absoluteSum ) -10.f;
-            const float thresholdSum = getLufsSum( absoluteThresholdVolume );
-
-            const int index = m_sum400ms70.findIndexAfterValue( thresholdSum );
-
-            float relativeSum = 0.f;
-            for ( int i = index ; i < m_sum400ms70.size() ; ++i )
-            {
-                //DBG( juce::String( "relativeSum adding " ) + juce::String( m_sum400ms70.getUnchecked( i ) ) );
-                relativeSum += m_sum400ms70.getUnchecked( i );
-            }
-
-            if ( m_sum400ms70.size() - index )
-                relativeSum /= ( m_sum400ms70.size() - index );
-
-            //DBG( juce::String( "relativeSum " ) + juce::String( relativeSum ) );
-            
-            m_integratedVolume = getLufsVolume( relativeSum );
-            m_integratedVolumeArray[ position ] = m_integratedVolume;
-        }
+        if ( isGated )
+            m_gatingState.addMomentary( m_momentaryVolumeArray[ position ] );
     }
     else
     {
@@ -440,9 +450,9 @@ void LufsProcessor::updatePosition( int position )
     }
 
 
-    // short term, abbreviated S (3 s)
+    // short term, abbreviated S (3 s), also needed for range
 
-    if ( position >= 30 )
+    if ( position >= 30 && ( meters & ( ShortTermMeter | LoudnessRangeMeter ) ) != 0 )
     {
         float sum = 0.f;
         for ( int i = position - 30 ; i < position ; ++i )
@@ -452,31 +462,244 @@ void LufsProcessor::updatePosition( int position )
         sum /= 30;
         m_shortTermVolumeArray[ position ] = juce::jmax( float(-0.691 + 10.*std::log10( sum ) ), DEFAULT_MIN_VOLUME );
 
-        if ( m_shortTermVolumeArray[ position ] > -70.f )
+        if ( isGated )
+            m_gatingState.addShortTerm( m_shortTermVolumeArray[ position ] );
+    }
+    else
+    {
+        m_shortTermVolumeArray[ position ] = DEFAULT_MIN_VOLUME;
+    }
+
+
+    // true peak
+
+    if ( isGated )
+    {
+        for ( int ch = 0 ; ch < LUFS_TP_MAX_NB_CHANNELS ; ++ch )
         {
-            m_sum3s70.addLufs( sum );
+            m_gatingState.addTruePeak( ch, m_truePeakPerChannelArray[ ch ][ position ] );
         }
+    }
+}
 
-        if ( m_sum3s70.size() )
-        {
-            const float absoluteSum = m_sum3s70.getSum() / (float) m_sum3s70.size();
-            const float absoluteThresholdVolume = getLufsVolume( absoluteSum ) -20.f;
-            const float thresholdSum = getLufsSum( absoluteThresholdVolume );
 
-            const int index = m_sum3s70.findIndexAfterValue( thresholdSum );
+// LufsGatingState implementation 
+
+LufsGatingState::LufsGatingState()
+{
+    reset();
+}
 
-            const float sumPercentile10 = m_sum3s70.getPercentileValue( index, 0.1f );
-            const float sumPercentile95 = m_sum3s70.getPercentileValue( index, 0.95f );
+void LufsGatingState::reset()
+{
+    m_momentaryHistogram.reset();
+    m_shortTermHistogram.reset();
 
-            m_rangeMin = getLufsVolume( sumPercentile10 );
-            m_rangeMax = getLufsVolume( sumPercentile95 );
+    m_maxMomentary = DEFAULT_MIN_VOLUME;
+    m_maxShortTerm = DEFAULT_MIN_VOLUME;
+
+    for ( int ch = 0 ; ch < LUFS_TP_MAX_NB_CHANNELS ; ++ch )
+    {
+        m_truePeakMaxPerChannelArray[ ch ] = DEFAULT_MIN_VOLUME;
+    }
+}
+
+void LufsGatingState::merge( const LufsGatingState & other )
+{
+    m_momentaryHistogram.merge( other.m_momentaryHistogram );
+    m_shortTermHistogram.merge( other.m_shortTermHistogram );
+
+    m_maxMomentary = juce::jmax( m_maxMomentary, other.m_maxMomentary );
+    m_maxShortTerm = juce::jmax( m_maxShortTerm, other.m_maxShortTerm );
+
+    for ( int ch = 0 ; ch < LUFS_TP_MAX_NB_CHANNELS ; ++ch )
+    {
+        m_truePeakMaxPerChannelArray[ ch ] = juce::jmax( m_truePeakMaxPerChannelArray[ ch ], other.m_truePeakMaxPerChannelArray[ ch ] );
+    }
+}
+
+void LufsGatingState::addMomentary( const float volume )
+{
+    m_maxMomentary = juce::jmax( m_maxMomentary, volume );
+    m_momentaryHistogram.add( volume );
+}
+
+void LufsGatingState::addShortTerm( const float volume )
+{
+    m_maxShortTerm = juce::jmax( m_maxShortTerm, volume );
+    m_shortTermHistogram.add( volume );
+}
+
+void LufsGatingState::addTruePeak( const int channel, const float decibelTruePeak )
+{
+    jassert( channel < LUFS_TP_MAX_NB_CHANNELS );
+
+    m_truePeakMaxPerChannelArray[ channel ] = juce::jmax( m_truePeakMaxPerChannelArray[ channel ], decibelTruePeak );
+}
+
+float LufsGatingState::getIntegratedVolume() const
+{
+    // relative gate is 10 LU below the volume of values above the absolute gate
+
+    int nbValues = 0;
+    const double absoluteSum = m_momentaryHistogram.getMeanSum( 0, nbValues );
+
+    if ( nbValues == 0 )
+        return DEFAULT_MIN_VOLUME;
+
+    const int index = m_momentaryHistogram.findIndexAfterVolume( getLufsVolume( absoluteSum ) - 10.f );
+    const double relativeSum = m_momentaryHistogram.getMeanSum( index, nbValues );
+
+    return getLufsVolume( relativeSum );
+}
+
+void LufsGatingState::getRange( float & rangeMin, float & rangeMax ) const
+{
+    // relative gate is 20 LU below the volume of values above the absolute gate,
+    // range is between 10% and 95% percentiles of the values above it
+
+    rangeMin = DEFAULT_MIN_VOLUME;
+    rangeMax = DEFAULT_MIN_VOLUME;
+
+    int nbValues = 0;
+    const double absoluteSum = m_shortTermHistogram.getMeanSum( 0, nbValues );
+
+    if ( nbValues == 0 )
+        return;
+
+    const int index = m_shortTermHistogram.findIndexAfterVolume( getLufsVolume( absoluteSum ) - 20.f );
+    m_shortTermHistogram.getMeanSum( index, nbValues );
+
+    if ( nbValues == 0 )
+        return;
+
+    rangeMin = getStepVolume( m_shortTermHistogram.findIndexOfRank( index, (int)( 0.1f * (float)( nbValues - 1 ) ) ) );
+    rangeMax = getStepVolume( m_shortTermHistogram.findIndexOfRank( index, (int)( 0.95f * (float)( nbValues - 1 ) ) ) );
+}
+
+float LufsGatingState::getTruePeak() const
+{
+    float truePeak = DEFAULT_MIN_VOLUME;
+
+    for ( int ch = 0 ; ch < LUFS_TP_MAX_NB_CHANNELS ; ++ch )
+    {
+        truePeak = juce::jmax( truePeak, m_truePeakMaxPerChannelArray[ ch ] );
+    }
+
+    return truePeak;
+}
+
+float LufsGatingState::getStepVolume( const int index )
+{
+    // volume in the middle of the step
+    return LUFS_GATING_ABSOLUTE_THRESHOLD + ( (float)index + 0.5f ) / (float)LUFS_GATING_STEPS_PER_LU;
+}
+
+double LufsGatingState::getStepSum( const int index )
+{
+    static const std::vector<double> sumArray = []
+    {
+        std::vector<double> sums( LUFS_GATING_NB_STEPS );
+
+        for ( int i = 0 ; i < LUFS_GATING_NB_STEPS ; ++i )
+        {
+            sums[ i ] = pow( 10.0, ( getStepVolume( i ) + 0.691 ) / 10.0 );
         }
 
+        return sums;
+    }();
+
+    return sumArray[ index ];
+}
+
+float LufsGatingState::getLufsVolume( const double sum )
+{
+    if ( sum <= 0.0 )
+        return DEFAULT_MIN_VOLUME;
+
+    return juce::jmax( float( -0.691 + 10.0 * log10( sum ) ), DEFAULT_MIN_VOLUME );
+}
+
+LufsGatingState::Histogram::Histogram()
+    : m_counts( LUFS_GATING_NB_STEPS, 0 )
+{
+    reset();
+}
+
+void LufsGatingState::Histogram::reset()
+{
+    std::fill( m_counts.begin(), m_counts.end(), 0 );
+
+    m_nbValues = 0;
+    m_lowestIndex = LUFS_GATING_NB_STEPS;
+    m_highestIndex = -1;
+}
+
+void LufsGatingState::Histogram::merge( const Histogram & other )
+{
+    for ( int i = other.m_lowestIndex ; i <= other.m_highestIndex ; ++i )
+    {
+        m_counts[ i ] += other.m_counts[ i ];
     }
-    else
+
+    m_nbValues += other.m_nbValues;
+    m_lowestIndex = juce::jmin( m_lowestIndex, other.m_lowestIndex );
+    m_highestIndex = juce::jmax( m_highestIndex, other.m_highestIndex );
+}
+
+void LufsGatingState::Histogram::add( const float volume )
+{
+    // absolute gate
+    if ( !( volume > LUFS_GATING_ABSOLUTE_THRESHOLD ) )
+        return;
+
+    const int index = juce::jmin( (int)( ( volume - LUFS_GATING_ABSOLUTE_THRESHOLD ) * LUFS_GATING_STEPS_PER_LU ), LUFS_GATING_NB_STEPS - 1 );
+
+    ++m_counts[ index ];
+    ++m_nbValues;
+
+    m_lowestIndex = juce::jmin( m_lowestIndex, index );
+    m_highestIndex = juce::jmax( m_highestIndex, index );
+}
+
+double LufsGatingState::Histogram::getMeanSum( const int index, int & nbValues ) const
+{
+    double sum = 0.0;
+    nbValues = 0;
+
+    for ( int i = juce::jmax( index, m_lowestIndex ) ; i <= m_highestIndex ; ++i )
     {
-        m_shortTermVolumeArray[ position ] = DEFAULT_MIN_VOLUME;
+        sum += m_counts[ i ] * getStepSum( i );
+        nbValues += m_counts[ i ];
     }
+
+    return nbValues ? sum / nbValues : 0.0;
+}
+
+int LufsGatingState::Histogram::findIndexAfterVolume( const float volume ) const
+{
+    for ( int i = m_lowestIndex ; i <= m_highestIndex ; ++i )
+    {
+        if ( getStepVolume( i ) > volume )
+            return i;
+    }
+
+    return LUFS_GATING_NB_STEPS;
+}
+
+int LufsGatingState::Histogram::findIndexOfRank( const int index, const int rank ) const
+{
+    int count = 0;
+
+    for ( int i = juce::jmax( index, m_lowestIndex ) ; i <= m_highestIndex ; ++i )
+    {
+        count += m_counts[ i ];
+
+        if ( count > rank )
+            return i;
+    }
+
+    return m_highestIndex;
 }
 
 
@@ -564,27 +787,22 @@ BiquadProcessor::BiquadProcessor()
 {
 }
 
+void BiquadProcessor::reset()
+{
+    m_X_2 = 0.f;
+    m_X_1 = 0.f;
+
+    m_Y_2 = 0.f;
+    m_Y_1 = 0.f;
+}
+
 void BiquadProcessor::process( float * _data, const int _sampleSize )
 {
     float * data = _data;
 
     for ( int sample = 0 ; sample < _sampleSize ; ++sample )
     {
-        float x = *data;
-
-        float y = x * m_B0;
-        y += m_X_1 * m_B1;
-        y += m_X_2 * m_B2;
-        y += m_Y_1 * m_A1;
-        y += m_Y_2 * m_A2;
-
-        m_X_2 = m_X_1;
-        m_X_1 = x;
-
-        m_Y_2 = m_Y_1;
-        m_Y_1 = y;
-
-        *data = y;
+        *data = processSample( *data );
 
         ++data;
     }
@@ -21,12 +21,26 @@
 
 #pragma once 
 
-#include "../JuceLibraryCode/JuceHeader.h"
+#include <vector>
+
+#include <JuceHeader.h>
+#include "DspUtils.h"
 #include "TruePeakProcessor.h"
+#include "StageTiming.h"
 
 #define DEFAULT_MIN_VOLUME ( -100.f )
 #define DEFAULT_ACCEPTABLE_MAX_TRUE_PEAK ( -1.f )
 #define LUFS_TP_MAX_NB_CHANNELS 2
+#define LUFS_MAX_POSITIONS ( 256 * 1024 ) // 100 ms positions stored, more than 7 hours. Later ones aren't measured.
+
+#define LUFS_GATING_ABSOLUTE_THRESHOLD ( -70.f )
+#define LUFS_GATING_MAX_VOLUME ( 10.f )
+#define LUFS_GATING_STEPS_PER_LU 100
+#define LUFS_GATING_NB_STEPS ( (int)( ( LUFS_GATING_MAX_VOLUME - LUFS_GATING_ABSOLUTE_THRESHOLD ) * LUFS_GATING_STEPS_PER_LU ) )
+
+// 100 ms positions to process before a file segment: 3 s for the short term window,
+// and 1 s for the K weighting filters to settle
+#define LUFS_SEGMENT_WARM_UP_POSITIONS 40
 
 class BiquadProcessor
 {
@@ -45,8 +59,35 @@ public:
 
     BiquadProcessor();
 
+    // clears the filter state, keeping the coefficients
+    void reset();
+
     void process( float * _data, const int _sampleSize );
 
+    // one sample, for kernels that do other work on the same samples
+    inline float processSample( const float x )
+    {
+        float y = x * m_B0;
+        y += m_X_1 * m_B1;
+        y += m_X_2 * m_B2;
+        y += m_Y_1 * m_A1;
+        y += m_Y_2 * m_A2;
+
+        // when the input goes silent, the output decays towards zero and would end up in denormals, 
+        // which are very slow on x86: flush it once it's down to nothing. done on each sample (not 
+        // on the state at the end of the block, as Juce's IIRFilter does) so the result doesn't 
+        // depend on the block size
+        snapToZero( y );
+
+        m_X_2 = m_X_1;
+        m_X_1 = x;
+
+        m_Y_2 = m_Y_1;
+        m_Y_1 = y;
+
+        return y;
+    }
+
     void setFilterParams( const float _samplingRate, const FilterType _filterType, const float _frequency, const float _quality, const float _decibelGain );
 
 private:
@@ -57,101 +98,74 @@ private:
     float m_B0, m_B1, m_B2, m_A1, m_A2;
 };
 
-class LufsFloatArray : public juce::Array<float>
+/**
+    Gating state of a loudness measurement: histograms of momentary (400 ms) and short term (3 s)
+    volumes above the absolute gate, max volumes, and true peak max per channel.
+
+    Histogram steps are 0.01 LU. Counts and max values merge exactly, so measuring a file in
+    segments and merging their states gives the same integrated volume, range and true peak
+    as measuring it in one go, whatever the order of merging.
+*/
+class LufsGatingState
 {
 public:
 
-    LufsFloatArray() : m_sum( 0.f ) {}
-    
-    void addLufs( float element ) 
-    { 
-        m_sum += element; 
+    LufsGatingState();
 
-        addSorted( *this, element ); 
-    }
+    void reset();
+    void merge( const LufsGatingState & other );
 
-    static int compareElements( const float first, const float second ) noexcept
-    {
-        const int result = (int)( 1000000000.f * ( first - second ) );
+    void addMomentary( const float volume );
+    void addShortTerm( const float volume );
+    void addTruePeak( const int channel, const float decibelTruePeak );
 
-        return result;
-    }
+    // DEFAULT_MIN_VOLUME until something is above the absolute gate
+    float getIntegratedVolume() const;
+    void getRange( float & rangeMin, float & rangeMax ) const;
 
-    float getPercentileValue( const int beginIndex, const float percentile ) const
-    {
-        jassert( beginIndex < size() );
-        jassert( percentile >= 0.f );
-        jassert( percentile <= 1.f );
-
-        switch( size() )
-        {
-        case 0:
-            return 0.f;
-        case 1:
-        case 2:
-            return getUnchecked( 0 );
-        }
-
-        const int indexBefore = beginIndex + (int)( percentile * (float)( size() - beginIndex - 1 ) );
-        return getUnchecked( indexBefore );
-    }
+    inline float getMaxMomentaryVolume() const { return m_maxMomentary; }
+    inline float getMaxShortTermVolume() const { return m_maxShortTerm; }
+    inline float getTruePeakChannelMax( const int ch ) const { return m_truePeakMaxPerChannelArray[ch]; }
+    float getTruePeak() const;
 
-    int findIndexAfterValue_( float value )
-    {
-        // to be optimized
-        jassert( size() );
-
-        for ( int i = 0 ; i < size() ; ++i )
-        {
-            if ( getUnchecked( i ) > value )
-            {
-                return i;
-            }
-        }
-
-        return size() - 1;
-    }
+private:
 
-    int findIndexAfterValue( float value )
+    class Histogram
     {
-        // could be optimized
-        jassert( size() );
-
-        if ( getUnchecked( 0 ) > value ) 
-        {
-            return 0;
-        }
-
-        int indexBefore = 0; 
-        int indexAfter = size() - 1;
-
-        while ( indexAfter - indexBefore > 1 )
-        {
-            int index = ( indexAfter + indexBefore ) >> 1;
-            if ( getUnchecked( index ) > value )
-                indexAfter = index;
-            else
-                indexBefore = index;
-        }
-
-        return indexAfter;
-    }
+    public:
+        Histogram();
 
-    float getSum() const 
-    {
-        return m_sum;
-    }
+        void reset();
+        void merge( const Histogram & other );
+        void add( const float volume );
 
-    void reset()
-    {
-        clearQuick();
+        inline int getNbValues() const { return m_nbValues; }
 
-        m_sum = 0.f;
-    }
+        // mean of lufs sums for steps from index, with the number of values
+        double getMeanSum( const int index, int & nbValues ) const;
 
-private:
+        // first step above volume, or LUFS_GATING_NB_STEPS if none
+        int findIndexAfterVolume( const float volume ) const;
 
-    float m_sum;
+        // step of the value at rank, counting values in order from index
+        int findIndexOfRank( const int index, const int rank ) const;
+
+    private:
+        std::vector<int> m_counts;
+        int m_nbValues;
+        int m_lowestIndex;
+        int m_highestIndex;
+    };
+
+    static float getStepVolume( const int index );
+    static double getStepSum( const int index );
+    static float getLufsVolume( const double sum );
+
+    Histogram m_momentaryHistogram;
+    Histogram m_shortTermHistogram;
+    float m_maxMomentary;
+    float m_maxShortTerm;
+    float m_truePeakMaxPerChannelArray[LUFS_TP_MAX_NB_CHANNELS];
 };
 
 
@@ -159,6 +173,18 @@ class LufsProcessor
 {
 public:
 
+    // meters that can be measured, combined in a mask for setMeters 
+    enum Meter
+    {
+        TruePeakMeter = 1,
+        MomentaryMeter = 2,
+        ShortTermMeter = 4,
+        IntegratedMeter = 8,
+        LoudnessRangeMeter = 16,
+        AllMeters = 31
+    };
+
+    // NaN if the file can't be opened or read
     static float testTruePeak(const juce::File & input , const double sampleRate, int bufferSize);
 
     LufsProcessor( const int nbChannels );
@@ -171,6 +197,14 @@ public:
     void prepareToPlay(const double sampleRate, int samplesPerBlock);
     void processBlock( juce::AudioSampleBuffer& buffer );
 
+    // meters to measure, all by default. the K weighting runs if any loudness meter is requested, 
+    // the true peak oversampler only for TruePeakMeter. integrated and range need the momentary 
+    // and short term volumes, so those are computed for them even when not requested. meters not 
+    // measured read DEFAULT_MIN_VOLUME. a meter turned on starts measuring from there, reset() to 
+    // start over
+    void setMeters( const int meters );
+    inline int getMeters() const { return m_meters; }
+
     inline void pause() { m_paused = true; }
     inline void resume() { m_paused = false; }
     inline bool isPaused() { return m_paused; }
@@ -192,28 +226,46 @@ public:
 
     inline int getSeconds() const { return m_processSize / 10; }
 
+    // Gating state for positions from the gating start position, for merging with other
+    // segments of the same file. Positions before it are metered but not gated, so the
+    // warm up part of a segment doesn't count twice.
+    inline const LufsGatingState & getGatingState() const { return m_gatingState; }
+    inline void setGatingStartPosition( const int position ) { m_gatingStartPosition = position; }
+
+    // timing of the filter, loudness and true peak stages, when built with DREAMCONTROL_STAGE_TIMING
+    inline void setStageTiming( StageTiming * stageTiming ) { m_stageTiming = stageTiming; }
+
 private:
 
+    // metering kernel state of one channel: K weighting filters, and sum of squares and true peak 
+    // max for the current 100 ms
+    struct ChannelState
+    {
+        ChannelState() : m_squaredSum( 0.f ), m_truePeakMax( 0.f ) {}
+
+        BiquadProcessor m_shelveFilter;
+        BiquadProcessor m_highPassFilter;
+        AudioProcessing::TruePeakChannel m_truePeak;
+        float m_squaredSum;
+        float m_truePeakMax;
+    };
+
+    void processSamples( const juce::AudioSampleBuffer& buffer, const int start, const int numSamples, const int numChannels );
+    template <bool measureLoudness, bool measureTruePeak> 
+    void processChannel( ChannelState & state, const float * data, const int numSamples );
+    void addPosition( const int numChannels );
     void addSquaredInputAndTruePeak( const float squaredInput, const AudioProcessing::TruePeak::LinearValue& value, const int numChannels );
     void updatePosition( int position );
 
-    static double ms_log10;
-    float getLufsVolume( const float sum ) { return float( juce::jmax( float(-0.691 + 10.0 * log( sum ) / ms_log10 ), DEFAULT_MIN_VOLUME ) ); }
-    float getLufsSum( const float volume ) { return float( exp( ( volume + 0.691 ) * ms_log10 / 10.0 ) ); }
-
-    juce::AudioSampleBuffer m_block; // data is copied to this buffer then filtered
-    juce::AudioSampleBuffer m_volumeMemory; // samples not processed from previous callback, filtered for volume 
-    juce::AudioSampleBuffer m_truePeakMemory; // samples not processed from previous callback, not filtered, for true peak 
     double m_sampleRate;
     int m_nbChannels;
 
-    juce::Array<BiquadProcessor> m_shelveFilterArray;
-    juce::Array<BiquadProcessor> m_highPassFilterArray;
+    juce::Array<ChannelState> m_channelStateArray;
 
     int m_maxSize;
     volatile int m_processSize;
     int m_validSize; // process size as seen by client, in main update 
-    int m_memorySize;
+    int m_positionSampleCount; // samples of the current 100 ms processed so far
     int m_sampleSize100ms;
 
     float * m_squaredInputArray; // squared input for 100 ms, summed for all channels, after K weighting filtration
@@ -228,18 +280,14 @@ private:
     float m_rangeMin;
     float m_rangeMax;
 
-    // 4 samples to calculate min/max, per channel
-    float ** m_memArray;
-    // linear max, per channel 
-    float m_maxLinArray[LUFS_TP_MAX_NB_CHANNELS];
-    juce::AudioSampleBuffer m_tempBlock; // to process min max;
-
     juce::SpinLock m_locker;
 
-    LufsFloatArray m_sum400ms70;
-    LufsFloatArray m_sum3s70;
+    LufsGatingState m_gatingState;
+    int m_gatingStartPosition;
+
+    StageTiming * m_stageTiming;
 
-    AudioProcessing::TruePeak m_truePeakProcessor;
+    volatile int m_meters;
 
     bool m_paused;
 };
@@ -0,0 +1,60 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "MeterAnalysisThread.h"
+
+MeterAnalysisThread::MeterAnalysisThread(LufsProcessor& lufsProcessor, BallisticMeterProcessor& ballisticMeterProcessor)
+	: Thread("Meter analysis"), lufsProcessor(lufsProcessor), ballisticMeterProcessor(ballisticMeterProcessor)
+{
+}
+
+MeterAnalysisThread::~MeterAnalysisThread()
+{
+	stop();
+}
+
+void MeterAnalysisThread::prepareToPlay(double sampleRate, int numChannels)
+{
+	stop();
+
+	// Channels missing from a block are metered as silence, as LufsProcessor expects all its channels.
+	fifo.prepare(numChannels, (int)(METER_ANALYSIS_FIFO_SECONDS * sampleRate));
+
+	startThread();
+}
+
+void MeterAnalysisThread::stop()
+{
+	stopThread(-1);
+}
+
+void MeterAnalysisThread::run()
+{
+	while (!threadShouldExit())
+	{
+		if (fifo.getNumReady() == 0)
+		{
+			wait(METER_ANALYSIS_POLL_MS);
+			continue;
+		}
+
+		// The FIFO's own memory is metered in place.
+		fifo.read([this](AudioSampleBuffer& block)
+		{
+			lufsProcessor.processBlock(block);
+			ballisticMeterProcessor.process(block);
+		});
+	}
+}
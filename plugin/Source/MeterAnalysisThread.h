@@ -0,0 +1,73 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "BallisticMeterProcessor.h"
+#include "LufsProcessor.h"
+#include "MultichannelBlockFifo.h"
+
+#define METER_ANALYSIS_FIFO_SECONDS 0.5			// How far the worker may fall behind before blocks are dropped.
+#define METER_ANALYSIS_POLL_MS 2				// The audio thread never wakes the worker, it polls.
+
+//==============================================================================
+/**
+	Runs the meters (LufsProcessor and BallisticMeterProcessor) on their own thread, so the
+	audio thread only copies samples.
+
+	push() is wait-free: it copies the block into a MultichannelBlockFifo and never
+	locks or allocates. The worker polls the FIFO every
+	couple of milliseconds and meters whatever is there, so the meters lag the audio
+	by a few ms. Meters don't depend on how the audio is split into blocks, so they
+	are the same as metering on the audio thread.
+
+	If the worker falls behind by more than the FIFO holds, whole blocks are dropped
+	and counted, rather than the audio thread waiting. The meters miss that audio.
+*/
+class MeterAnalysisThread : private Thread
+{
+public:
+	MeterAnalysisThread(LufsProcessor& lufsProcessor, BallisticMeterProcessor& ballisticMeterProcessor);
+	~MeterAnalysisThread();
+
+	// Not real-time: stops the worker, sizes and clears the FIFO, then starts it again.
+	void prepareToPlay(double sampleRate, int numChannels);
+
+	// Not real-time. Samples still in the FIFO aren't metered, prepareToPlay clears them.
+	void stop();
+
+	// Audio thread only.
+	void push(const AudioSampleBuffer& block) { fifo.push(block); }
+
+	// True while samples pushed are waiting or being metered: the audio thread must keep
+	// pushing until then if it switches back to metering itself, so samples stay in order.
+	bool isBusy() const { return fifo.getNumReady() > 0; }
+
+	// Sample frames push() can take without dropping any.
+	int getFreeSpace() const { return fifo.getFreeSpace(); }
+
+	// Sample frames dropped because the FIFO was full, since prepareToPlay.
+	int64 getNumDroppedFrames() const { return fifo.getNumDroppedFrames(); }
+
+private:
+	void run() override;
+
+	LufsProcessor& lufsProcessor;
+	BallisticMeterProcessor& ballisticMeterProcessor;
+	MultichannelBlockFifo fifo;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MeterAnalysisThread)
+};
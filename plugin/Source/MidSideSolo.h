@@ -0,0 +1,55 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// M/S solo, in place on the first two channels: the mid or side signal in both. Mono buffers are left alone.
+// Part of MonitorChain, kept apart as it needs no state.
+
+inline void applyMidSolo(AudioSampleBuffer& buffer)
+{
+	if (buffer.getNumChannels() < 2)
+		return;
+
+	float* left = buffer.getWritePointer(0);
+	float* right = buffer.getWritePointer(1);
+
+	for (int sample = 0; sample < buffer.getNumSamples(); ++sample)
+	{
+		left[sample] = (left[sample] + right[sample]) / 2.0;
+		right[sample] = left[sample];
+	}
+}
+
+inline void applySideSolo(AudioSampleBuffer& buffer)
+{
+	if (buffer.getNumChannels() < 2)
+		return;
+
+	float* left = buffer.getWritePointer(0);
+	float* right = buffer.getWritePointer(1);
+
+	// Each sample only uses the input sample at the same position.
+	for (int sample = 0; sample < buffer.getNumSamples(); ++sample)
+	{
+		const float l = left[sample];
+		const float r = right[sample];
+
+		left[sample] = ((r - l) + -(l - r)) / 2.0;
+		right[sample] = left[sample];
+	}
+}
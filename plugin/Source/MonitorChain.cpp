@@ -0,0 +1,180 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "MonitorChain.h"
+#include "MidSideSolo.h"
+
+MonitorChain::MonitorChain(const MonitorRouting& monitorRouting, int numMeterChannels)
+	: monitorRouting(monitorRouting), multibandWasActive(false), linearPhaseWasActive(false), lufsProcessor(numMeterChannels),
+	meterAnalysisThread(lufsProcessor, ballisticMeterProcessor), roomCorrectionWasActive(false)
+{
+	lufsProcessor.setStageTiming(&stageTiming);
+	ballisticMeterProcessor.setStageTiming(&stageTiming);
+}
+
+void MonitorChain::prepareToPlay(double sampleRate, int samplesPerBlock, int numChannels)
+{
+	multibandCrossover.prepareToPlay(sampleRate, numChannels);
+	multibandWasActive = false;
+	linearPhaseCrossover.prepareToPlay(sampleRate, numChannels, MULTIBAND_CROSSOVER_MAX_BANDS);
+	linearPhaseWasActive = false;
+
+	loudnessEqProcessor.prepareToPlay(sampleRate, numChannels);
+
+	// The analysis thread is stopped first, as it may still be metering from the last run.
+	meterAnalysisThread.stop();
+	lufsProcessor.prepareToPlay(sampleRate, samplesPerBlock);
+	lufsProcessor.reset();
+	ballisticMeterProcessor.prepareToPlay(sampleRate, numChannels);
+	meterAnalysisThread.prepareToPlay(sampleRate, numChannels);
+	spectrumAnalyser.prepareToPlay(sampleRate, numChannels);
+	stageTiming.clear();
+
+	speakerSetProcessor.prepareToPlay(sampleRate, numChannels, MONITOR_ROUTING_MAX_DELAY_MS);
+	roomCorrectionProcessor.prepareToPlay(sampleRate, numChannels);
+	roomCorrectionWasActive = false;
+}
+
+void MonitorChain::releaseResources()
+{
+	meterAnalysisThread.stop();
+	spectrumAnalyser.stop();
+	roomCorrectionProcessor.stop();
+}
+
+// The IIR crossovers pick the settings up on the audio thread, the linear phase ones are only
+// redesigned when something has changed.
+void MonitorChain::setCrossovers(int numBands, const float* frequencies)
+{
+	multibandCrossover.setNumBands(numBands);
+	linearPhaseCrossover.setNumBands(numBands);
+
+	for (int i = 0; i < MULTIBAND_CROSSOVER_MAX_CROSSOVERS; i++)
+	{
+		multibandCrossover.setCrossoverFrequency(i, frequencies[i]);
+		linearPhaseCrossover.setCrossoverFrequency(i, frequencies[i]);
+	}
+
+	linearPhaseCrossover.update();
+}
+
+int MonitorChain::getLatencySamples(bool linearPhase, bool roomCorrection) const
+{
+	int latency = linearPhase ? linearPhaseCrossover.getLatencySamples() : 0;
+	if (roomCorrection)
+		latency += roomCorrectionProcessor.getLatencySamples();
+
+	return latency;
+}
+
+void MonitorChain::process(AudioSampleBuffer& buffer, const Settings& settings)
+{
+	// IIR filter tails decay into denormals when playback stops, which are very slow on x86.
+	// The filters flush their state too, this covers everything else.
+	ScopedNoDenormals noDenormals;
+
+	STAGE_TIMING_SCOPE(&stageTiming, StageTiming::processBlock);
+
+	// The spectrum is of the input, before solo, trim and EQ, for setting the crossovers by.
+	if (spectrumAnalyser.getFrameRate() > 0.0f)
+		spectrumAnalyser.push(buffer);
+
+	// Band solo. The linear phase crossovers delay everything, soloed or not, by the latency reported to the host.
+	if (settings.linearPhase)
+	{
+		STAGE_TIMING_SCOPE(&stageTiming, StageTiming::bandSolo);
+
+		// Its history is stale if the IIR crossovers were used in the meantime.
+		if (!linearPhaseWasActive)
+			linearPhaseCrossover.reset();
+
+		linearPhaseCrossover.process(buffer, settings.soloMask);
+	}
+	else if (settings.soloMask != 0)
+	{
+		STAGE_TIMING_SCOPE(&stageTiming, StageTiming::bandSolo);
+
+		// It only knows which bands were soloed last time it ran.
+		if (!multibandWasActive)
+			multibandCrossover.reset();
+
+		multibandCrossover.process(buffer, settings.soloMask);
+	}
+
+	linearPhaseWasActive = settings.linearPhase;
+	multibandWasActive = !settings.linearPhase && settings.soloMask != 0;
+
+	// Mid/side solo
+	if (settings.midSolo)
+	{
+		STAGE_TIMING_SCOPE(&stageTiming, StageTiming::midSide);
+		applyMidSolo(buffer);
+	}
+	else if (settings.sideSolo)
+	{
+		STAGE_TIMING_SCOPE(&stageTiming, StageTiming::midSide);
+		applySideSolo(buffer);
+	}
+
+	// Perform LUFS, True Peak and ballistic measurements, here or on the analysis thread. After switching
+	// back, blocks go through the analysis thread until it's done, so they're metered in order. They're
+	// taken before the loudness EQ, which is a listening aid and mustn't change the readings.
+	if (settings.meterOnAnalysisThread || meterAnalysisThread.isBusy())
+	{
+		meterAnalysisThread.push(buffer);
+	}
+	else
+	{
+		lufsProcessor.processBlock(buffer);
+		ballisticMeterProcessor.process(buffer);
+	}
+
+	// Loudness EQ, after the meters
+	if (settings.loudnessEq)
+	{
+		STAGE_TIMING_SCOPE(&stageTiming, StageTiming::loudnessEq);
+		loudnessEqProcessor.setLevel(settings.listeningLevel);
+		loudnessEqProcessor.process(buffer);
+	}
+
+	// Trim and time alignment for the selected speaker set, applied in the same pass as the monitor gain.
+	// Crossfades when switching speaker sets, so no clicks. Monitors off uses no trim or delay.
+	if (settings.speakerSet >= 0)
+	{
+		auto routing = monitorRouting.getSpeakerSetForAudioThread(settings.speakerSet);
+		speakerSetProcessor.setTarget(routing.trimDb, routing.delayMs);
+	}
+	else
+	{
+		speakerSetProcessor.setTarget(0.0f, 0.0f);
+	}
+
+	// Room correction follows the speaker set too, crossfading between the sets' filters.
+	if (settings.roomCorrection)
+	{
+		STAGE_TIMING_SCOPE(&stageTiming, StageTiming::roomCorrection);
+
+		// Its history is stale if it was switched off in the meantime.
+		if (!roomCorrectionWasActive)
+			roomCorrectionProcessor.reset();
+
+		roomCorrectionProcessor.setSpeakerSet(settings.speakerSet);
+		roomCorrectionProcessor.process(buffer);
+	}
+	roomCorrectionWasActive = settings.roomCorrection;
+
+	STAGE_TIMING_SCOPE(&stageTiming, StageTiming::speakerSet);
+	speakerSetProcessor.process(buffer, settings.gain);
+}
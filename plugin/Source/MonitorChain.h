@@ -0,0 +1,111 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "BallisticMeterProcessor.h"
+#include "LinearPhaseCrossover.h"
+#include "LoudnessEqProcessor.h"
+#include "LufsProcessor.h"
+#include "MeterAnalysisThread.h"
+#include "MonitorRouting.h"
+#include "MultibandCrossover.h"
+#include "RoomCorrectionProcessor.h"
+#include "SpeakerSetProcessor.h"
+#include "SpectrumAnalyserThread.h"
+#include "StageTiming.h"
+
+//==============================================================================
+/**
+	The plugin's audio processing, from the host's input to its output: the spectrum
+	tap, band solo (IIR or linear phase crossovers), M/S solo, the LUFS, true peak
+	and ballistic meters (here or on the analysis thread), loudness EQ, room
+	correction, and the speaker set's trim, delay and monitor gain.
+
+	It has no parameters of its own: the plugin reads its parameters into a Settings
+	once per block. The stages' own settings (crossover frequencies, ballistics,
+	impulse responses) are made on the stages themselves, from the threads each one
+	allows. The block size stress test runs this class too, so it checks the code
+	the plugin runs.
+*/
+class MonitorChain
+{
+public:
+	struct Settings
+	{
+		int soloMask;						// Bit n is band n.
+		bool linearPhase;					// Linear phase crossovers: always run, for a steady latency.
+		bool midSolo;
+		bool sideSolo;						// Ignored while midSolo is on.
+		bool meterOnAnalysisThread;
+		bool loudnessEq;
+		float listeningLevel;				// dB, for the loudness EQ.
+		float gain;							// Monitor gain, 0 for mute.
+		int speakerSet;						// -1 for monitors off: no trim, delay or room correction filter.
+		bool roomCorrection;
+	};
+
+	// The routing table is read on the audio thread, for the speaker set's trim and delay.
+	MonitorChain(const MonitorRouting& monitorRouting, int numMeterChannels);
+
+	// Not real-time: prepares every stage and starts the analysis threads. Room correction
+	// passes through until impulse responses are loaded, see getRoomCorrectionProcessor().
+	void prepareToPlay(double sampleRate, int samplesPerBlock, int numChannels);
+
+	// Not real-time: stops the analysis threads and the impulse response loader.
+	void releaseResources();
+
+	// Not real-time, any thread but the audio thread, after prepareToPlay. Both crossovers, so
+	// switching between them needs no redesign. frequencies has MULTIBAND_CROSSOVER_MAX_CROSSOVERS
+	// values, the ones past numBands are kept for when there are more bands.
+	void setCrossovers(int numBands, const float* frequencies);
+
+	// Audio thread.
+	void process(AudioSampleBuffer& buffer, const Settings& settings);
+
+	// The latency process() adds with these settings.
+	int getLatencySamples(bool linearPhase, bool roomCorrection) const;
+
+	LufsProcessor& getLufsProcessor() { return lufsProcessor; }
+	BallisticMeterProcessor& getBallisticMeterProcessor() { return ballisticMeterProcessor; }
+	MeterAnalysisThread& getMeterAnalysisThread() { return meterAnalysisThread; }
+	SpectrumAnalyserThread& getSpectrumAnalyser() { return spectrumAnalyser; }
+	const SpectrumAnalyserThread& getSpectrumAnalyser() const { return spectrumAnalyser; }
+	RoomCorrectionProcessor& getRoomCorrectionProcessor() { return roomCorrectionProcessor; }
+	StageTiming& getStageTiming() { return stageTiming; }
+
+private:
+	const MonitorRouting& monitorRouting;
+	StageTiming stageTiming;
+
+	MultibandCrossover multibandCrossover;
+	bool multibandWasActive;
+	LinearPhaseCrossover linearPhaseCrossover;
+	bool linearPhaseWasActive;
+
+	LufsProcessor lufsProcessor;
+	BallisticMeterProcessor ballisticMeterProcessor;
+	MeterAnalysisThread meterAnalysisThread;
+	SpectrumAnalyserThread spectrumAnalyser;
+
+	LoudnessEqProcessor loudnessEqProcessor;
+	RoomCorrectionProcessor roomCorrectionProcessor;
+	bool roomCorrectionWasActive;
+	SpeakerSetProcessor speakerSetProcessor;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MonitorChain)
+};
@@ -0,0 +1,114 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "MonitorRouting.h"
+
+bool SpeakerSetRouting::operator== (const SpeakerSetRouting& other) const
+{
+	for (int i = 0; i < MONITOR_ROUTING_MAX_OUTPUTS; i++)
+		if (totalMixOutputs[i] != other.totalMixOutputs[i])
+			return false;
+
+	return switcherRelay == other.switcherRelay && trimDb == other.trimDb && delayMs == other.delayMs;
+}
+
+bool MonitorRouting::Table::operator== (const Table& other) const
+{
+	for (int i = 0; i < MONITOR_ROUTING_NUM_SPEAKER_SETS; i++)
+		if (speakerSets[i] != other.speakerSets[i])
+			return false;
+
+	return true;
+}
+
+MonitorRouting::MonitorRouting()
+	: table(getDefaultTable()), requestedAudioTable(0), activeAudioTable(0), audioTablePending(false)
+{
+	audioTables[0] = audioTables[1] = table;
+}
+
+MonitorRouting::Table MonitorRouting::getDefaultTable()
+{
+	// Defaults match the original studio setup: TotalMix output faders AES, ADAT13/14, ADAT15/16
+	// for MAIN, ALT1, ALT2 monitors, and switcher relays 1-4.
+	const int defaultOutputs[MONITOR_ROUTING_NUM_SPEAKER_SETS] = { 17, 7, 8, 0 };
+
+	Table defaultTable;
+	for (int i = 0; i < MONITOR_ROUTING_NUM_SPEAKER_SETS; i++)
+	{
+		SpeakerSetRouting& speakerSet = defaultTable.speakerSets[i];
+
+		speakerSet.totalMixOutputs[0] = defaultOutputs[i];
+		for (int out = 1; out < MONITOR_ROUTING_MAX_OUTPUTS; out++)
+			speakerSet.totalMixOutputs[out] = 0;
+
+		speakerSet.switcherRelay = i + 1;
+		speakerSet.trimDb = 0.0f;
+		speakerSet.delayMs = 0.0f;
+	}
+
+	return defaultTable;
+}
+
+MonitorRouting::Table MonitorRouting::getTable() const
+{
+	const SpinLock::ScopedLockType sl(lock);
+	return table;
+}
+
+SpeakerSetRouting MonitorRouting::getSpeakerSet(int speakerSet) const
+{
+	jassert(speakerSet >= 0 && speakerSet < MONITOR_ROUTING_NUM_SPEAKER_SETS);
+
+	const SpinLock::ScopedLockType sl(lock);
+	return table.speakerSets[speakerSet];
+}
+
+SpeakerSetRouting MonitorRouting::getSpeakerSetForAudioThread(int speakerSet) const
+{
+	jassert(speakerSet >= 0 && speakerSet < MONITOR_ROUTING_NUM_SPEAKER_SETS);
+
+	// Pick up a new table, if there is one. setTable() won't touch this one until the next is picked up.
+	const int current = requestedAudioTable.load(std::memory_order_acquire);
+	activeAudioTable.store(current, std::memory_order_release);
+	return audioTables[current].speakerSets[speakerSet];
+}
+
+bool MonitorRouting::setTable(const Table& newTable)
+{
+	bool changed = false;
+	{
+		const SpinLock::ScopedLockType sl(lock);
+
+		if (newTable != table)
+		{
+			table = newTable;
+			changed = true;
+		}
+	}
+
+	audioTablePending = audioTablePending || changed;
+
+	// The audio thread is still on the last copy until its next block: this one waits for the next call.
+	const int active = activeAudioTable.load(std::memory_order_acquire);
+	if (audioTablePending && requestedAudioTable.load(std::memory_order_relaxed) == active)
+	{
+		audioTables[1 - active] = newTable;
+		requestedAudioTable.store(1 - active, std::memory_order_release);
+		audioTablePending = false;
+	}
+
+	return changed;
+}
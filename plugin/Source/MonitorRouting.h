@@ -0,0 +1,87 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+
+#include <JuceHeader.h>
+
+#define MONITOR_ROUTING_NUM_SPEAKER_SETS 4			// MAIN, ALT1, ALT2, ALT3
+#define MONITOR_ROUTING_MAX_OUTPUTS 2				// TotalMix hardware outputs per speaker set.
+#define MONITOR_ROUTING_MAX_TOTALMIX_OUTPUT 64
+#define MONITOR_ROUTING_MAX_RELAY 4					// Our switcher unit has 4 relay groups.
+#define MONITOR_ROUTING_MAX_DELAY_MS 50.0f
+
+//==============================================================================
+/**
+	Routing for one set of monitor speakers.
+*/
+struct SpeakerSetRouting
+{
+	int totalMixOutputs[MONITOR_ROUTING_MAX_OUTPUTS];	// Index of hardware output fader in TotalMix, 0 if unused.
+	int switcherRelay;									// Relay (note number) on our switcher unit, 0 if none.
+	float trimDb;										// Calibration gain trim.
+	float delayMs;										// Time alignment delay.
+
+	bool operator== (const SpeakerSetRouting& other) const;
+	bool operator!= (const SpeakerSetRouting& other) const { return !(*this == other); }
+};
+
+//==============================================================================
+/**
+	Monitor routing table: maps each speaker set to its TotalMix outputs, switcher
+	relay, trim and delay.
+
+	The whole table is replaced in one go under a lock, so readers on other threads
+	always see a consistent set of values. The audio thread doesn't take the lock: it
+	reads its own copy, one of two, and setTable() publishes changes into the one it
+	isn't reading, once it has picked up the last.
+*/
+class MonitorRouting
+{
+public:
+	struct Table
+	{
+		SpeakerSetRouting speakerSets[MONITOR_ROUTING_NUM_SPEAKER_SETS];
+
+		bool operator== (const Table& other) const;
+		bool operator!= (const Table& other) const { return !(*this == other); }
+	};
+
+	MonitorRouting();
+
+	static Table getDefaultTable();
+
+	Table getTable() const;
+	SpeakerSetRouting getSpeakerSet(int speakerSet) const;
+
+	// Audio thread only. Lock-free.
+	SpeakerSetRouting getSpeakerSetForAudioThread(int speakerSet) const;
+
+	// One writer thread. Returns true if the table changed.
+	bool setTable(const Table& newTable);
+
+private:
+	Table table;
+	SpinLock lock;
+
+	Table audioTables[2];
+	std::atomic<int> requestedAudioTable;
+	mutable std::atomic<int> activeAudioTable;
+	bool audioTablePending;						// A change the audio thread hasn't been given yet.
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MonitorRouting)
+};
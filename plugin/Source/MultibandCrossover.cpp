@@ -0,0 +1,233 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "MultibandCrossover.h"
+#include "DspUtils.h"
+
+#define MULTIBAND_CROSSOVER_DEFAULT_FREQUENCY 1000.0f
+
+// One biquad on every lane. Each line is the same operation across the lanes, for the compiler to vectorise.
+static inline void processBiquad(const double* c, double (*s)[MULTIBAND_CROSSOVER_LANES], double* x)
+{
+	// s is [x1, x2, y1, y2][lane], c is b0, b1, b2, a1, a2.
+	double y[MULTIBAND_CROSSOVER_LANES];
+
+	for (int lane = 0; lane < MULTIBAND_CROSSOVER_LANES; lane++)
+		y[lane] = c[0] * x[lane] + c[1] * s[0][lane] + c[2] * s[1][lane] - c[3] * s[2][lane] - c[4] * s[3][lane];
+
+	// Filter tails decay into denormals on silence. Flushed on every sample, not once a block,
+	// so the output doesn't depend on the host's block size.
+	for (int lane = 0; lane < MULTIBAND_CROSSOVER_LANES; lane++)
+		snapToZero(y[lane]);
+
+	for (int lane = 0; lane < MULTIBAND_CROSSOVER_LANES; lane++)
+	{
+		s[1][lane] = s[0][lane];
+		s[0][lane] = x[lane];
+		s[3][lane] = s[2][lane];
+		s[2][lane] = y[lane];
+		x[lane] = y[lane];
+	}
+}
+
+MultibandCrossover::MultibandCrossover()
+	: requestedNumBands(MULTIBAND_CROSSOVER_MIN_BANDS), numBands(MULTIBAND_CROSSOVER_MIN_BANDS), lastSoloMask(0), sampleRate(44100.0)
+{
+	for (int crossover = 0; crossover < MULTIBAND_CROSSOVER_MAX_CROSSOVERS; crossover++)
+	{
+		frequencies[crossover] = MULTIBAND_CROSSOVER_DEFAULT_FREQUENCY;
+		designedFrequencies[crossover] = MULTIBAND_CROSSOVER_DEFAULT_FREQUENCY;
+		updateCoefficients(crossover);
+	}
+
+	reset();
+}
+
+void MultibandCrossover::prepareToPlay(double newSampleRate, int numChannels)
+{
+	sampleRate = newSampleRate;
+	laneGroups.resize((numChannels + MULTIBAND_CROSSOVER_LANES - 1) / MULTIBAND_CROSSOVER_LANES);
+
+	for (int crossover = 0; crossover < MULTIBAND_CROSSOVER_MAX_CROSSOVERS; crossover++)
+	{
+		designedFrequencies[crossover] = frequencies[crossover].load(std::memory_order_relaxed);
+		updateCoefficients(crossover);
+	}
+
+	numBands = requestedNumBands.load(std::memory_order_relaxed);
+	reset();
+}
+
+void MultibandCrossover::reset()
+{
+	for (LaneGroup& group : laneGroups)
+	{
+		double* state = &group.states[0][0][0][0][0];
+		std::fill(state, state + sizeof(group.states) / sizeof(double), 0.0);
+	}
+
+	lastSoloMask = 0;
+}
+
+// A band's filters are its own: the highpass pair of the crossover below it and the lowpass pair of the one above.
+void MultibandCrossover::clearBand(int band)
+{
+	const size_t filterSize = sizeof(laneGroups[0].states[0][0]) / sizeof(double);
+
+	for (LaneGroup& group : laneGroups)
+	{
+		if (band > 0)
+		{
+			double* state = &group.states[band - 1][highpass][0][0][0];
+			std::fill(state, state + filterSize, 0.0);
+		}
+
+		if (band < numBands - 1)
+		{
+			double* state = &group.states[band][lowpass][0][0][0];
+			std::fill(state, state + filterSize, 0.0);
+		}
+	}
+}
+
+void MultibandCrossover::setNumBands(int newNumBands)
+{
+	requestedNumBands = jlimit(MULTIBAND_CROSSOVER_MIN_BANDS, MULTIBAND_CROSSOVER_MAX_BANDS, newNumBands);
+}
+
+void MultibandCrossover::setCrossoverFrequency(int crossover, float frequency)
+{
+	if (crossover < MULTIBAND_CROSSOVER_MAX_CROSSOVERS)
+		frequencies[crossover] = frequency;
+}
+
+void MultibandCrossover::updateCoefficients(int crossover)
+{
+	// Bilinear transform 2nd order Butterworth, prewarped to the crossover frequency f. With
+	// K = 1 / tan(pi f / fs) and n0 = 1 / (1 + sqrt(2) K + K^2):
+	//   lowpass b = n0 (1, 2, 1), highpass b = n0 K^2 (1, -2, 1),
+	//   both a1 = 2 n0 (1 - K^2), a2 = n0 (1 - sqrt(2) K + K^2).
+	const double q = std::sqrt(2.0);
+	const double frequency = jlimit(10.0, 0.49 * sampleRate, (double)designedFrequencies[crossover]);
+	const double wd1 = 1.0 / std::tan(double_Pi * frequency / sampleRate);
+	const double n0 = 1.0 / (1.0 + q * wd1 + wd1 * wd1);
+
+	double* lp = coefficients[crossover][lowpass];
+	double* hp = coefficients[crossover][highpass];
+
+	lp[b0] = n0;
+	lp[b1] = 2.0 * n0;
+	lp[b2] = n0;
+	lp[a1] = -2.0 * (wd1 * wd1 - 1.0) * n0;
+	lp[a2] = (1.0 - q * wd1 + wd1 * wd1) * n0;
+
+	hp[b0] = n0 * wd1 * wd1;
+	hp[b1] = -2.0 * n0 * wd1 * wd1;
+	hp[b2] = n0 * wd1 * wd1;
+	hp[a1] = lp[a1];
+	hp[a2] = lp[a2];
+}
+
+void MultibandCrossover::process(AudioSampleBuffer& buffer, int soloMask)
+{
+	// New settings. A different number of bands is a different set of filters, so they start from silence.
+	const int newNumBands = requestedNumBands.load(std::memory_order_relaxed);
+	if (newNumBands != numBands)
+	{
+		numBands = newNumBands;
+		reset();
+	}
+
+	for (int crossover = 0; crossover < numBands - 1; crossover++)
+	{
+		const float frequency = frequencies[crossover].load(std::memory_order_relaxed);
+		if (frequency != designedFrequencies[crossover])
+		{
+			designedFrequencies[crossover] = frequency;
+			updateCoefficients(crossover);
+		}
+	}
+
+	// Only soloed bands are filtered, so a band soloed again starts from silence, as for a new number of bands,
+	// not from where its filters were left when it was last soloed.
+	int soloedBands[MULTIBAND_CROSSOVER_MAX_BANDS];
+	int numSoloedBands = 0;
+	for (int band = 0; band < numBands; band++)
+	{
+		if (soloMask & (1 << band))
+		{
+			if (!(lastSoloMask & (1 << band)))
+				clearBand(band);
+
+			soloedBands[numSoloedBands++] = band;
+		}
+	}
+
+	lastSoloMask = soloMask;
+
+	const int numSamples = buffer.getNumSamples();
+	const int numChannels = jmin(buffer.getNumChannels(), (int)laneGroups.size() * MULTIBAND_CROSSOVER_LANES);
+
+	for (int firstChannel = 0; firstChannel < numChannels; firstChannel += MULTIBAND_CROSSOVER_LANES)
+	{
+		const int numGroupChannels = jmin(numChannels - firstChannel, MULTIBAND_CROSSOVER_LANES);
+		float* data[MULTIBAND_CROSSOVER_LANES] = {};
+		for (int chan = 0; chan < numGroupChannels; chan++)
+			data[chan] = buffer.getWritePointer(firstChannel + chan);
+
+		processLaneGroup(laneGroups[firstChannel / MULTIBAND_CROSSOVER_LANES], data, numGroupChannels, numSamples, soloedBands, numSoloedBands);
+	}
+}
+
+void MultibandCrossover::processLaneGroup(LaneGroup& group, float** data, int numGroupChannels, int numSamples, const int* soloedBands, int numSoloedBands)
+{
+	auto& states = group.states;
+
+	// A band is the highpass pair of the crossover below it and the lowpass pair of the one above.
+	for (int sample = 0; sample < numSamples; sample++)
+	{
+		double input[MULTIBAND_CROSSOVER_LANES] = {};
+		double output[MULTIBAND_CROSSOVER_LANES] = {};
+
+		for (int chan = 0; chan < numGroupChannels; chan++)
+			input[chan] = data[chan][sample];
+
+		for (int i = 0; i < numSoloedBands; i++)
+		{
+			const int band = soloedBands[i];
+			double x[MULTIBAND_CROSSOVER_LANES];
+			for (int lane = 0; lane < MULTIBAND_CROSSOVER_LANES; lane++)
+				x[lane] = input[lane];
+
+			if (band > 0)
+			{
+				processBiquad(coefficients[band - 1][highpass], states[band - 1][highpass][0], x);
+				processBiquad(coefficients[band - 1][highpass], states[band - 1][highpass][1], x);
+			}
+
+			if (band < numBands - 1)
+			{
+				processBiquad(coefficients[band][lowpass], states[band][lowpass][0], x);
+				processBiquad(coefficients[band][lowpass], states[band][lowpass][1], x);
+			}
+
+			for (int lane = 0; lane < MULTIBAND_CROSSOVER_LANES; lane++)
+				output[lane] += x[lane];
+		}
+
+		for (int chan = 0; chan < numGroupChannels; chan++)
+			data[chan][sample] = (float)output[chan];
+	}
+}
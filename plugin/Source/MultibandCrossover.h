@@ -0,0 +1,97 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include <JuceHeader.h>
+
+#define MULTIBAND_CROSSOVER_MIN_BANDS 2
+#define MULTIBAND_CROSSOVER_MAX_BANDS 8
+#define MULTIBAND_CROSSOVER_MAX_CROSSOVERS (MULTIBAND_CROSSOVER_MAX_BANDS - 1)
+#define MULTIBAND_CROSSOVER_LANES 2						// Channels processed side by side: two doubles fill an SSE2/NEON register.
+
+//==============================================================================
+/**
+	IIR band solo crossover with 2 to 8 bands, Linkwitz-Riley 4th order: each
+	crossover is a pair of 2nd order Butterworth lowpasses for the band below it,
+	and a pair of highpasses for the band above, by the bilinear transform with the
+	cutoff prewarped (the formulas are in updateCoefficients()).
+
+	The channels are processed in groups of MULTIBAND_CROSSOVER_LANES. Each group's
+	filter states are in one fixed size array, with the channels innermost, so each
+	biquad runs on the whole group at once as a short vector. The groups are allocated
+	in prepareToPlay() for the number of channels; channels beyond that are left alone.
+	Only soloed bands are filtered, each from the input, and summed.
+
+	Frequencies and the number of bands can be set from any thread; the audio thread
+	recalculates the coefficients at its next block.
+*/
+class MultibandCrossover
+{
+public:
+	MultibandCrossover();
+
+	// Not real-time.
+	void prepareToPlay(double sampleRate, int numChannels);
+
+	// Audio thread.
+	void reset();
+
+	// Any thread.
+	void setNumBands(int numBands);
+	void setCrossoverFrequency(int crossover, float frequency);
+
+	// Audio thread. Bit n of soloMask is band n; the soloed bands are summed, silence if none.
+	void process(AudioSampleBuffer& buffer, int soloMask);
+
+private:
+	enum Filter
+	{
+		lowpass,
+		highpass,
+		numFilters
+	};
+
+	// Direct form I: y = b0 x + b1 x1 + b2 x2 - a1 y1 - a2 y2.
+	enum Coefficient { b0, b1, b2, a1, a2, numCoefficients };
+	enum State { x1, x2, y1, y2, numStates };
+
+	void updateCoefficients(int crossover);
+
+	// One group of channels: [crossover][filter][cascade][state][lane].
+	struct LaneGroup
+	{
+		alignas(16) double states[MULTIBAND_CROSSOVER_MAX_CROSSOVERS][numFilters][2][numStates][MULTIBAND_CROSSOVER_LANES];
+	};
+
+	void processLaneGroup(LaneGroup& group, float** data, int numGroupChannels, int numSamples, const int* soloedBands, int numSoloedBands);
+	void clearBand(int band);
+
+	// [crossover][filter][coefficient].
+	double coefficients[MULTIBAND_CROSSOVER_MAX_CROSSOVERS][numFilters][numCoefficients];
+	std::vector<LaneGroup> laneGroups;
+
+	float designedFrequencies[MULTIBAND_CROSSOVER_MAX_CROSSOVERS];
+	std::atomic<float> frequencies[MULTIBAND_CROSSOVER_MAX_CROSSOVERS];
+	std::atomic<int> requestedNumBands;
+	int numBands;
+	int lastSoloMask;							// Bands filtered in the last block. The others' states are stale.
+	double sampleRate;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MultibandCrossover)
+};
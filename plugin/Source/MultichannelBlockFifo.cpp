@@ -0,0 +1,60 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "MultichannelBlockFifo.h"
+
+MultichannelBlockFifo::MultichannelBlockFifo()
+	: fifo(1), droppedFrames(0)
+{
+}
+
+void MultichannelBlockFifo::prepare(int numChannels, int numFrames)
+{
+	// One more than needed, as an AbstractFifo holds one less than its size.
+	buffer.setSize(numChannels, numFrames + 1);
+	fifo.setTotalSize(numFrames + 1);
+	droppedFrames = 0;
+}
+
+bool MultichannelBlockFifo::push(const AudioSampleBuffer& block)
+{
+	const int numSamples = block.getNumSamples();
+
+	if (fifo.getFreeSpace() < numSamples)
+	{
+		droppedFrames.fetch_add(numSamples, std::memory_order_relaxed);
+		return false;
+	}
+
+	int start1, size1, start2, size2;
+	fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+	for (int chan = 0; chan < buffer.getNumChannels(); chan++)
+	{
+		if (chan >= block.getNumChannels())
+		{
+			buffer.clear(chan, start1, size1);
+			buffer.clear(chan, start2, size2);
+			continue;
+		}
+
+		buffer.copyFrom(chan, start1, block, chan, 0, size1);
+		if (size2 > 0)
+			buffer.copyFrom(chan, start2, block, chan, size1, size2);
+	}
+
+	fifo.finishedWrite(size1 + size2);
+	return true;
+}
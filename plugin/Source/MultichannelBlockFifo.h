@@ -0,0 +1,84 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+	Single producer, single consumer FIFO of multichannel audio, for handing the audio
+	thread's blocks to a worker thread.
+
+	push() is wait-free: it copies the block into the FIFO's own buffer and never locks
+	or allocates. Blocks go in whole or not at all, so the worker never sees a block with
+	a gap in it; a block that doesn't fit is dropped and counted. Channels missing from
+	the block are pushed as silence.
+
+	The worker reads whatever is there with read(), in place, as at most two blocks
+	when the FIFO wraps round.
+*/
+class MultichannelBlockFifo
+{
+public:
+	MultichannelBlockFifo();
+
+	// Not real-time, and not while either thread is using the FIFO. Clears it.
+	void prepare(int numChannels, int numFrames);
+
+	// Producer only. False if the block was dropped.
+	bool push(const AudioSampleBuffer& block);
+
+	// Consumer only. Calls consume(AudioSampleBuffer&) on each part of what is ready, oldest
+	// first, then frees it. Returns the number of frames read.
+	template <typename Consumer>
+	int read(Consumer&& consume)
+	{
+		int start1, size1, start2, size2;
+		fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+
+		if (size1 > 0)
+		{
+			AudioSampleBuffer block1(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start1, size1);
+			consume(block1);
+		}
+
+		if (size2 > 0)
+		{
+			AudioSampleBuffer block2(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start2, size2);
+			consume(block2);
+		}
+
+		fifo.finishedRead(size1 + size2);
+		return size1 + size2;
+	}
+
+	// Any thread.
+	int getNumChannels() const { return buffer.getNumChannels(); }
+	int getNumReady() const { return fifo.getNumReady(); }
+	int getFreeSpace() const { return fifo.getFreeSpace(); }
+
+	// Sample frames dropped because the FIFO was full, since prepare.
+	int64 getNumDroppedFrames() const { return droppedFrames.load(std::memory_order_relaxed); }
+
+private:
+	AbstractFifo fifo;
+	AudioSampleBuffer buffer;
+	std::atomic<int64> droppedFrames;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MultichannelBlockFifo)
+};
@@ -0,0 +1,245 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "PartitionedConvolution.h"
+
+PartitionedConvolution::PartitionedConvolution()
+	: partitionSize(0), numSubTransforms(1), subTransformSize(0), numStages(0)
+{
+}
+
+void PartitionedConvolution::prepare(int newPartitionSize, int maxPassSize)
+{
+	partitionSize = newPartitionSize;
+
+	int fftOrder = 0;
+	while ((1 << fftOrder) < 2 * partitionSize)
+		fftOrder++;
+
+	designFft = std::make_unique<dsp::FFT>(fftOrder);
+
+	numSubTransforms = 1;
+	numStages = 0;
+	while (maxPassSize > 0 && partitionSize / numSubTransforms > maxPassSize)
+	{
+		numSubTransforms *= 2;
+		numStages++;
+	}
+
+	if (numSubTransforms == 1)
+	{
+		fft = std::make_unique<dsp::FFT>(fftOrder);
+		subFft = nullptr;
+		subTransformSize = 0;
+		twiddles.clear();
+		realTwiddles.clear();
+		return;
+	}
+
+	fft = nullptr;
+	subTransformSize = partitionSize / numSubTransforms;
+	subFft = std::make_unique<dsp::FFT>(fftOrder - 1 - numStages);
+
+	twiddles.resize(partitionSize / 2);
+	for (int k = 0; k < partitionSize / 2; k++)
+		twiddles[k] = Bin(std::polar(1.0, -2.0 * double_Pi * k / partitionSize));
+
+	realTwiddles.resize(partitionSize + 1);
+	for (int k = 0; k <= partitionSize; k++)
+		realTwiddles[k] = Bin(std::polar(1.0, -double_Pi * k / partitionSize));
+}
+
+void PartitionedConvolution::transformPartition(const float* taps, int numTaps, Bin* spectrum) const
+{
+	// Zero padded to the FFT length, so the overlap-save output is a linear convolution.
+	std::vector<float> data(getWorkSize(), 0.0f);
+	std::copy(taps, taps + jmin(numTaps, partitionSize), data.begin());
+	designFft->performRealOnlyForwardTransform(data.data());
+
+	for (int bin = 0; bin < getNumBins(); bin++)
+		spectrum[bin] = Bin(data[2 * bin], data[2 * bin + 1]);
+}
+
+void PartitionedConvolution::forwardTransform(float* work, Bin* spectrum) const
+{
+	for (int pass = 0; pass < getNumPasses(); pass++)
+		forwardPass(work, spectrum, pass);
+}
+
+// Split, the work buffer holds two transforms' worth of complex points and a sub-transform's. The
+// sub-transforms go into the second, and the butterflies go back and forth between the two.
+void PartitionedConvolution::forwardPass(float* work, Bin* spectrum, int pass) const
+{
+	if (numSubTransforms == 1)
+	{
+		FloatVectorOperations::clear(work + 2 * partitionSize, 2 * partitionSize);
+		fft->performRealOnlyForwardTransform(work);
+
+		for (int bin = 0; bin < getNumBins(); bin++)
+			spectrum[bin] = Bin(work[2 * bin], work[2 * bin + 1]);
+		return;
+	}
+
+	Bin* buffers[2] = { reinterpret_cast<Bin*>(work), reinterpret_cast<Bin*>(work + 2 * partitionSize) };
+	Bin* scratch = reinterpret_cast<Bin*>(work + 4 * partitionSize);
+
+	if (pass < numSubTransforms)
+	{
+		// Every numSubTransforms'th complex point, from this one.
+		for (int i = 0; i < subTransformSize; i++)
+		{
+			const int n = pass + i * numSubTransforms;
+			scratch[i] = Bin(work[2 * n], work[2 * n + 1]);
+		}
+
+		subFft->perform(scratch, buffers[1] + pass * subTransformSize, false);
+		return;
+	}
+
+	pass -= numSubTransforms;
+	if (pass < numStages)
+	{
+		// Decimation in time: each pair of transforms, of the even and odd points, into one twice as long.
+		const Bin* from = buffers[(pass + 1) % 2];
+		Bin* to = buffers[pass % 2];
+		const int size = subTransformSize << pass;
+		const int numOutputs = numSubTransforms >> (pass + 1);
+		const int twiddleStep = partitionSize / (2 * size);
+
+		for (int output = 0; output < numOutputs; output++)
+		{
+			const Bin* even = from + output * size;
+			const Bin* odd = from + (output + numOutputs) * size;
+			Bin* result = to + output * 2 * size;
+
+			for (int k = 0; k < size; k++)
+			{
+				const Bin t = twiddles[k * twiddleStep] * odd[k];
+				result[k] = even[k] + t;
+				result[k + size] = even[k] - t;
+			}
+		}
+		return;
+	}
+
+	// The spectra of the even and odd samples are the conjugate symmetric and antisymmetric parts.
+	const Bin* z = buffers[(numStages + 1) % 2];
+	for (int bin = 0; bin < getNumBins(); bin++)
+	{
+		const Bin a = z[bin % partitionSize];
+		const Bin b = std::conj(z[(partitionSize - bin) % partitionSize]);
+		const Bin even = 0.5f * (a + b);
+		const Bin odd = Bin(0.0f, -0.5f) * (a - b);
+		spectrum[bin] = even + realTwiddles[bin] * odd;
+	}
+}
+
+// Written out, as std::complex multiplication checks for infinities.
+void PartitionedConvolution::multiplyAdd(Bin* accumulator, const Bin* a, const Bin* b, int numBins)
+{
+	float* acc = reinterpret_cast<float*>(accumulator);
+	const float* x = reinterpret_cast<const float*>(a);
+	const float* y = reinterpret_cast<const float*>(b);
+
+	for (int bin = 0; bin < 2 * numBins; bin += 2)
+	{
+		acc[bin] += x[bin] * y[bin] - x[bin + 1] * y[bin + 1];
+		acc[bin + 1] += x[bin] * y[bin + 1] + x[bin + 1] * y[bin];
+	}
+}
+
+void PartitionedConvolution::inverseTransform(const Bin* accumulator, float* work, float* output) const
+{
+	for (int pass = 0; pass < getNumPasses(); pass++)
+		inversePass(accumulator, work, output, pass);
+}
+
+// Split, forwardPass() backwards: the even and odd samples' spectra from the real one, butterflies
+// back down to the sub-transforms, and each sub-transform's points back to their samples.
+void PartitionedConvolution::inversePass(const Bin* accumulator, float* work, float* output, int pass) const
+{
+	if (numSubTransforms == 1)
+	{
+		// Only the non-negative frequencies are needed for a real inverse transform.
+		for (int bin = 0; bin < getNumBins(); bin++)
+		{
+			work[2 * bin] = accumulator[bin].real();
+			work[2 * bin + 1] = accumulator[bin].imag();
+		}
+
+		fft->performRealOnlyInverseTransform(work);
+
+		// The second half is the linear convolution, the first has wrapped round.
+		FloatVectorOperations::copy(output, work + partitionSize, partitionSize);
+		return;
+	}
+
+	Bin* buffers[2] = { reinterpret_cast<Bin*>(work), reinterpret_cast<Bin*>(work + 2 * partitionSize) };
+	Bin* scratch = reinterpret_cast<Bin*>(work + 4 * partitionSize);
+
+	if (pass == 0)
+	{
+		Bin* z = buffers[0];
+		for (int k = 0; k < partitionSize; k++)
+		{
+			const Bin a = accumulator[k];
+			const Bin b = std::conj(accumulator[partitionSize - k]);
+			const Bin even = 0.5f * (a + b);
+			const Bin odd = 0.5f * (a - b) * std::conj(realTwiddles[k]);
+			z[k] = even + Bin(0.0f, 1.0f) * odd;
+		}
+		return;
+	}
+
+	pass--;
+	if (pass < numStages)
+	{
+		// Each transform back into the two half as long, of its even and odd points. Halved each time, as
+		// the sub-transforms only scale by their own length.
+		const Bin* from = buffers[pass % 2];
+		Bin* to = buffers[(pass + 1) % 2];
+		const int size = partitionSize >> (pass + 1);
+		const int numInputs = 1 << pass;
+		const int twiddleStep = partitionSize / (2 * size);
+
+		for (int input = 0; input < numInputs; input++)
+		{
+			const Bin* transform = from + input * 2 * size;
+			Bin* even = to + input * size;
+			Bin* odd = to + (input + numInputs) * size;
+
+			for (int k = 0; k < size; k++)
+			{
+				even[k] = 0.5f * (transform[k] + transform[k + size]);
+				odd[k] = 0.5f * (transform[k] - transform[k + size]) * std::conj(twiddles[k * twiddleStep]);
+			}
+		}
+		return;
+	}
+
+	// Only the second half of the samples is output: the first has wrapped round.
+	pass -= numStages;
+	subFft->perform(buffers[numStages % 2] + pass * subTransformSize, scratch, true);
+
+	for (int i = 0; i < subTransformSize; i++)
+	{
+		const int n = pass + i * numSubTransforms;
+		if (2 * n >= partitionSize)
+		{
+			output[2 * n - partitionSize] = scratch[i].real();
+			output[2 * n + 1 - partitionSize] = scratch[i].imag();
+		}
+	}
+}
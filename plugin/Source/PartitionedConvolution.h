@@ -0,0 +1,99 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <complex>
+#include <memory>
+#include <vector>
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+	The transforms of uniformly partitioned convolution by overlap-save, for one
+	partition size. The caller keeps the frequency domain delay line and decides
+	when each step runs: LinearPhaseCrossover does a whole partition at once,
+	RoomCorrectionProcessor spreads it over the next partition's samples.
+
+	For each partition of input, forwardTransform() transforms it with the partition
+	before it, at twice its length. multiplyAdd() accumulates each partition of the
+	filter times the input spectrum that many partitions back, and inverseTransform()
+	gives the next partition of output. Filter partitions are transformed zero padded
+	by transformPartition(), so the output is a linear convolution.
+
+	Long transforms can be split into passes of about the same work each, for a
+	caller that spreads them over time: sub-transforms no longer than maxPassSize
+	complex points, combined by radix-2 butterflies (one pass per level) and split
+	into the real spectrum (one more pass).
+
+	The audio thread and the design have an FFT each, as an FFT may lock while it
+	transforms.
+*/
+class PartitionedConvolution
+{
+public:
+	typedef std::complex<float> Bin;
+
+	PartitionedConvolution();
+
+	// Not real-time. Transforms for partitions longer than maxPassSize are split into passes, see
+	// forwardPass(). 0 never splits them.
+	void prepare(int partitionSize, int maxPassSize = 0);
+
+	int getPartitionSize() const { return partitionSize; }
+	int getNumBins() const { return partitionSize + 1; }
+
+	// Floats in the work buffer forwardTransform() and inverseTransform() need.
+	int getWorkSize() const { return 4 * partitionSize + (numSubTransforms > 1 ? 2 * subTransformSize : 0); }
+
+	// Passes in each forward, and each inverse, transform: 1 unless split.
+	int getNumPasses() const { return numSubTransforms > 1 ? numSubTransforms + numStages + 1 : 1; }
+
+	// Not real-time, any thread but the audio thread. Transforms up to one partition of filter taps,
+	// zero padded, into getNumBins() bins.
+	void transformPartition(const float* taps, int numTaps, Bin* spectrum) const;
+
+	// Audio thread. work holds the last two partitions of input, oldest first, and is used up.
+	void forwardTransform(float* work, Bin* spectrum) const;
+
+	// Audio thread. forwardTransform() one pass at a time, from 0. The last pass writes the spectrum.
+	void forwardPass(float* work, Bin* spectrum, int pass) const;
+
+	// Audio thread. accumulator += a * b, for numBins bins.
+	static void multiplyAdd(Bin* accumulator, const Bin* a, const Bin* b, int numBins);
+
+	// Audio thread. One partition of output from the accumulated spectrum, transformed in work.
+	void inverseTransform(const Bin* accumulator, float* work, float* output) const;
+
+	// Audio thread. inverseTransform() one pass at a time, from 0. The first pass reads the accumulator,
+	// the last ones write the output.
+	void inversePass(const Bin* accumulator, float* work, float* output, int pass) const;
+
+private:
+	int partitionSize;
+	std::unique_ptr<dsp::FFT> fft;
+	std::unique_ptr<dsp::FFT> designFft;
+
+	// Split transforms: the 2 * partitionSize real points as partitionSize complex ones, even samples
+	// real and odd imaginary, transformed as numSubTransforms interleaved sub-transforms and numStages
+	// levels of butterflies.
+	int numSubTransforms;
+	int subTransformSize;
+	int numStages;
+	std::unique_ptr<dsp::FFT> subFft;
+	std::vector<Bin> twiddles;					// Butterflies: e^(-2 pi i k / partitionSize), k < partitionSize / 2.
+	std::vector<Bin> realTwiddles;				// Real spectrum: e^(-2 pi i k / (2 * partitionSize)), k <= partitionSize.
+};
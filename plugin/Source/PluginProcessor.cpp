@@ -21,11 +21,11 @@
 #include <string>
 #include <math.h>
 #include <map>
+#include <cctype>
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 #include "LufsProcessor.h"
-#include "CrossoverFilter.h"
 #include "RmeTotalMixFaderCurve.h"
 
 #define CALLBACK_TIMER_PERIOD_MS 10									// How often parameters, meters etc are updated.
@@ -45,6 +45,15 @@
 #define REAPER_OSC_SEND_PORT 8000
 #define REAPER_OSC_RECEIVE_PORT 9000
 
+#define STATE_XML_TAG "DREAMCONTROL"
+#define STATE_PARAM_XML_TAG "PARAM"
+#define STAGE_TIMING_REPORT_PERIOD_MS 1000							// Audio callback timing dump, in DREAMCONTROL_STAGE_TIMING builds.
+#define STAGE_TIMING_JSON_FILE_NAME "DreamControlStageTiming.json"	// In the temp directory.
+#define STAGE_TIMING_OSC_ADDRESS "/dreamcontrol/timing/"			// Followed by the stage name, sent to the REAPER OSC port.
+#define SPECTRUM_OSC_ADDRESS "/dreamcontrol/spectrum"				// The band levels, sent to the REAPER OSC port.
+
+#define STATE_VERSION 2												// 1 = fixed order binary stream, 2 = XML keyed by parameter ID.
+
 const int sysexManufacturerId[3] = { 0x00, 0x21, 0x69 };			// Our SysEx manufacturer ID.
 
 enum sysexCommand {
@@ -52,6 +61,21 @@ enum sysexCommand {
 	SYSEX_COMMAND_SYNC_BUTTONS = 2
 };
 
+#define METER_BAR_COUNT 3											// LED bars on the surface.
+#define CROSSOVER_DEFAULT_BANDS 4									// One per band solo button on the surface.
+
+// What each LED bar shows, sent in the meter data. Same order as the firmware's dc_meter_type_t.
+enum meterBarType {
+	METER_BAR_AUTO = 0,												// Follows the LUFS/peak mode buttons.
+	METER_BAR_TRUE_PEAK = 1,
+	METER_BAR_SAMPLE_PEAK = 2,
+	METER_BAR_RMS = 3,
+	METER_BAR_VU = 4,
+	METER_BAR_PPM = 5,
+	METER_BAR_CORRELATION = 6,
+	METER_BAR_BALANCE = 7
+};
+
 enum midiNoteCommand {
 	BUTTON_LOUD = 0,
 	BUTTON_MONO = 1,
@@ -104,12 +128,7 @@ enum midiNoteCommand {
 	BUTTON_1DB_PEAK_SCALE = 49
 };
 
-// RME TotalMix monitor output assignments, corresponds to index of hardware output in TotalMix. { MAIN, ALT1, ALT2, ALT3 }
-// ///////////////////////////////////////////////////////
-// TODO: This is currently hardcoded for Dave's studio setup! In future we want to be able to select this in the plugin UI.
-//       Output faders in TotalMix: AES, ADAT13/14, ADAT15/16 corresponding to MAIN, ALT1, ALT2 monitors.
-// ///////////////////////////////////////////////////////
-const std::vector<int> rmeTotalMixMidiChannelControllers = { 17, 7, 8, -1 };
+const char* speakerSetNames[MONITOR_ROUTING_NUM_SPEAKER_SETS] = { "Main", "Alt1", "Alt2", "Alt3" };
 
 //==============================================================================
 DreamControlAudioProcessor::DreamControlAudioProcessor()
@@ -124,9 +143,11 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 	)
 #endif
 	, MidiInputCallback()
+	, monitorChain(monitorRouting, getNumInputChannels())
 {
 	numChannels = getNumInputChannels();
 	msSinceLastPeakReset = 0;
+	msSinceLastTimingReport = 0;
 
 	// Init MIDI ports to our hardware, for sending meter values and receiving commands.
 	// We use independent ports instead of our DAW port for better SysEx support.
@@ -157,15 +178,8 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 	}
 
 	// Also try and connect to our DreamControlSwitcher unit if it's available.
-	int switcherOutputDeviceId = MidiOutput::getDevices().indexOf(MIDI_OUT_SWITCHER_PORT_NAME);
-	if (switcherOutputDeviceId > -1)
-	{
-		midiOutputToSwitcher = MidiOutput::openDevice(switcherOutputDeviceId);
-	}
-	else
-	{
-		midiOutputToSwitcher = NULL;
-	}
+	midiOutputToSwitcher = NULL;
+	openMonitorSwitcher();
 
 	// Lambda for handling when a mode toggle changes.
 	auto modeChangedFunction = [this](const String& paramName, bool newValue)
@@ -174,7 +188,7 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 		// TODO: Make this an option!
 		if (paramName != "dimMode" && paramName != "refMode" && paramName != "muteMode" && paramName != "volModMode")
 		{
-			lufsProcessor->reset();
+			monitorChain.getLufsProcessor().reset();
 		}
 
 		// Mid/side solo is exclusive.
@@ -256,6 +270,9 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 			if (volControlDeviceId > -1)
 			{
 				this->midiOutputToVolControl.reset(MidiOutput::openDevice(volControlDeviceId));
+
+				// TotalMix state is unknown after (re)connecting, so everything gets sent next time.
+				std::fill(rmeOutputSentCC.begin(), rmeOutputSentCC.end(), -1);
 			}
 			else
 			{
@@ -273,6 +290,20 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 	};
 
 	faderRpnDetector = new MidiRPNDetector();
+	rmeOutputSentCC.assign(MONITOR_ROUTING_MAX_TOTALMIX_OUTPUT + 1, -1);
+
+	// Fader moves go to REAPER as OSC, and REAPER's track volume comes back to the motor fader as NRPN.
+	faderBridge = std::make_unique<FaderBridge>(
+		[this](int value)
+		{
+			if (useReaperOsc->get())
+				reaperOscSender.send("/track/volume", (float)value / (float)FADER_BRIDGE_MAX_VALUE);
+		},
+		[this](int value)
+		{
+			if (midiOutput != nullptr)
+				midiOutput->sendBlockOfMessagesNow(MidiRPNGenerator::generate(1, 1, value, true, true));
+		});
 
 	// Initialise level controls
 	addParameter(monitorLevel = new AudioParameterFloat("monitorLevel", "Monitor Level", LOWEST_VOLUME_VALUE, 0.0f, LOWEST_VOLUME_VALUE));
@@ -280,19 +311,33 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 	addParameter(dimMode = new AudioParameterBoolNotify("dimMode", "Dim", 0, modeChangedFunction));
 	addParameter(refMode = new AudioParameterBoolNotify("refMode", "Ref", 0, modeChangedFunction));
 
-	// Initialise our crossover filters
-	numCrossovers = 3;
-	numBands = numCrossovers + 1;			
-	bandSolo.resize(numCrossovers + 1);
-	crossoverFreq.resize(numCrossovers);
+	// Initialise our crossover filters. Parameters for the bands beyond the default are added last, after the
+	// ones added since, so existing parameter indices don't move.
+	bandSolo.resize(MULTIBAND_CROSSOVER_MAX_BANDS);
+	crossoverFreq.resize(MULTIBAND_CROSSOVER_MAX_CROSSOVERS);
 
-	for (int i = 0; i < numCrossovers + 1; i++) {
+	auto addBandSoloParameter = [this, modeChangedFunction](int i)
+	{
 		addParameter(bandSolo[i] = new AudioParameterBoolNotify(
 			"solo" + std::to_string(i + 1),
 			"Band " + std::to_string(i + 1) + " Solo",
 			0, modeChangedFunction)
 		);
-	}
+	};
+
+	const float crossoverDefaults[MULTIBAND_CROSSOVER_MAX_CROSSOVERS] = { 100.0f, 400.0f, 4000.0f, 8000.0f, 12000.0f, 15000.0f, 18000.0f };
+	auto addCrossoverParameter = [this, &crossoverDefaults](int i, float maxFrequency)
+	{
+		addParameter(crossoverFreq[i] = new AudioParameterFloat(
+			"crossover" + std::to_string(i + 1),
+			"Band " + std::to_string(i + 1) + "/" + std::to_string(i + 2) + " Crossover Frequency",
+			NormalisableRange<float>(20.0f, maxFrequency, 0.0f, 1.0f),
+			crossoverDefaults[i])
+		);
+	};
+
+	for (int i = 0; i < CROSSOVER_DEFAULT_BANDS; i++)
+		addBandSoloParameter(i);
 
 	addParameter(midSolo = new AudioParameterBoolNotify("midSolo", "Mono / Mid Solo", 0, modeChangedFunction));
 	addParameter(sideSolo = new AudioParameterBoolNotify("sideSolo", "Side Solo", 0, modeChangedFunction));
@@ -307,7 +352,8 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 	clipMeterRight = new AudioParameterBool("clipMeterR", "Clip R", 0);
 
 	// Initialise our EBU R128 LUFS meter
-	lufsProcessor = new LufsProcessor(getNumInputChannels());
+	lastDroppedMeterFrames = 0;
+	lastSpectrumFrame = 0;
 
 	lufsMomentary = new AudioParameterFloat("lufsMomentary", "LUFS Momentary", NormalisableRange<float>(LOWEST_LUFS_VALUE, 0.0f, 0.1f), 0.0f);
 	lufsShort = new AudioParameterFloat("lufsShort", "LUFS Short", NormalisableRange<float>(LOWEST_LUFS_VALUE, 0.0f, 0.1f), 0.0f);
@@ -323,14 +369,8 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 	addParameter(relativeMode = new AudioParameterBoolNotify("relativeMode", "LUFS Relative Mode", false, modeChangedFunction));
 	addParameter(is1dbPeakScale = new AudioParameterBoolNotify("is1dbPeakScale", "1dB Peak Meter Scale", false, modeChangedFunction));
 
-	for (int i = 0; i < numCrossovers; i++) {
-		addParameter(crossoverFreq[i] = new AudioParameterFloat(
-			"crossover" + std::to_string(i + 1),
-			"Band " + std::to_string(i + 1) + "/" + std::to_string(i + 2) + " Crossover Frequency",
-			NormalisableRange<float>(20.0f, 10000.0f, 0.0f, 1.0f),
-			i == 0 ? 100 : i == 1 ? 400 : i == 2 ? 4000 : 1000)
-		);
-	}
+	for (int i = 0; i < CROSSOVER_DEFAULT_BANDS - 1; i++)
+		addCrossoverParameter(i, 10000.0f);
 
 	addParameter(dimLevel = new AudioParameterFloat("dimLevel", "Dim Level", LOWEST_TRUE_PEAK_VALUE, 0.0f, -25.0f));
 	addParameter(refLevel = new AudioParameterFloat("refLevel", "Ref Level", LOWEST_TRUE_PEAK_VALUE, 0.0f, -10.0f));
@@ -341,6 +381,64 @@ DreamControlAudioProcessor::DreamControlAudioProcessor()
 	addParameter(useRMEVolControl = new AudioParameterBoolNotify("useRMEVolControl", "RME TotalMix integration", false, rmeVolControlChangedFunction));
 	addParameter(useRMEMonitorSwitch = new AudioParameterBool("useRMEMonitorSwitch", "RME TotalMix monitor switch", false));
 	addParameter(useReaperOsc = new AudioParameterBoolNotify("useReaperOsc", "REAPER OSC integration", false, reaperOscChangedFunction));
+	addParameter(faderMaxRate = new AudioParameterFloat("faderMaxRate", "Fader Max Update Rate (Hz)", 25.0f, 500.0f, 200.0f));
+
+	// Initialise monitor routing, one set of parameters per speaker set.
+	auto defaultRouting = MonitorRouting::getDefaultTable();
+	routingTotalMixOutput.resize(MONITOR_ROUTING_NUM_SPEAKER_SETS);
+	routingSwitcherRelay.resize(MONITOR_ROUTING_NUM_SPEAKER_SETS);
+	routingTrim.resize(MONITOR_ROUTING_NUM_SPEAKER_SETS);
+	routingDelay.resize(MONITOR_ROUTING_NUM_SPEAKER_SETS);
+
+	for (int i = 0; i < MONITOR_ROUTING_NUM_SPEAKER_SETS; i++)
+	{
+		std::string id(speakerSetNames[i]);
+		std::string name(speakerSetNames[i]);
+		id[0] = tolower(id[0]);
+		const SpeakerSetRouting& defaults = defaultRouting.speakerSets[i];
+
+		routingTotalMixOutput[i].resize(MONITOR_ROUTING_MAX_OUTPUTS);
+		for (int out = 0; out < MONITOR_ROUTING_MAX_OUTPUTS; out++)
+		{
+			addParameter(routingTotalMixOutput[i][out] = new AudioParameterInt(
+				id + "TotalMixOut" + std::to_string(out + 1),
+				name + " TotalMix Output " + std::to_string(out + 1) + " (0 = none)",
+				0, MONITOR_ROUTING_MAX_TOTALMIX_OUTPUT, defaults.totalMixOutputs[out])
+			);
+		}
+
+		addParameter(routingSwitcherRelay[i] = new AudioParameterInt(id + "SwitcherRelay", name + " Switcher Relay (0 = none)", 0, MONITOR_ROUTING_MAX_RELAY, defaults.switcherRelay));
+		addParameter(routingTrim[i] = new AudioParameterFloat(id + "Trim", name + " Trim (dB)", -24.0f, 12.0f, defaults.trimDb));
+		addParameter(routingDelay[i] = new AudioParameterFloat(id + "Delay", name + " Delay (ms)", 0.0f, MONITOR_ROUTING_MAX_DELAY_MS, defaults.delayMs));
+	}
+
+	addParameter(meterOnAnalysisThread = new AudioParameterBool("meterOnAnalysisThread", "Meters on analysis thread", false));
+
+	// Meter type per LED bar, overriding the mode buttons.
+	const StringArray meterBarTypeNames = { "Auto", "True Peak", "Sample Peak", "RMS", "VU", "PPM", "Correlation", "Balance" };
+	meterBarType.resize(METER_BAR_COUNT);
+	for (int i = 0; i < METER_BAR_COUNT; i++) {
+		addParameter(meterBarType[i] = new AudioParameterChoice(
+			"meterBar" + std::to_string(i + 1) + "Type",
+			"LED Meter " + std::to_string(i + 1) + " Type",
+			meterBarTypeNames, METER_BAR_AUTO)
+		);
+	}
+
+	addParameter(correlationTime = new AudioParameterFloat("correlationTime", "Correlation Time (ms)", 10.0f, 3000.0f, BALLISTIC_METER_DEFAULT_CORRELATION_MS));
+	addParameter(spectrumRate = new AudioParameterFloat("spectrumRate", "Spectrum Analyser Rate (Hz, 0 = off)", 0.0f, 60.0f, 0.0f));
+	addParameter(linearPhaseMode = new AudioParameterBool("linearPhaseMode", "Linear Phase Crossovers", false));
+
+	// Up to 8 bands. The surface's buttons solo the first four, the rest are soloed from the host.
+	addParameter(crossoverBands = new AudioParameterInt("crossoverBands", "Crossover Bands", MULTIBAND_CROSSOVER_MIN_BANDS, MULTIBAND_CROSSOVER_MAX_BANDS, CROSSOVER_DEFAULT_BANDS));
+	for (int i = CROSSOVER_DEFAULT_BANDS; i < MULTIBAND_CROSSOVER_MAX_BANDS; i++)
+		addBandSoloParameter(i);
+	for (int i = CROSSOVER_DEFAULT_BANDS - 1; i < MULTIBAND_CROSSOVER_MAX_CROSSOVERS; i++)
+		addCrossoverParameter(i, 20000.0f);
+
+	addParameter(roomCorrection = new AudioParameterBool("roomCorrection", "Room Correction", false));
+
+	monitorRouting.setTable(getRoutingTableFromParameters());
 
 	// Our map of button note numbers to plugin parameters.
 	buttonParamMap = {
@@ -412,7 +510,7 @@ DreamControlAudioProcessor::~DreamControlAudioProcessor()
 {
 	if (midiInput != nullptr) midiInput->stop();
 	stopTimer();
-	delete lufsProcessor;
+	cancelPendingUpdate();
 	if (midiInput != nullptr) delete midiInput;
 	if (midiOutput != nullptr) delete midiOutput;
 	if (midiOutputToSwitcher != nullptr) delete midiOutputToSwitcher;
@@ -491,72 +589,35 @@ void DreamControlAudioProcessor::prepareToPlay(double sampleRate, int samplesPer
 	numChannels = getNumInputChannels();
 	int bufferSize = getBlockSize();
 
-	//////////////////////////////////////////////////////////////////////////
-	// Crossover filter initialisation
-	//////////////////////////////////////////////////////////////////////////
-
-	// Allocate memory for filter objects
-	crossoverFilters.resize(numChannels);
-	for (auto &it : crossoverFilters)
-		it.resize(numCrossovers * 4);		// * 4 for duplicated filters for Linkwitz-Riley implementation
-
-	if (crossoverFilters.size() != 0) {
-		std::vector<std::vector<std::unique_ptr<CrossoverFilter>>>::iterator row;
-		std::vector<std::unique_ptr<CrossoverFilter>>::iterator col;
-		for (row = crossoverFilters.begin(); row != crossoverFilters.end(); row++) {
-			for (col = row->begin(); col != row->end(); col++) {
-				*col = std::make_unique<CrossoverFilter>(false, true);
-			}
-		}
+	// The switcher unit may have been plugged in since we last looked.
+	if (midiOutputToSwitcher == nullptr)
+	{
+		openMonitorSwitcher();
+		updateMonitorSwitcher();
 	}
 
-	// Update the filter settings to work with the current parameters and sample rate
-	updateFilters(sampleRate);
-
 	//////////////////////////////////////////////////////////////////////////
-	// Loudness EQ initialisation
+	// Audio chain initialisation: crossovers, meters, loudness EQ, room correction, speaker set trim/delay
 	//////////////////////////////////////////////////////////////////////////
 
-	loudnessEqFilters.resize(numChannels);
-	for (auto &it : loudnessEqFilters)
-		it.resize(7);						// 7 bands of EQ for our loudness EQ
-
-	if (loudnessEqFilters.size() != 0) {
-		std::vector<std::vector<std::unique_ptr<IIRFilter>>>::iterator row;
-		std::vector<std::unique_ptr<IIRFilter>>::iterator col;
-		for (row = loudnessEqFilters.begin(); row != loudnessEqFilters.end(); row++) {
-			for (col = row->begin(); col != row->end(); col++) {
-				*col = std::make_unique<IIRFilter>(IIRFilter());
-			}
-		}
-	}
+	monitorChain.prepareToPlay(sampleRate, samplesPerBlock, numChannels);
+	updateLatency();
 
-	for (int chan = 0; chan < numChannels; chan++)
-	{
-		// EQ parameters taken from https://www.hometheatershack.com/forums/av-home-theater/23077-equal-loudness-db-phons-contours-eq-you-will-want-give-listen.html
-		// TODO: This needs to be checked and has scope for improvement.
-		loudnessEqFilters[chan][0]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 20.0, 4.45, Decibels::decibelsToGain(-38.9)));
-		loudnessEqFilters[chan][1]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 1130.0, 0.65, Decibels::decibelsToGain(3.85)));
-		loudnessEqFilters[chan][2]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 1490.0, 2.20, Decibels::decibelsToGain(-8.15)));
-		loudnessEqFilters[chan][3]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 3290.0, 0.59, Decibels::decibelsToGain(6.55)));
-		loudnessEqFilters[chan][4]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 8850.0, 1.78, Decibels::decibelsToGain(-12.88)));
-		loudnessEqFilters[chan][5]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 12300.0, 4.50, Decibels::decibelsToGain(5.44)));
-		loudnessEqFilters[chan][6]->setCoefficients(IIRCoefficients::makePeakFilter(sampleRate, 20000.0, 3.50, Decibels::decibelsToGain(-10.50)));
-	}
+	// Update the filter settings to work with the current parameters
+	updateFilters();
 
-	//////////////////////////////////////////////////////////////////////////
-	// Loudness meter initialisation
-	//////////////////////////////////////////////////////////////////////////
+	lastDroppedMeterFrames = 0;
+	lastSpectrumFrame = monitorChain.getSpectrumAnalyser().getNumFrames();
 
-	lufsProcessor->prepareToPlay(sampleRate, samplesPerBlock);
-	lufsProcessor->reset();
+	// The impulse responses are (re)loaded in the background, for the new sample rate.
+	monitorChain.getRoomCorrectionProcessor().startLoading();
 
 	startTimer(CALLBACK_TIMER_PERIOD_MS);
 }
 
 void DreamControlAudioProcessor::releaseResources()
 {
-
+	monitorChain.releaseResources();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -589,115 +650,61 @@ void DreamControlAudioProcessor::processBlock(AudioBuffer<float>& buffer, MidiBu
 	// Audio processing block
 	//////////////////////////////////////////////////////////////////////////
 
-	const int numInputChannels = getNumInputChannels();   
-	const int numOutputChannels = getNumOutputChannels();   
-	const int numSamples = buffer.getNumSamples();          												
-
-	// Perform band filtering if any of our band solos are engaged.
-	if (isAnyBandSolo()) 
-	{
-		AudioSampleBuffer inputBuffer;
-		AudioSampleBuffer chanBuffer = AudioSampleBuffer(1, numSamples);
-		inputBuffer.makeCopyOf(buffer);
-		buffer.clear();
-
-		// For each channel, for each band, perform LP and HP filtering on input, then sum to main output buffer.
-		// Lowest and highest bands have 1 L/HPF, and mid bands have 1 LPF + 1 HPF. These are also doubled in number to make Linkwitz-Riley filters.
-		for (int chan = 0; chan < numInputChannels; chan++)
-		{	
-			int filtIndex = 0;
-
-			for (int band = 0; band < numBands; band++)
-			{
-				int filtCount = (band > 0) && (band < numBands - 1) ? 4 : 2;
-
-				if (bandSolo[band]->get() == false)
-				{
-					// If band is not solo'd, skip this band.
-					filtIndex += filtCount;
-					continue;
-				}
-
-				for (int i = 0; i < filtCount; i++)
-				{
-					float* sourcePointer = (i == 0) ? inputBuffer.getWritePointer(chan) : chanBuffer.getWritePointer(0);
-					crossoverFilters[chan][filtIndex]->applyFilter(sourcePointer, chanBuffer.getWritePointer(0), numSamples);
-					filtIndex++;
-				}				
-
-				// Sum to output buffer
-				for (int sample = 0; sample < numSamples; ++sample)
-					buffer.getWritePointer(chan)[sample] += chanBuffer.getReadPointer(0)[sample];
-			}
-		}
-	}
-
-	// Mid/side solo
-	if (midSolo->get() == true)
-	{
-		for (int sample = 0; sample < numSamples; ++sample)
-		{
-			buffer.getWritePointer(0)[sample] = (buffer.getReadPointer(0)[sample] + buffer.getReadPointer(1)[sample]) / 2.0;
-			buffer.getWritePointer(1)[sample] = buffer.getReadPointer(0)[sample];
-		}
-	}
-	else if (sideSolo->get() == true)
-	{
-		AudioSampleBuffer inputBuffer;
-		inputBuffer.makeCopyOf(buffer);
-
-		for (int sample = 0; sample < numSamples; ++sample)
-		{
-			buffer.getWritePointer(0)[sample] = ((inputBuffer.getReadPointer(1)[sample] - inputBuffer.getReadPointer(0)[sample]) 
-				+ -(inputBuffer.getReadPointer(0)[sample] - inputBuffer.getReadPointer(1)[sample])) / 2.0;
-			buffer.getWritePointer(1)[sample] = buffer.getReadPointer(0)[sample];
-		}
-	}
-
-	// Loudness EQ
-	if (loudnessMode->get() == true)
-	{
-		for (int chan = 0; chan < numChannels; chan++)
-		{
-			for (int i = 0; i < 7; i++)
-				loudnessEqFilters[chan][i]->processSamples(buffer.getWritePointer(chan), numSamples);
-		}
-	}
-
-	// Perform LUFS and True Peak measurements.
-	lufsProcessor->processBlock(buffer);
+	MonitorChain::Settings settings;
+	settings.soloMask = getBandSoloMask();
+	settings.linearPhase = linearPhaseMode->get();
+	settings.midSolo = midSolo->get();
+	settings.sideSolo = sideSolo->get();
+	settings.meterOnAnalysisThread = meterOnAnalysisThread->get();
+	settings.loudnessEq = loudnessMode->get();
+	settings.listeningLevel = getListeningLevel();
+	settings.gain = 1.0f;
+	settings.speakerSet = currentMonitorSelect.load(std::memory_order_relaxed);
+	settings.roomCorrection = roomCorrection->get();
 
 	if (!useRMEVolControl->get()) 
 	{
-		// Monitor/ref/dim gain.
-		float currentGainDb = dimMode->get() ? dimLevel->get() : refMode->get() ? refLevel->get() : monitorLevel->get();
-
-		// Set gain, or mute
-		if (muteMode->get() || currentGainDb <= LOWEST_VOLUME_VALUE)
-		{
-			buffer.clear();
-		}
+		// Monitor/ref/dim gain, or mute
+		if (muteMode->get() || settings.listeningLevel <= LOWEST_VOLUME_VALUE)
+			settings.gain = 0.0f;
 		else
-		{
-			float gain = Decibels::decibelsToGain(currentGainDb);
-			buffer.applyGain(gain);
-		}
+			settings.gain = Decibels::decibelsToGain(settings.listeningLevel);
 	}
+
+	monitorChain.process(buffer, settings);
 }
 
 //==============================================================================
 // Callback executed every 10ms.
 void DreamControlAudioProcessor::hiResTimerCallback()
 {
-	// LUFS meter.
-	lufsProcessor->update();
-	const int validSize = lufsProcessor->getValidSize();
+	LufsProcessor& lufsProcessor = monitorChain.getLufsProcessor();
+	BallisticMeterProcessor& ballisticMeterProcessor = monitorChain.getBallisticMeterProcessor();
+
+	// LUFS meter. Only what's displayed is measured: the range parameters for the host (the other
+	// meter values aren't host parameters), and the LCD and LED bars when the surface is connected.
+	lufsProcessor.setMeters(getDisplayedMeters());
+	lufsProcessor.update();
+	ballisticMeterProcessor.setEnabled(areBallisticMetersDisplayed());
+	ballisticMeterProcessor.setHoldTime(peakHoldSeconds->get());
+	ballisticMeterProcessor.setCorrelationTime(correlationTime->get());
+	monitorChain.getSpectrumAnalyser().setFrameRate(spectrumRate->get());
+	sendSpectrum();
+
+	// The analysis thread drops audio it can't keep up with, which the meters then miss.
+	const int64 droppedMeterFrames = monitorChain.getMeterAnalysisThread().getNumDroppedFrames();
+	if (droppedMeterFrames != lastDroppedMeterFrames)
+	{
+		Logger::writeToLog("DreamControl: meter analysis thread dropped " + String(droppedMeterFrames - lastDroppedMeterFrames) + " frames");
+		lastDroppedMeterFrames = droppedMeterFrames;
+	}
+	const int validSize = lufsProcessor.getValidSize();
 
-	float lufsSval = lufsProcessor->getShortTermVolumeArray()[validSize - 1];
-	float lufsMval = lufsProcessor->getMomentaryVolumeArray()[validSize - 1];
-	float lufsIval = lufsProcessor->getIntegratedVolumeArray()[validSize - 1];
-	float lufsMinVal = lufsProcessor->getRangeMinVolume();
-	float lufsMaxVal = lufsProcessor->getRangeMaxVolume();
+	float lufsSval = lufsProcessor.getShortTermVolumeArray()[validSize - 1];
+	float lufsMval = lufsProcessor.getMomentaryVolumeArray()[validSize - 1];
+	float lufsIval = lufsProcessor.getIntegratedVolumeArray()[validSize - 1];
+	float lufsMinVal = lufsProcessor.getRangeMinVolume();
+	float lufsMaxVal = lufsProcessor.getRangeMaxVolume();
 
 	lufsShort->setValueNotifyingHost(((lufsSval >= LOWEST_LUFS_VALUE ? lufsSval : LOWEST_LUFS_VALUE) - LOWEST_LUFS_VALUE) / -LOWEST_LUFS_VALUE);
 	lufsMomentary->setValueNotifyingHost(((lufsMval >= LOWEST_LUFS_VALUE ? lufsMval : LOWEST_LUFS_VALUE) - LOWEST_LUFS_VALUE) / -LOWEST_LUFS_VALUE);
@@ -708,14 +715,14 @@ void DreamControlAudioProcessor::hiResTimerCallback()
 	if (lufsReset->get() == true)
 	{
 		lufsReset->setValueNotifyingHost(false);
-		lufsProcessor->reset();
+		lufsProcessor.reset();
 		msSinceLastPeakReset = 0;
 	}
 
 	// True Peak meter.
 	float truePeakRange = LOWEST_TRUE_PEAK_VALUE - HIGHEST_TRUE_PEAK_VALUE;
-	float peakLval = lufsProcessor->getTruePeakChannelArray(0)[validSize - 1] - HIGHEST_TRUE_PEAK_VALUE;
-	float peakRval = lufsProcessor->getTruePeakChannelArray(1)[validSize - 1] - HIGHEST_TRUE_PEAK_VALUE;
+	float peakLval = lufsProcessor.getTruePeakChannelArray(0)[validSize - 1] - HIGHEST_TRUE_PEAK_VALUE;
+	float peakRval = lufsProcessor.getTruePeakChannelArray(1)[validSize - 1] - HIGHEST_TRUE_PEAK_VALUE;
 	peakMeterLeft->setValueNotifyingHost(((peakLval >= truePeakRange ? peakLval : truePeakRange) - truePeakRange) / -truePeakRange);
 	peakMeterRight->setValueNotifyingHost(((peakRval >= truePeakRange ? peakRval : truePeakRange) - truePeakRange) / -truePeakRange);
 
@@ -778,12 +785,104 @@ void DreamControlAudioProcessor::hiResTimerCallback()
 			peakLval + HIGHEST_TRUE_PEAK_VALUE > 0.0f ? 1 : 0, peakRval + HIGHEST_TRUE_PEAK_VALUE > 0.0f ? 1 : 0
 		};
 
-		MidiMessage msg = MidiMessage::createSysExMessage(sysexData, sizeof(sysexData));
+		std::vector<unsigned char> packet(std::begin(sysexData), std::end(sysexData));
+
+		auto addMeterValue = [&](float val) {
+			char* ints = getMeterIntegralFractional(val);
+			packet.push_back(ints[0]);
+			packet.push_back(ints[1]);
+			delete[] ints;
+		};
+
+		// Ballistic meters, left and right of each, then the sample peak and PPM holds. They can go
+		// over 0dB, so they're offset like true peak. Then the meter type of each LED bar.
+		for (int ballistics = 0; ballistics < BallisticMeterProcessor::numBallistics; ballistics++)
+			for (int chan = 0; chan < BALLISTIC_METER_MAX_CHANNELS; chan++)
+				addMeterValue(ballisticMeterProcessor.getLevel(chan, (BallisticMeterProcessor::Ballistics)ballistics) - HIGHEST_TRUE_PEAK_VALUE);
+
+		for (auto ballistics : { BallisticMeterProcessor::samplePeak, BallisticMeterProcessor::ppm })
+			for (int chan = 0; chan < BALLISTIC_METER_MAX_CHANNELS; chan++)
+				addMeterValue(ballisticMeterProcessor.getHold(chan, ballistics) - HIGHEST_TRUE_PEAK_VALUE);
+
+		for (int i = 0; i < METER_BAR_COUNT; i++)
+			packet.push_back((unsigned char)meterBarType[i]->getIndex());
+
+		// Correlation and balance, offset so they're never above 0 either.
+		addMeterValue(ballisticMeterProcessor.getCorrelation() - 1.0f);
+		addMeterValue(ballisticMeterProcessor.getBalance() - BALLISTIC_METER_MAX_BALANCE_DB);
+
+		MidiMessage msg = MidiMessage::createSysExMessage(packet.data(), (int)packet.size());
 		midiOutput->sendMessageNow(msg);
 	}
 
-	// Update crossover filter coefficients.
-	updateFilters(getSampleRate());
+	// Apply any routing changes made since the last callback.
+	if (monitorRouting.setTable(getRoutingTableFromParameters()))
+	{
+		updateRMEVolumeControl();
+		updateMonitorSwitcher();
+	}
+
+	// Send any fader values held back by the rate limit.
+	faderBridge->setMaxRate(faderMaxRate->get());
+	faderBridge->flush();
+
+	// Update crossover filter coefficients. Hosts expect latency changes on the message thread.
+	updateFilters();
+	if (getRequiredLatency() != getLatencySamples())
+		triggerAsyncUpdate();
+
+#if DREAMCONTROL_STAGE_TIMING
+	msSinceLastTimingReport += CALLBACK_TIMER_PERIOD_MS;
+	if (msSinceLastTimingReport >= STAGE_TIMING_REPORT_PERIOD_MS)
+	{
+		msSinceLastTimingReport = 0;
+		reportStageTiming();
+	}
+#endif
+}
+
+// Dump the audio callback timing as JSON to a file, and over OSC if REAPER integration is on,
+// to see which feature is pushing an instance over budget.
+void DreamControlAudioProcessor::reportStageTiming()
+{
+	File::getSpecialLocation(File::tempDirectory).getChildFile(STAGE_TIMING_JSON_FILE_NAME).replaceWithText(monitorChain.getStageTiming().toJson());
+
+	if (!oscConnected)
+		return;
+
+	for (int stage = 0; stage < StageTiming::numStages; stage++)
+	{
+		const StageTiming::Stats stats = monitorChain.getStageTiming().getStats((StageTiming::Stage)stage);
+
+		// Floats, as OSC ints are 32 bits and cycle counts can be bigger.
+		OSCMessage message(STAGE_TIMING_OSC_ADDRESS + String(StageTiming::getStageName((StageTiming::Stage)stage)));
+		message.addFloat32((float)stats.count);
+		message.addFloat32((float)stats.mean);
+		message.addFloat32((float)stats.median);
+		message.addFloat32((float)stats.percentile99);
+		message.addFloat32((float)stats.max);
+		reaperOscSender.send(message);
+	}
+}
+
+// Send the spectrum analyser's band levels over OSC when REAPER integration is on, once per new frame,
+// for a display on the OSC network (the surface has nowhere to show them).
+void DreamControlAudioProcessor::sendSpectrum()
+{
+	const int frame = monitorChain.getSpectrumAnalyser().getNumFrames();
+	if (frame == lastSpectrumFrame)
+		return;
+
+	lastSpectrumFrame = frame;
+
+	if (!oscConnected)
+		return;
+
+	// dB, lowest band (20 Hz) first.
+	OSCMessage message(SPECTRUM_OSC_ADDRESS);
+	for (int band = 0; band < SPECTRUM_ANALYSER_NUM_BANDS; band++)
+		message.addFloat32(monitorChain.getSpectrumAnalyser().getBandLevel(band));
+	reaperOscSender.send(message);
 }
 
 char* DreamControlAudioProcessor::getMeterIntegralFractional(float val)
@@ -802,47 +901,83 @@ char* DreamControlAudioProcessor::getMeterIntegralFractional(float val)
 	return output;
 }
 
-// Update the coefficients of our crossover filters.
-void DreamControlAudioProcessor::updateFilters(float sampleRate)
+// Meters shown by the surface and the host, for LufsProcessor::setMeters. Mode changes reset the
+// meters, so integrated and range are always measured from the start.
+int DreamControlAudioProcessor::getDisplayedMeters() const
 {
-	// Iterate over each filter object and set coefficients from plugin params.
-	// Lowest and highest bands have 1 L/HPF, and mid bands have 1 LPF + 1 HPF. These are also doubled in number to make Linkwitz-Riley filters.
-	for (int chan = 0; chan < numChannels; chan++)
+	// The LUFS range parameters are visible to the host.
+	int meters = LufsProcessor::LoudnessRangeMeter;
+
+	if (midiOutput != nullptr)
 	{
-		int filtIndex = 0;
+		// The LCD shows max true peak (and clip), integrated, range and short term in every mode.
+		meters |= LufsProcessor::TruePeakMeter | LufsProcessor::IntegratedMeter | LufsProcessor::ShortTermMeter;
 
-		for (int band = 0; band < numBands; band++)
-		{
-			for (int i = 0; i < 2; i++)		// Duplication of filters for Linkwitz-Riley.
-			{
-				if (band == 0)
-				{
-					crossoverFilters[chan][filtIndex]->makeCrossover(*crossoverFreq[band], sampleRate, true, false);
-					filtIndex++;
-				}
-				else if (band < numBands - 1)
-				{
-					crossoverFilters[chan][filtIndex]->makeCrossover(*crossoverFreq[band - 1], sampleRate, true, true);
-					crossoverFilters[chan][filtIndex + 1]->makeCrossover(*crossoverFreq[band], sampleRate, true, false);
-					filtIndex += 2;
-				}
-				else
-				{
-					crossoverFilters[chan][filtIndex]->makeCrossover(*crossoverFreq[band - 1], sampleRate, true, true);
-					filtIndex++;
-				}
-			}
-		}
+		// LED bars: momentary, short term and integrated in LUFS mode; true peak and
+		// momentary or integrated in peak mode.
+		if (lufsMode->get() || peakWithMomentaryMode->get())
+			meters |= LufsProcessor::MomentaryMeter;
 	}
+
+	return meters;
 }
 
-bool DreamControlAudioProcessor::isAnyBandSolo()
+// The ballistic, correlation and balance meters are only shown on the surface's LED bars, when one is set to them.
+bool DreamControlAudioProcessor::areBallisticMetersDisplayed() const
 {
-	for (int b = 0; b < bandSolo.size(); b++)
-		if (bandSolo[b]->get() == true) return true;
+	if (midiOutput == nullptr)
+		return false;
+
+	for (auto* type : meterBarType)
+	{
+		if (type->getIndex() >= METER_BAR_SAMPLE_PEAK)
+			return true;
+	}
+
 	return false;
 }
 
+// Pass the crossover settings on. The IIR crossovers pick them up on the audio thread, the
+// linear phase ones are only redesigned when something has changed.
+void DreamControlAudioProcessor::updateFilters()
+{
+	float frequencies[MULTIBAND_CROSSOVER_MAX_CROSSOVERS];
+	for (int i = 0; i < MULTIBAND_CROSSOVER_MAX_CROSSOVERS; i++)
+		frequencies[i] = *crossoverFreq[i];
+
+	monitorChain.setCrossovers(crossoverBands->get(), frequencies);
+}
+
+// The linear phase crossovers and room correction add latency, while they're on.
+int DreamControlAudioProcessor::getRequiredLatency() const
+{
+	return monitorChain.getLatencySamples(linearPhaseMode->get(), roomCorrection->get());
+}
+
+// Message thread, or prepareToPlay.
+void DreamControlAudioProcessor::updateLatency()
+{
+	const int latency = getRequiredLatency();
+	if (latency != getLatencySamples())
+		setLatencySamples(latency);
+}
+
+// Latency changes seen by the timer, which runs on its own thread.
+void DreamControlAudioProcessor::handleAsyncUpdate()
+{
+	updateLatency();
+}
+
+// Bit n set if band n is soloed. Solos of bands beyond the current number of bands are ignored.
+int DreamControlAudioProcessor::getBandSoloMask() const
+{
+	int mask = 0;
+	for (int band = 0; band < crossoverBands->get(); band++)
+		if (bandSolo[band]->get())
+			mask |= 1 << band;
+	return mask;
+}
+
 //==============================================================================
 // MIDI Input handler.
 void DreamControlAudioProcessor::handleIncomingMidiMessage(MidiInput* source, const MidiMessage& m)
@@ -853,13 +988,7 @@ void DreamControlAudioProcessor::handleIncomingMidiMessage(MidiInput* source, co
 		const juce::uint8 *data = m.getSysExData();
 		
 		if (data[0] == SYSEX_COMMAND_SYNC_BUTTONS)
-		{
-			// Send all button values out.
-			for (auto p : buttonParamMap)	
-				if (midiOutput != nullptr)
-					midiOutput->sendMessageNow(MidiMessage::noteOn(1, p.first, p.second->get() ? 1.0f : 0.0f));
-			
-		}
+			sendButtonStates();
 	}
 	else if (m.isControllerOfType(7))
 	{
@@ -889,12 +1018,7 @@ void DreamControlAudioProcessor::handleIncomingMidiMessage(MidiInput* source, co
 			midiOutput->sendMessageNow(MidiMessage::noteOn(1, m.getNoteNumber(), 1.0f));
 		}
 
-		if (midiOutputToSwitcher != nullptr)
-		{
-			// If switcher unit present, send Note Ons to switch relays
-			midiOutputToSwitcher->sendMessageNow(MidiMessage::noteOn(1, currentMonitorSelect + 1, 127.0f));
-		}
-
+		updateMonitorSwitcher();
 		updateRMEVolumeControl();
 	}
 	else if (m.isNoteOn(false) && m.getVelocity() == 127)
@@ -974,10 +1098,14 @@ void DreamControlAudioProcessor::handleIncomingMidiMessage(MidiInput* source, co
 			}
 		}
 	}
-	else if (m.isControllerOfType(MIDI_FADER_TOUCH_SENSE_CC) && useReaperOsc->get())
+	else if (m.isControllerOfType(MIDI_FADER_TOUCH_SENSE_CC))
 	{
+		// While touched, the DAW doesn't move the motor fader.
+		faderBridge->setTouched(m.getControllerValue() > 0);
+
 		// Pass fader touch sense to REAPER.
-		reaperOscSender.send("/track/volume/touch", m.getControllerValue() > 0 ? 1.0f : 0.0f);
+		if (useReaperOsc->get())
+			reaperOscSender.send("/track/volume/touch", m.getControllerValue() > 0 ? 1.0f : 0.0f);
 	}
 	else if (m.isController())
 	{
@@ -985,45 +1113,115 @@ void DreamControlAudioProcessor::handleIncomingMidiMessage(MidiInput* source, co
 		MidiRPNMessage msg;
 		if (faderRpnDetector->parseControllerMessage(m.getChannel(), m.getControllerNumber(), m.getControllerValue(), msg))
 		{
-			if (useReaperOsc->get() && msg.isNRPN && msg.is14BitValue)
-				reaperOscSender.send("/track/volume", (float)msg.value / 16383.0f);
+			if (msg.isNRPN && msg.is14BitValue)
+				faderBridge->faderMoved(msg.value);
 		}
 	}
 }
 
+// Monitor, ref or dim level in dB, whichever is in use. Mute is left to the caller.
+float DreamControlAudioProcessor::getListeningLevel() const
+{
+	return dimMode->get() ? dimLevel->get() : refMode->get() ? refLevel->get() : monitorLevel->get();
+}
+
 void DreamControlAudioProcessor::updateRMEVolumeControl()
 {
 	// If external volume control enabled, send MIDI.
 	if (midiOutputToVolControl != nullptr && useRMEVolControl->get())
 	{
 		// Monitor/mute/ref/dim value.
-		float level = dimMode->get() ? dimLevel->get() : refMode->get() ? refLevel->get() : monitorLevel->get();
+		float level = getListeningLevel();
 		if (muteMode->get()) level = LOWEST_VOLUME_VALUE;
 
-		// Look up RME TotalMix fader MIDI value using our curve vector.
-		std::vector<float>::const_iterator index = std::lower_bound(RME_TOTALMIX_FADER_CURVE.begin(), RME_TOTALMIX_FADER_CURVE.end(), level);
-		int levelMidiVal = (index - RME_TOTALMIX_FADER_CURVE.begin());
+		// Look up RME TotalMix fader MIDI value using our precomputed curve table.
+		int levelMidiVal = rmeTotalMixCCForDecibels(level);
 		if (level <= LOWEST_VOLUME_VALUE + 0.5) levelMidiVal = 0;
 
-		// Send volume control MIDI messages.
-		for (int i = 0; i < rmeTotalMixMidiChannelControllers.size(); i++)
+		// Work out the value for each TotalMix output first, as speaker sets can share outputs.
+		auto routing = monitorRouting.getTable();
+		int outputMidiVal[MONITOR_ROUTING_MAX_TOTALMIX_OUTPUT + 1];
+		for (int out = 0; out <= MONITOR_ROUTING_MAX_TOTALMIX_OUTPUT; out++)
+			outputMidiVal[out] = -1;
+
+		for (int i = 0; i < MONITOR_ROUTING_NUM_SPEAKER_SETS; i++)
+		{
+			int midiVal = (currentMonitorSelect == i || useRMEMonitorSwitch->get() == false) ? levelMidiVal : 0;
+
+			for (int out = 0; out < MONITOR_ROUTING_MAX_OUTPUTS; out++)
+			{
+				int rmeChan = routing.speakerSets[i].totalMixOutputs[out];
+				if (rmeChan > 0 && midiVal > outputMidiVal[rmeChan])
+					outputMidiVal[rmeChan] = midiVal;
+			}
+
+			if (useRMEMonitorSwitch->get() == false && i > 0)
+				break;
+		}
+
+		// Send volume control MIDI messages, only for outputs whose value has changed.
+		for (int rmeChan = 1; rmeChan <= MONITOR_ROUTING_MAX_TOTALMIX_OUTPUT; rmeChan++)
 		{
-			int rmeChan = rmeTotalMixMidiChannelControllers[i];
-			if (rmeChan == -1) continue;
+			int midiVal = outputMidiVal[rmeChan];
+			if (midiVal == -1 || rmeOutputSentCC[rmeChan] == midiVal) continue;
 
 			// Get MIDI channel and CC for TotalMix hardware output fader.
 			int midiChan = floor((rmeChan - 1) / 8) + 9;
 			int midiCC = (((rmeChan - 1) % 8) * 2) + 102;
 
-			MidiMessage msg = MidiMessage::controllerEvent(midiChan, midiCC, (currentMonitorSelect == i || useRMEMonitorSwitch->get() == false) ? levelMidiVal : 0);
-			midiOutputToVolControl->sendMessageNow(msg);
+			midiOutputToVolControl->sendMessageNow(MidiMessage::controllerEvent(midiChan, midiCC, midiVal));
+			rmeOutputSentCC[rmeChan] = midiVal;
+		}
+	}
+}
+
+void DreamControlAudioProcessor::openMonitorSwitcher()
+{
+	int switcherOutputDeviceId = MidiOutput::getDevices().indexOf(MIDI_OUT_SWITCHER_PORT_NAME);
+	if (switcherOutputDeviceId > -1)
+	{
+		midiOutputToSwitcher = MidiOutput::openDevice(switcherOutputDeviceId);
 
-			if (useRMEMonitorSwitch->get() == false && i > 0)
-				return;
+		// The relay state is unknown after (re)connecting, so it gets sent next time.
+		switcherSentRelay = -1;
+	}
+}
+
+void DreamControlAudioProcessor::updateMonitorSwitcher()
+{
+	// If switcher unit present, send Note On to switch relays. Note 0 switches all relays off.
+	if (midiOutputToSwitcher != nullptr)
+	{
+		const int speakerSet = currentMonitorSelect;
+		int relay = speakerSet >= 0 ? monitorRouting.getSpeakerSet(speakerSet).switcherRelay : 0;
+
+		if (relay != switcherSentRelay)
+		{
+			midiOutputToSwitcher->sendMessageNow(MidiMessage::noteOn(1, relay, 127.0f));
+			switcherSentRelay = relay;
 		}
 	}
 }
 
+MonitorRouting::Table DreamControlAudioProcessor::getRoutingTableFromParameters()
+{
+	MonitorRouting::Table table;
+
+	for (int i = 0; i < MONITOR_ROUTING_NUM_SPEAKER_SETS; i++)
+	{
+		SpeakerSetRouting& speakerSet = table.speakerSets[i];
+
+		for (int out = 0; out < MONITOR_ROUTING_MAX_OUTPUTS; out++)
+			speakerSet.totalMixOutputs[out] = routingTotalMixOutput[i][out]->get();
+
+		speakerSet.switcherRelay = routingSwitcherRelay[i]->get();
+		speakerSet.trimDb = routingTrim[i]->get();
+		speakerSet.delayMs = routingDelay[i]->get();
+	}
+
+	return table;
+}
+
 //==============================================================================
 // OSC Input handler.
 void DreamControlAudioProcessor::oscMessageReceived(const OSCMessage& message)
@@ -1036,7 +1234,7 @@ void DreamControlAudioProcessor::oscMessageReceived(const OSCMessage& message)
 		if (pattern == "/track/volume")
 		{
 			// Track volume fader.
-			midiOutput->sendBlockOfMessagesNow(MidiRPNGenerator::generate(1, 1, static_cast<int>(value * 16383), true, true));
+			faderBridge->dawVolumeChanged(static_cast<int>(value * FADER_BRIDGE_MAX_VALUE + 0.5f));
 		}
 		else if (pattern == "/anysolo" && value == 0.0f)
 		{
@@ -1116,33 +1314,88 @@ AudioProcessorEditor* DreamControlAudioProcessor::createEditor()
 
 //==============================================================================
 // Parameter state persistence.
-// TODO: Use AudioProcessorValueTreeState to manage parameters and persist state.
 
+// State is saved as XML, with each value keyed by its parameter ID. Unknown IDs are ignored and missing
+// ones keep their defaults, so sessions load in both older and newer versions of the plugin.
 void DreamControlAudioProcessor::getStateInformation(MemoryBlock& destData)
 {
-	MemoryOutputStream stream(destData, true);
-
-	stream.writeFloat(monitorLevel->get());
-	stream.writeBool(*muteMode);
-	stream.writeBool(*dimMode);
-	stream.writeBool(*refMode);
-	stream.writeBool(*midSolo);
-	stream.writeBool(*sideSolo);
-	stream.writeBool(*loudnessMode);
-	stream.writeFloat(lufsTarget->get());
-	stream.writeBool(*lufsMode);
-	stream.writeBool(*peakWithMomentaryMode);
-	stream.writeBool(*relativeMode);
-	stream.writeBool(*is1dbPeakScale);
-	stream.writeFloat(dimLevel->get());
-	stream.writeFloat(refLevel->get());
-	stream.writeFloat(peakHoldSeconds->get());
-	stream.writeBool(*volModMode);
-	stream.writeBool(*useRMEVolControl);
-	stream.writeBool(*useReaperOsc);
+	XmlElement xml(STATE_XML_TAG);
+	xml.setAttribute("version", STATE_VERSION);
+
+	for (auto* param : getParameters())
+	{
+		if (!isParameterSavedInState(param))
+			continue;
+
+		auto* paramWithID = dynamic_cast<AudioProcessorParameterWithID*>(param);
+		XmlElement* paramXml = xml.createNewChildElement(STATE_PARAM_XML_TAG);
+		paramXml->setAttribute("id", paramWithID->paramID);
+
+		// Save real values rather than normalised ones, so they survive any later range changes.
+		if (auto* floatParam = dynamic_cast<AudioParameterFloat*>(param))
+			paramXml->setAttribute("value", floatParam->get());
+		else if (auto* intParam = dynamic_cast<AudioParameterInt*>(param))
+			paramXml->setAttribute("value", intParam->get());
+		else if (auto* boolParam = dynamic_cast<AudioParameterBool*>(param))
+			paramXml->setAttribute("value", boolParam->get() ? 1 : 0);
+		else if (auto* choiceParam = dynamic_cast<AudioParameterChoice*>(param))
+			paramXml->setAttribute("value", choiceParam->getIndex());
+	}
+
+	copyXmlToBinary(xml, destData);
 }
 
 void DreamControlAudioProcessor::setStateInformation(const void* data, int sizeInBytes)
+{
+	// Restore everything as one batch. Mode change side effects (meter reset, hardware LEDs) run
+	// once at the end if any mode changed, and MIDI/OSC ports are only opened or closed if their
+	// setting changed.
+	setParameterNotificationsSuspended(true);
+
+	std::unique_ptr<XmlElement> xml(getXmlFromBinary(data, sizeInBytes));
+
+	if (xml != nullptr && xml->hasTagName(STATE_XML_TAG))
+		setStateFromXml(*xml);
+	else
+		setLegacyStateInformation(data, sizeInBytes);
+
+	setParameterNotificationsSuspended(false);
+}
+
+void DreamControlAudioProcessor::setStateFromXml(const XmlElement& xml)
+{
+	// Newer versions only ever add parameters, so we can read anything with a higher version too.
+	std::map<String, AudioProcessorParameter*> paramsById;
+	for (auto* param : getParameters())
+		if (isParameterSavedInState(param))
+			paramsById[dynamic_cast<AudioProcessorParameterWithID*>(param)->paramID] = param;
+
+	forEachXmlChildElementWithTagName(xml, paramXml, STATE_PARAM_XML_TAG)
+	{
+		auto it = paramsById.find(paramXml->getStringAttribute("id"));
+		if (it == paramsById.end())
+			continue;
+
+		AudioProcessorParameter* param = it->second;
+		const double value = paramXml->getDoubleAttribute("value");
+
+		if (auto* floatParam = dynamic_cast<AudioParameterFloat*>(param))
+		{
+			float newValue = (float)value;
+			if (floatParam == monitorLevel && newValue < LOWEST_VOLUME_VALUE) newValue = LOWEST_VOLUME_VALUE;
+			*floatParam = newValue;
+		}
+		else if (auto* intParam = dynamic_cast<AudioParameterInt*>(param))
+			*intParam = roundToInt(value);
+		else if (auto* boolParam = dynamic_cast<AudioParameterBool*>(param))
+			boolParam->setValueNotifyingHost(value != 0.0 ? 1.0f : 0.0f);
+		else if (auto* choiceParam = dynamic_cast<AudioParameterChoice*>(param))
+			*choiceParam = jlimit(0, choiceParam->choices.size() - 1, roundToInt(value));	// Notifies the host, as setValueNotifyingHost().
+	}
+}
+
+// Sessions saved before the state was versioned: a fixed sequence of values.
+void DreamControlAudioProcessor::setLegacyStateInformation(const void* data, int sizeInBytes)
 {
 	MemoryInputStream stream(data, static_cast<size_t> (sizeInBytes), false);
 
@@ -1167,6 +1420,69 @@ void DreamControlAudioProcessor::setStateInformation(const void* data, int sizeI
 	volModMode->setValueNotifyingHost(stream.readBool());
 	useRMEVolControl->setValueNotifyingHost(stream.readBool());
 	useReaperOsc->setValueNotifyingHost(stream.readBool());
+
+	// Monitor routing (not present in sessions saved by older versions).
+	if (!stream.isExhausted())
+	{
+		for (int i = 0; i < MONITOR_ROUTING_NUM_SPEAKER_SETS; i++)
+		{
+			for (int out = 0; out < MONITOR_ROUTING_MAX_OUTPUTS; out++)
+				*routingTotalMixOutput[i][out] = stream.readInt();
+
+			*routingSwitcherRelay[i] = stream.readInt();
+			*routingTrim[i] = stream.readFloat();
+			*routingDelay[i] = stream.readFloat();
+		}
+	}
+}
+
+void DreamControlAudioProcessor::setParameterNotificationsSuspended(bool suspended)
+{
+	bool modeChanged = false;
+
+	for (auto* param : getParameters())
+	{
+		if (auto* notifyParam = dynamic_cast<AudioParameterBoolNotify*>(param))
+		{
+			if (suspended)
+				notifyParam->suspendNotifications();
+			else if (notifyParam->resumeNotifications())
+			{
+				// The integrations each open or close their own port. Modes share their side effects, so they run once.
+				if (notifyParam == useReaperOsc || notifyParam == useRMEVolControl)
+					notifyParam->notifyValueChanged();
+				else
+					modeChanged = true;
+			}
+		}
+	}
+
+	if (modeChanged)
+		restoredModesChanged();
+}
+
+// What the mode changed handler does, once for a whole restored state. Mid/side and dim/ref
+// aren't made exclusive here: the state was saved that way.
+void DreamControlAudioProcessor::restoredModesChanged()
+{
+	monitorChain.getLufsProcessor().reset();
+	sendButtonStates();
+}
+
+void DreamControlAudioProcessor::sendButtonStates()
+{
+	if (midiOutput == nullptr)
+		return;
+
+	for (auto p : buttonParamMap)
+		midiOutput->sendMessageNow(MidiMessage::noteOn(1, p.first, p.second->get() ? 1.0f : 0.0f));
+}
+
+// Meter readouts are outputs, not settings.
+bool DreamControlAudioProcessor::isParameterSavedInState(const AudioProcessorParameter* param) const
+{
+	return dynamic_cast<const AudioProcessorParameterWithID*>(param) != nullptr
+		&& param != lufsRangeMin && param != lufsRangeMax;
 }
 
 //==============================================================================
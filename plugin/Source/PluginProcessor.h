@@ -15,20 +15,23 @@
 
 #pragma once
 
+#include <atomic>
 #include <vector>
 #include <array>
 #include <map>
 
-#include "../JuceLibraryCode/JuceHeader.h"
+#include <JuceHeader.h>
 #include "AudioParameterBoolNotify.h"
-#include "LufsProcessor.h"
-#include "CrossoverFilter.h"
+#include "FaderBridge.h"
+#include "MonitorChain.h"
+#include "MonitorRouting.h"
 
 //==============================================================================
 /**
 */
 class DreamControlAudioProcessor :  public AudioProcessor,
 									public HighResolutionTimer,
+									private AsyncUpdater,
 									public MidiInputCallback, 
 									public OSCReceiver,
 									public OSCReceiver::Listener<OSCReceiver::MessageLoopCallback>
@@ -54,7 +57,7 @@ public:
 
     void processBlock (AudioBuffer<float>&, MidiBuffer&) override;
 	void hiResTimerCallback() override;
-	bool isAnyBandSolo();
+	int getBandSoloMask() const;
 	void handleIncomingMidiMessage (MidiInput* source, const MidiMessage& m) override;
 	void oscMessageReceived(const OSCMessage& message) override;
 	void oscBundleReceived(const OSCBundle& bundle) override;
@@ -62,6 +65,9 @@ public:
 	OSCSender reaperOscSender;
 	bool oscConnected;
 
+	// Third octave spectrum of the input, also sent over OSC.
+	const SpectrumAnalyserThread& getSpectrumAnalyser() const { return monitorChain.getSpectrumAnalyser(); }
+
     //==============================================================================
     AudioProcessorEditor* createEditor() override;
     bool hasEditor() const override;
@@ -86,6 +92,13 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
 private:
+	void setStateFromXml(const XmlElement& xml);
+	void setLegacyStateInformation(const void* data, int sizeInBytes);
+	void setParameterNotificationsSuspended(bool suspended);
+	void restoredModesChanged();
+	void sendButtonStates();
+	bool isParameterSavedInState(const AudioProcessorParameter* param) const;
+
 	//==============================================================================
 	// Main
 	MidiOutput* midiOutput;
@@ -101,15 +114,39 @@ private:
 	AudioParameterBoolNotify* muteMode;
 	AudioParameterBoolNotify* dimMode;
 	AudioParameterBoolNotify* refMode;
+	float getListeningLevel() const;
 
 	AudioParameterBool* useRMEVolControl;
 	AudioParameterBool* useRMEMonitorSwitch;
 	void updateRMEVolumeControl();
-	int currentMonitorSelect = 0;
+	std::vector<int> rmeOutputSentCC;				// Last CC value sent to each TotalMix output, -1 if unknown.
+	void openMonitorSwitcher();
+	void updateMonitorSwitcher();
+	int switcherSentRelay = -1;
+	std::atomic<int> currentMonitorSelect { 0 };	// Set by the surface's buttons, read by the audio thread.
 	int currentInputButton = 0;
 
 	AudioParameterBool* useReaperOsc;
 	MidiRPNDetector* faderRpnDetector;
+	std::unique_ptr<FaderBridge> faderBridge;
+	AudioParameterFloat* faderMaxRate;
+
+	//==============================================================================
+	// Monitor routing, per speaker set (MAIN, ALT1, ALT2, ALT3)
+	MonitorRouting monitorRouting;
+	MonitorRouting::Table getRoutingTableFromParameters();
+
+	std::vector<std::vector<AudioParameterInt*>> routingTotalMixOutput;
+	std::vector<AudioParameterInt*> routingSwitcherRelay;
+	std::vector<AudioParameterFloat*> routingTrim;
+	std::vector<AudioParameterFloat*> routingDelay;
+
+	// Room correction per speaker set. Always adds its latency while on, whether or not the set has a file.
+	AudioParameterBool* roomCorrection;
+
+	//==============================================================================
+	// The audio processing, from input to output. Reads the routing table, so it's declared after it.
+	MonitorChain monitorChain;
 
 	//==============================================================================
 	// Channel Strip
@@ -118,8 +155,6 @@ private:
 
 	//==============================================================================
 	// Meters
-	LufsProcessor* lufsProcessor;
-
 	AudioParameterFloat* lufsShort;
 	AudioParameterFloat* lufsMomentary;
 	AudioParameterFloat* lufsIntegrated;
@@ -144,30 +179,52 @@ private:
 	AudioParameterBoolNotify* peakWithMomentaryMode;
 	AudioParameterBoolNotify* relativeMode;
 	AudioParameterBoolNotify* is1dbPeakScale;
+	int getDisplayedMeters() const;
+
+	// Sample peak, RMS, VU, PPM, correlation and balance, for LED bars set to show them.
+	std::vector<AudioParameterChoice*> meterBarType;
+	AudioParameterFloat* correlationTime;
+	bool areBallisticMetersDisplayed() const;
+
+	// Metering on a worker thread, for small buffers where the audio thread has no time to spare.
+	AudioParameterBool* meterOnAnalysisThread;
+	int64 lastDroppedMeterFrames;
+
+	// Spectrum analyser, off until given a frame rate. Each new frame is sent over OSC.
+	AudioParameterFloat* spectrumRate;
+	int lastSpectrumFrame;
+	void sendSpectrum();
 
 	//==============================================================================
 	// Band solo
-	void updateFilters(float sampleRate);
+	void updateFilters();
 
 	int numChannels;
-	int numCrossovers;
-	int numBands;
 	bool aSoloButtonJustEngaged;
-	std::vector<std::vector<std::unique_ptr<CrossoverFilter>>> crossoverFilters;
+	AudioParameterInt* crossoverBands;
 	std::vector<AudioParameterFloat*> crossoverFreq;
 	std::vector<AudioParameterBoolNotify*> bandSolo;
 
+	// Linear phase crossovers, instead of the IIR ones. They always run while selected, so the latency stays put.
+	AudioParameterBool* linearPhaseMode;
+	int getRequiredLatency() const;
+	void updateLatency();
+	void handleAsyncUpdate() override;
+
 	//==============================================================================
 	// M/S solo, loudness EQ
 	AudioParameterBoolNotify* midSolo;
 	AudioParameterBoolNotify* sideSolo;
 	AudioParameterBoolNotify* loudnessMode;
-	std::vector<std::vector<std::unique_ptr<IIRFilter>>> loudnessEqFilters;
 
 	//==============================================================================
 	// For development use only
 	AudioParameterBoolNotify* volModMode;
 
+	// Audio callback timing per stage (see MonitorChain), recorded in DREAMCONTROL_STAGE_TIMING builds only.
+	int msSinceLastTimingReport;
+	void reportStageTiming();
+
 	//==============================================================================
 	char* getMeterIntegralFractional(float val);
 
@@ -1,8 +1,7 @@
 #pragma once
 
-#include <vector>
-
-const std::vector<float> RME_TOTALMIX_FADER_CURVE =
+// RME TotalMix hardware output fader curve: dB value for each MIDI CC value (index).
+constexpr float RME_TOTALMIX_FADER_CURVE[] =
 {
 	-64.0f,
 	-63.2f,
@@ -109,4 +108,49 @@ const std::vector<float> RME_TOTALMIX_FADER_CURVE =
 	-0.5f,
 	-0.3f,
 	0.0f
-};
\ No newline at end of file
+};
+
+#define RME_TOTALMIX_FADER_CURVE_SIZE ((int)(sizeof(RME_TOTALMIX_FADER_CURVE) / sizeof(float)))
+#define RME_TOTALMIX_TABLE_MIN_DB -64.0f
+#define RME_TOTALMIX_TABLE_STEPS_PER_DB 10
+#define RME_TOTALMIX_TABLE_SIZE (64 * RME_TOTALMIX_TABLE_STEPS_PER_DB + 1)
+
+// dB to MIDI CC lookup table, in 0.1dB steps from -64dB to 0dB, built at compile time from the curve above.
+// Each entry is the first CC whose curve value is at or above that level (same as a lower_bound search of the curve).
+struct RmeTotalMixFaderTable
+{
+	unsigned char cc[RME_TOTALMIX_TABLE_SIZE];
+
+	constexpr RmeTotalMixFaderTable() : cc()
+	{
+		int curveIndex = 0;
+		for (int i = 0; i < RME_TOTALMIX_TABLE_SIZE; i++)
+		{
+			const float db = RME_TOTALMIX_TABLE_MIN_DB + (float)i / (float)RME_TOTALMIX_TABLE_STEPS_PER_DB;
+			while (curveIndex < RME_TOTALMIX_FADER_CURVE_SIZE - 1 && RME_TOTALMIX_FADER_CURVE[curveIndex] < db - 0.001f)
+				curveIndex++;
+			cc[i] = (unsigned char)curveIndex;
+		}
+	}
+};
+
+constexpr RmeTotalMixFaderTable RME_TOTALMIX_FADER_TABLE;
+
+// Get the TotalMix fader CC value for a level in dB.
+constexpr int rmeTotalMixCCForDecibels(float db)
+{
+	return db <= RME_TOTALMIX_TABLE_MIN_DB ? RME_TOTALMIX_FADER_TABLE.cc[0]
+		: db >= 0.0f ? RME_TOTALMIX_FADER_TABLE.cc[RME_TOTALMIX_TABLE_SIZE - 1]
+		: RME_TOTALMIX_FADER_TABLE.cc[(int)((db - RME_TOTALMIX_TABLE_MIN_DB) * RME_TOTALMIX_TABLE_STEPS_PER_DB + 0.5f)];
+}
+
+// Inverse of the above: get the level in dB for a (fractional) TotalMix fader CC value, interpolating between curve points.
+constexpr float rmeTotalMixDecibelsForCC(float cc)
+{
+	return cc <= 0.0f ? RME_TOTALMIX_FADER_CURVE[0]
+		: cc >= (float)(RME_TOTALMIX_FADER_CURVE_SIZE - 1) ? RME_TOTALMIX_FADER_CURVE[RME_TOTALMIX_FADER_CURVE_SIZE - 1]
+		: RME_TOTALMIX_FADER_CURVE[(int)cc] + (cc - (float)(int)cc) * (RME_TOTALMIX_FADER_CURVE[(int)cc + 1] - RME_TOTALMIX_FADER_CURVE[(int)cc]);
+}
+
+static_assert(rmeTotalMixCCForDecibels(-64.0f) == 0, "TotalMix fader table must start at CC 0");
+static_assert(rmeTotalMixCCForDecibels(0.0f) == RME_TOTALMIX_FADER_CURVE_SIZE - 1, "TotalMix fader table must end at 0dB");
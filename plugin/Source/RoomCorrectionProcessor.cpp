@@ -0,0 +1,578 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "RoomCorrectionProcessor.h"
+
+#define ROOM_CORRECTION_IDENTITY (2 * MONITOR_ROUTING_NUM_SPEAKER_SETS)		// Filter ID of the pass through filter.
+#define ROOM_CORRECTION_RESAMPLE_ZERO_CROSSINGS 32							// Each side of the resampling filter.
+#define ROOM_CORRECTION_RESAMPLE_CUTOFF 0.95								// Of the lower of the two Nyquist frequencies.
+
+// Band limited resampling by a Blackman windowed sinc, centred on each output tap, so there is no delay.
+// Going down, the sinc is stretched to the new Nyquist frequency, so nothing above it folds back.
+static void resample(const float* input, int numInput, float* output, int numOutput, double speedRatio)
+{
+	const double cutoff = ROOM_CORRECTION_RESAMPLE_CUTOFF * jmin(1.0, 1.0 / speedRatio);	// Of the input rate's Nyquist.
+	const double halfWidth = ROOM_CORRECTION_RESAMPLE_ZERO_CROSSINGS / cutoff;					// Input samples.
+
+	for (int tap = 0; tap < numOutput; tap++)
+	{
+		const double centre = tap * speedRatio;
+		const int first = jmax(0, (int)std::ceil(centre - halfWidth));
+		const int last = jmin(numInput - 1, (int)std::floor(centre + halfWidth));
+		double sum = 0.0;
+
+		for (int i = first; i <= last; i++)
+		{
+			const double x = i - centre;
+			const double sinc = x == 0.0 ? cutoff : std::sin(double_Pi * cutoff * x) / (double_Pi * x);
+			const double phase = double_Pi * (x / halfWidth + 1.0);
+			sum += input[i] * sinc * (0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase));
+		}
+
+		output[tap] = (float)sum;
+	}
+}
+
+RoomCorrectionProcessor::RoomCorrectionProcessor()
+	: Thread("Room correction loader"), historyPosition(0), position(0), speakerSet(-1), targetFilter(ROOM_CORRECTION_IDENTITY),
+	fadeLength(1), filtersInUse(0), sampleRate(44100.0), numChannels(0)
+{
+	for (int set = 0; set < MONITOR_ROUTING_NUM_SPEAKER_SETS; set++)
+	{
+		requestedFilters[set] = 0;
+		activeFilters[set] = 0;
+		loadedLengths[set] = 0;
+		loadedFileTimes[set] = 0;
+	}
+
+	formatManager.registerBasicFormats();
+}
+
+RoomCorrectionProcessor::~RoomCorrectionProcessor()
+{
+	stop();
+}
+
+File RoomCorrectionProcessor::getImpulseResponseFolder()
+{
+	return File::getSpecialLocation(File::userApplicationDataDirectory).getChildFile("DreamControl").getChildFile("Room Correction");
+}
+
+String RoomCorrectionProcessor::getSpeakerSetName(int speakerSet)
+{
+	const char* names[MONITOR_ROUTING_NUM_SPEAKER_SETS] = { "MAIN", "ALT1", "ALT2", "ALT3" };
+	return names[speakerSet];
+}
+
+void RoomCorrectionProcessor::prepareToPlay(double newSampleRate, int newNumChannels)
+{
+	stop();
+
+	const CriticalSection::ScopedLockType sl(designLock);
+
+	sampleRate = newSampleRate;
+	numChannels = newNumChannels;
+	fadeLength = jmax(1, (int)(ROOM_CORRECTION_CROSSFADE_MS * sampleRate / 1000.0));
+
+	// Each segment starts where its output can first be ready: two of its partitions, less the latency.
+	segments.resize(ROOM_CORRECTION_NUM_SEGMENTS);
+	const int latency = getLatencySamples();
+	int partitionSize = ROOM_CORRECTION_FIRST_PARTITION_SIZE;
+
+	for (int s = 0; s < ROOM_CORRECTION_NUM_SEGMENTS; s++)
+	{
+		Segment& segment = segments[s];
+		const int end = s < ROOM_CORRECTION_NUM_SEGMENTS - 1 ? 2 * partitionSize * ROOM_CORRECTION_PARTITION_GROWTH - latency : ROOM_CORRECTION_MAX_IR_SAMPLES;
+
+		segment.partitionSize = partitionSize;
+		segment.offset = s == 0 ? 0 : 2 * partitionSize - latency;
+		segment.maxPartitions = (end - segment.offset + partitionSize - 1) / partitionSize;
+
+		segment.convolution.prepare(partitionSize, ROOM_CORRECTION_MAX_PASS_SIZE);
+
+		segment.channels.resize(numChannels);
+		for (SegmentChannel& channel : segment.channels)
+		{
+			channel.work.assign(segment.convolution.getWorkSize(), 0.0f);
+			channel.spectra.assign(segment.maxPartitions, std::vector<Bin>(segment.convolution.getNumBins()));
+			for (int slot = 0; slot < 2; slot++)
+			{
+				channel.accumulators[slot].assign(segment.convolution.getNumBins(), Bin());
+				channel.results[slot].assign(partitionSize, 0.0f);
+				channel.playing[slot].assign(partitionSize, 0.0f);
+			}
+		}
+
+		partitionSize *= ROOM_CORRECTION_PARTITION_GROWTH;
+	}
+
+	history.assign(numChannels, std::vector<float>(2 * segments.back().partitionSize, 0.0f));
+
+	// Everything passes through until the files are loaded again, at this sample rate.
+	designIdentity(identity);
+	for (int set = 0; set < MONITOR_ROUTING_NUM_SPEAKER_SETS; set++)
+	{
+		designIdentity(filters[set][0]);
+		designIdentity(filters[set][1]);
+		requestedFilters[set] = 0;
+		activeFilters[set] = 0;
+		loadedLengths[set] = 0;
+		loadedFileTimes[set] = 0;
+	}
+
+	speakerSet = -1;
+	targetFilter = ROOM_CORRECTION_IDENTITY;
+	reset();
+}
+
+void RoomCorrectionProcessor::startLoading()
+{
+	startThread();
+}
+
+void RoomCorrectionProcessor::stop()
+{
+	stopThread(-1);
+}
+
+//==============================================================================
+// Loading and design.
+
+void RoomCorrectionProcessor::run()
+{
+	while (!threadShouldExit())
+	{
+		for (int set = 0; set < MONITOR_ROUTING_NUM_SPEAKER_SETS && !threadShouldExit(); set++)
+			loadFile(set);
+
+		wait(ROOM_CORRECTION_POLL_MS);
+	}
+}
+
+void RoomCorrectionProcessor::loadFile(int set)
+{
+	// Files are only read when they change, or appear or disappear.
+	const File file = getImpulseResponseFolder().getChildFile(getSpeakerSetName(set) + ".wav");
+	const int64 fileTime = file.existsAsFile() ? file.getLastModificationTime().toMilliseconds() : 0;
+	if (fileTime == loadedFileTimes[set])
+		return;
+
+	AudioSampleBuffer impulseResponse;
+	double impulseResponseSampleRate = sampleRate;
+
+	if (fileTime != 0)
+	{
+		std::unique_ptr<AudioFormatReader> reader(formatManager.createReaderFor(file));
+		if (reader == nullptr || reader->numChannels == 0)
+		{
+			// Not tried again until it changes: it may still be being written.
+			Logger::writeToLog("DreamControl: can't read room correction file " + file.getFullPathName());
+			loadedFileTimes[set] = fileTime;
+			return;
+		}
+
+		const int64 maxLength = (int64)std::ceil(ROOM_CORRECTION_MAX_IR_SAMPLES * reader->sampleRate / sampleRate);
+		const int length = (int)jmin(reader->lengthInSamples, maxLength);
+		impulseResponse.setSize((int)reader->numChannels, length);
+		reader->read(&impulseResponse, 0, length, 0, true, true);
+		impulseResponseSampleRate = reader->sampleRate;
+	}
+
+	// If the audio thread is still fading from the other filter, this is tried again at the next poll.
+	if (!setImpulseResponse(set, impulseResponse, impulseResponseSampleRate))
+		return;
+
+	loadedFileTimes[set] = fileTime;
+
+	if (fileTime != 0)
+		Logger::writeToLog("DreamControl: room correction for " + getSpeakerSetName(set) + " loaded, " + String(getImpulseResponseLength(set)) + " taps");
+	else
+		Logger::writeToLog("DreamControl: room correction for " + getSpeakerSetName(set) + " removed");
+}
+
+bool RoomCorrectionProcessor::setImpulseResponse(int set, const AudioSampleBuffer& impulseResponse, double impulseResponseSampleRate)
+{
+	const CriticalSection::ScopedLockType sl(designLock);
+
+	// The filter the audio thread isn't playing, once it has picked up the last one and finished fading from this one.
+	const int active = activeFilters[set].load(std::memory_order_acquire);
+	if (segments.empty() || requestedFilters[set].load(std::memory_order_relaxed) != active)
+		return false;
+
+	const int free = 1 - active;
+	if ((filtersInUse.load(std::memory_order_acquire) & (1u << (set * 2 + free))) != 0)
+		return false;
+
+	int length = jmin(impulseResponse.getNumSamples(), (int)ROOM_CORRECTION_MAX_IR_SAMPLES);
+
+	if (length == 0)
+	{
+		designIdentity(filters[set][free]);
+	}
+	else if (impulseResponseSampleRate == sampleRate)
+	{
+		design(filters[set][free], impulseResponse, length);
+	}
+	else
+	{
+		// Resampled, and scaled so the frequency response stays the same: the taps are closer together, or
+		// further apart. The band limited filter rings either side of each tap, and what would ring
+		// before the first one is cut.
+		const double speedRatio = impulseResponseSampleRate / sampleRate;
+		length = jmin((int)std::ceil(impulseResponse.getNumSamples() / speedRatio), (int)ROOM_CORRECTION_MAX_IR_SAMPLES);
+
+		AudioSampleBuffer resampled(impulseResponse.getNumChannels(), length);
+
+		for (int chan = 0; chan < impulseResponse.getNumChannels(); chan++)
+		{
+			resample(impulseResponse.getReadPointer(chan), impulseResponse.getNumSamples(), resampled.getWritePointer(chan), length, speedRatio);
+			resampled.applyGain(chan, 0, length, (float)speedRatio);
+		}
+
+		design(filters[set][free], resampled, length);
+	}
+
+	loadedLengths[set] = filters[set][free].length;
+	requestedFilters[set].store(free, std::memory_order_release);
+	return true;
+}
+
+void RoomCorrectionProcessor::designIdentity(Filter& filter)
+{
+	// A unit impulse: one partition of the first segment, flat.
+	filter.spectra.resize(numChannels);
+	for (auto& channelSpectra : filter.spectra)
+	{
+		channelSpectra.resize(segments.size());
+		for (size_t s = 0; s < segments.size(); s++)
+			channelSpectra[s].clear();
+
+		if (!segments.empty())
+			channelSpectra[0].assign(1, std::vector<Bin>(segments[0].partitionSize + 1, Bin(1.0f, 0.0f)));
+	}
+
+	filter.length = 0;
+}
+
+void RoomCorrectionProcessor::design(Filter& filter, const AudioSampleBuffer& impulseResponse, int length)
+{
+	filter.spectra.resize(numChannels);
+
+	for (int chan = 0; chan < numChannels; chan++)
+	{
+		// A mono response is used for every channel.
+		const float* taps = impulseResponse.getReadPointer(jmin(chan, impulseResponse.getNumChannels() - 1));
+		filter.spectra[chan].resize(segments.size());
+
+		for (size_t s = 0; s < segments.size(); s++)
+		{
+			const Segment& segment = segments[s];
+			const int partitionSize = segment.partitionSize;
+			const int numPartitions = jlimit(0, segment.maxPartitions, (length - segment.offset + partitionSize - 1) / partitionSize);
+			std::vector<std::vector<Bin>>& spectra = filter.spectra[chan][s];
+			spectra.resize(numPartitions);
+
+			for (int partition = 0; partition < numPartitions; partition++)
+			{
+				const int start = segment.offset + partition * partitionSize;
+
+				spectra[partition].resize(segment.convolution.getNumBins());
+				segment.convolution.transformPartition(taps + start, jmin(partitionSize, length - start), spectra[partition].data());
+			}
+		}
+	}
+
+	filter.length = length;
+}
+
+//==============================================================================
+// Convolution, on the audio thread.
+
+const RoomCorrectionProcessor::Filter& RoomCorrectionProcessor::getFilter(int filterId) const
+{
+	return filterId == ROOM_CORRECTION_IDENTITY ? identity : filters[filterId / 2][filterId % 2];
+}
+
+void RoomCorrectionProcessor::reset()
+{
+	for (Segment& segment : segments)
+	{
+		for (SegmentChannel& channel : segment.channels)
+		{
+			for (auto& spectrum : channel.spectra)
+				std::fill(spectrum.begin(), spectrum.end(), Bin());
+			for (int slot = 0; slot < 2; slot++)
+			{
+				std::fill(channel.results[slot].begin(), channel.results[slot].end(), 0.0f);
+				std::fill(channel.playing[slot].begin(), channel.playing[slot].end(), 0.0f);
+			}
+		}
+
+		segment.spectraPosition = 0;
+		segment.ticks = 0;
+		segment.stepsDone = 0;
+		segment.numSteps = 0;
+		segment.numPartitions = 0;
+		segment.slotFilters[0] = segment.slotFilters[1] = -1;
+		segment.slotValid[0] = segment.slotValid[1] = false;
+		segment.currentSlot = 0;
+		segment.fadePosition = -1;
+	}
+
+	for (auto& channelHistory : history)
+		std::fill(channelHistory.begin(), channelHistory.end(), 0.0f);
+
+	historyPosition = 0;
+	position = 0;
+	filtersInUse.store(0, std::memory_order_release);
+}
+
+void RoomCorrectionProcessor::setSpeakerSet(int newSpeakerSet)
+{
+	speakerSet = newSpeakerSet;
+}
+
+void RoomCorrectionProcessor::process(AudioSampleBuffer& buffer)
+{
+	if (segments.empty())
+		return;
+
+	// Pick up new filters, for every set, so the loader can carry on. setImpulseResponse() won't touch
+	// these until the next ones are picked up.
+	for (int set = 0; set < MONITOR_ROUTING_NUM_SPEAKER_SETS; set++)
+		activeFilters[set].store(requestedFilters[set].load(std::memory_order_acquire), std::memory_order_release);
+
+	targetFilter = speakerSet >= 0 ? speakerSet * 2 + activeFilters[speakerSet].load(std::memory_order_relaxed) : ROOM_CORRECTION_IDENTITY;
+
+	const int firstPartitionSize = ROOM_CORRECTION_FIRST_PARTITION_SIZE;
+	const int numSamples = buffer.getNumSamples();
+	const int numBufferChannels = jmin(buffer.getNumChannels(), numChannels);
+	const int historySize = history.empty() ? 0 : (int)history[0].size();
+
+	// Samples go into the history, and come out of each segment's playing partition.
+	for (int done = 0; done < numSamples;)
+	{
+		const int count = jmin(numSamples - done, firstPartitionSize - position);
+
+		for (int chan = 0; chan < numBufferChannels; chan++)
+		{
+			float* data = buffer.getWritePointer(chan, done);
+			FloatVectorOperations::copy(history[chan].data() + historyPosition, data, count);
+			FloatVectorOperations::clear(data, count);
+
+			for (Segment& segment : segments)
+				addOutput(segment, chan, data, segment.ticks * firstPartitionSize + position, count);
+		}
+
+		for (Segment& segment : segments)
+		{
+			if (segment.fadePosition < 0)
+				continue;
+
+			// Fade done: the old slot stops being computed.
+			segment.fadePosition += count;
+			if (segment.fadePosition >= fadeLength)
+			{
+				const int oldSlot = segment.currentSlot;
+				segment.currentSlot = 1 - oldSlot;
+				segment.slotFilters[oldSlot] = -1;
+				segment.slotValid[oldSlot] = false;
+				segment.fadePosition = -1;
+			}
+		}
+
+		historyPosition = (historyPosition + count) % historySize;
+		position += count;
+		done += count;
+
+		if (position == firstPartitionSize)
+		{
+			position = 0;
+			tick();
+		}
+	}
+
+	// Filters any slot still uses, so the loader leaves them alone.
+	uint32 inUse = 0;
+	for (const Segment& segment : segments)
+		for (int slot = 0; slot < 2; slot++)
+			if (segment.slotFilters[slot] >= 0)
+				inUse |= 1u << segment.slotFilters[slot];
+
+	filtersInUse.store(inUse, std::memory_order_release);
+}
+
+void RoomCorrectionProcessor::addOutput(const Segment& segment, int chan, float* output, int playPosition, int numSamples)
+{
+	const SegmentChannel& channel = segment.channels[chan];
+	const int current = segment.currentSlot;
+
+	if (segment.fadePosition < 0)
+	{
+		if (segment.slotValid[current])
+			FloatVectorOperations::add(output, channel.playing[current].data() + playPosition, numSamples);
+		return;
+	}
+
+	// Linear, as both are the same input filtered.
+	const float* from = channel.playing[current].data() + playPosition;
+	const float* to = channel.playing[1 - current].data() + playPosition;
+
+	for (int i = 0; i < numSamples; i++)
+	{
+		const float fade = jmin(1.0f, (float)(segment.fadePosition + i) / (float)fadeLength);
+		output[i] += from[i] + fade * (to[i] - from[i]);
+	}
+}
+
+void RoomCorrectionProcessor::tick()
+{
+	for (int s = 0; s < (int)segments.size(); s++)
+	{
+		Segment& segment = segments[s];
+		const int ticksPerPartition = segment.partitionSize / ROOM_CORRECTION_FIRST_PARTITION_SIZE;
+
+		// Enough of the work to be this far through the partition.
+		segment.ticks++;
+		const int steps = (segment.numSteps * segment.ticks + ticksPerPartition - 1) / ticksPerPartition;
+		while (segment.stepsDone < steps)
+			doStep(s, segment.stepsDone++);
+
+		if (segment.ticks < ticksPerPartition)
+			continue;
+
+		// What was computed plays next. A slot's first output starts the fade to it.
+		for (int slot = 0; slot < 2; slot++)
+		{
+			if (segment.slotFilters[slot] < 0)
+				continue;
+
+			for (SegmentChannel& channel : segment.channels)
+				std::swap(channel.results[slot], channel.playing[slot]);
+			segment.slotValid[slot] = true;
+		}
+
+		const int other = 1 - segment.currentSlot;
+		if (segment.fadePosition < 0 && segment.slotFilters[other] >= 0 && segment.slotValid[other])
+			segment.fadePosition = 0;
+
+		segment.ticks = 0;
+		startPartition(s);
+	}
+}
+
+void RoomCorrectionProcessor::startPartition(int s)
+{
+	Segment& segment = segments[s];
+	const int partitionSize = segment.partitionSize;
+	const int historySize = (int)history[0].size();
+
+	// The last two partitions of input, for the forward transforms.
+	const int start = (historyPosition - 2 * partitionSize + historySize) % historySize;
+	const int firstPart = jmin(2 * partitionSize, historySize - start);
+
+	for (int chan = 0; chan < numChannels; chan++)
+	{
+		float* work = segment.channels[chan].work.data();
+		FloatVectorOperations::copy(work, history[chan].data() + start, firstPart);
+		FloatVectorOperations::copy(work + firstPart, history[chan].data(), 2 * partitionSize - firstPart);
+	}
+
+	segment.spectraPosition = (segment.spectraPosition + 1) % segment.maxPartitions;
+
+	// The speaker set's filter, straight in if nothing is playing yet, otherwise into the other slot to fade to.
+	// One fade at a time: a change during a fade waits for it to finish.
+	int& current = segment.slotFilters[segment.currentSlot];
+	int& other = segment.slotFilters[1 - segment.currentSlot];
+
+	if (current < 0)
+	{
+		current = targetFilter;
+	}
+	else if (targetFilter != current && other < 0)
+	{
+		other = targetFilter;
+		segment.slotValid[1 - segment.currentSlot] = false;
+	}
+
+	segment.numPartitions = 0;
+	for (int slot = 0; slot < 2; slot++)
+		if (segment.slotFilters[slot] >= 0)
+			segment.numPartitions = jmax(segment.numPartitions, (int)getFilter(segment.slotFilters[slot]).spectra[0][s].size());
+
+	// A forward transform per channel, a multiply-add per partition, and an inverse transform per slot and
+	// channel. Each transform is one step per pass.
+	const int numPasses = segment.convolution.getNumPasses();
+	segment.numSteps = numChannels * numPasses + segment.numPartitions + 2 * numChannels * numPasses;
+	segment.stepsDone = 0;
+}
+
+void RoomCorrectionProcessor::doStep(int s, int step)
+{
+	Segment& segment = segments[s];
+	const int numBins = segment.convolution.getNumBins();
+	const int numPasses = segment.convolution.getNumPasses();
+
+	if (step < numChannels * numPasses)
+	{
+		// Every segment keeps transforming its input, even with no filter using it, so a new one has the history.
+		SegmentChannel& channel = segment.channels[step / numPasses];
+		const int pass = step % numPasses;
+		segment.convolution.forwardPass(channel.work.data(), channel.spectra[segment.spectraPosition].data(), pass);
+
+		if (pass == 0)
+			for (int slot = 0; slot < 2; slot++)
+				std::fill(channel.accumulators[slot].begin(), channel.accumulators[slot].end(), Bin());
+		return;
+	}
+
+	step -= numChannels * numPasses;
+	if (step < segment.numPartitions)
+	{
+		// Each partition of the filter meets the input that many partitions back.
+		const int delayed = (segment.spectraPosition - step + segment.maxPartitions) % segment.maxPartitions;
+
+		for (int slot = 0; slot < 2; slot++)
+		{
+			if (segment.slotFilters[slot] < 0)
+				continue;
+
+			const Filter& filter = getFilter(segment.slotFilters[slot]);
+			for (int chan = 0; chan < numChannels; chan++)
+			{
+				const std::vector<std::vector<Bin>>& filterSpectra = filter.spectra[chan][s];
+				if (step < (int)filterSpectra.size())
+					PartitionedConvolution::multiplyAdd(segment.channels[chan].accumulators[slot].data(), segment.channels[chan].spectra[delayed].data(), filterSpectra[step].data(), numBins);
+			}
+		}
+		return;
+	}
+
+	step -= segment.numPartitions;
+	const int slot = step / (numChannels * numPasses);
+	SegmentChannel& channel = segment.channels[step / numPasses % numChannels];
+	const int pass = step % numPasses;
+	if (segment.slotFilters[slot] < 0)
+		return;
+
+	if (getFilter(segment.slotFilters[slot]).spectra[0][s].empty())
+	{
+		if (pass == 0)
+			std::fill(channel.results[slot].begin(), channel.results[slot].end(), 0.0f);
+		return;
+	}
+
+	segment.convolution.inversePass(channel.accumulators[slot].data(), channel.work.data(), channel.results[slot].data(), pass);
+}
@@ -0,0 +1,174 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include <JuceHeader.h>
+
+#include "MonitorRouting.h"
+#include "PartitionedConvolution.h"
+
+#define ROOM_CORRECTION_FIRST_PARTITION_SIZE 64			// Samples. The latency is two of these: 2.7 ms at 48 kHz.
+#define ROOM_CORRECTION_PARTITION_GROWTH 8				// Each segment's partitions are this much longer than the last's.
+#define ROOM_CORRECTION_NUM_SEGMENTS 3					// 64, 512 and 4096 sample partitions.
+#define ROOM_CORRECTION_MAX_PASS_SIZE 512				// Longer partitions' transforms are split into passes of this size.
+#define ROOM_CORRECTION_MAX_IR_SAMPLES 131072			// Longer impulse responses are cut short.
+#define ROOM_CORRECTION_CROSSFADE_MS 20.0				// As SpeakerSetProcessor, so trim and correction switch together.
+#define ROOM_CORRECTION_POLL_MS 1000					// How often the impulse response files are checked for changes.
+
+//==============================================================================
+/**
+	Room correction: each speaker set's output is convolved with its own impulse
+	response, loaded from MAIN.wav, ALT1.wav, ALT2.wav and ALT3.wav in
+	getImpulseResponseFolder(). Sets with no file pass through, delayed by the same
+	latency, so the latency reported to the host doesn't change with the speakers.
+
+	Non-uniform partitioned convolution: the impulse response is split into segments
+	of 64, 512 and 4096 sample partitions, each convolved by overlap-save
+	(PartitionedConvolution) with its own frequency domain delay line. A segment's
+	work for a partition of input (a forward transform per channel, a multiply-add per
+	partition of the filter, an inverse transform per channel) is spread in steps over
+	the next partition's worth of samples, and its output plays in the one after. So
+	each segment starts two of its partitions, less the latency, into the response.
+	The 4096 sample partitions' transforms are split into passes no bigger than a 512
+	sample partition's transform (see PartitionedConvolution), each its own step, so
+	no 64 sample tick has a whole 8192 point transform to do.
+
+	The delay lines only depend on the input, so a new filter has the whole history
+	to work with: switching speaker sets (or loading a new file for the set playing)
+	computes both filters from the same spectra and crossfades between them. Each
+	segment fades as soon as it has the new filter's output, so the start of the
+	response switches within a few milliseconds and the later parts follow.
+
+	Files are read, resampled to the session's rate and transformed on a background
+	thread, which polls the folder and reloads files that change. Each speaker set
+	has two filters: the audio thread plays one, the loader writes into the other once
+	nothing is fading from it, and the audio thread picks it up at its next block.
+*/
+class RoomCorrectionProcessor : private Thread
+{
+public:
+	RoomCorrectionProcessor();
+	~RoomCorrectionProcessor();
+
+	// Not real-time: stops the loader, and allocates for the sample rate. Every speaker set passes through
+	// until its impulse response is loaded again.
+	void prepareToPlay(double sampleRate, int numChannels);
+
+	// Not real-time: starts or stops loading files from the folder, in the background.
+	void startLoading();
+	void stop();
+
+	// Not real-time, any thread but the audio thread, after prepareToPlay. Designs a speaker set's filter
+	// from an impulse response, one channel per output channel (or one for all), resampled if need be.
+	// Returns false if the audio thread is still fading from the set's other filter: try again later.
+	bool setImpulseResponse(int speakerSet, const AudioSampleBuffer& impulseResponse, double impulseResponseSampleRate);
+
+	// Audio thread.
+	void reset();
+	void setSpeakerSet(int speakerSet);		// -1 for none: passes through.
+	void process(AudioSampleBuffer& buffer);
+
+	int getLatencySamples() const { return 2 * ROOM_CORRECTION_FIRST_PARTITION_SIZE; }
+
+	// Any thread. The taps in a speaker set's impulse response, 0 if it has none.
+	int getImpulseResponseLength(int speakerSet) const { return loadedLengths[speakerSet].load(std::memory_order_relaxed); }
+
+	static File getImpulseResponseFolder();
+	static String getSpeakerSetName(int speakerSet);
+
+private:
+	typedef PartitionedConvolution::Bin Bin;
+
+	// A speaker set's filter: [channel][segment][partition][bin]. Short responses have fewer partitions
+	// in the last segments, or none.
+	struct Filter
+	{
+		std::vector<std::vector<std::vector<std::vector<Bin>>>> spectra;
+		int length;
+	};
+
+	struct SegmentChannel
+	{
+		std::vector<float> work;				// The transforms' buffer: the captured input, then each slot's output.
+		std::vector<std::vector<Bin>> spectra;	// Frequency domain delay line: transformed inputs, one per partition.
+		std::vector<Bin> accumulators[2];		// Per slot.
+		std::vector<float> results[2];			// Per slot: computed this partition, played in the next.
+		std::vector<float> playing[2];
+	};
+
+	// Partitions of one size. Slots are the filters being computed: one, or two while crossfading.
+	struct Segment
+	{
+		int partitionSize;
+		int offset;								// Where its partitions start in the impulse response.
+		int maxPartitions;
+		PartitionedConvolution convolution;
+		std::vector<SegmentChannel> channels;
+		int spectraPosition;					// Newest input in the delay lines.
+
+		int ticks;								// Smallest partitions into this partition.
+		int stepsDone;
+		int numSteps;							// The work for this partition, spread over its ticks.
+		int numPartitions;						// The most any slot's filter has here.
+
+		int slotFilters[2];						// Filter IDs, -1 for none.
+		bool slotValid[2];						// The slot's output is playing.
+		int currentSlot;
+		int fadePosition;						// Samples into the fade to the other slot, -1 if not fading.
+	};
+
+	void run() override;
+	void loadFile(int speakerSet);
+
+	void designIdentity(Filter& filter);
+	void design(Filter& filter, const AudioSampleBuffer& impulseResponse, int length);
+
+	const Filter& getFilter(int filterId) const;
+	void tick();
+	void startPartition(int segment);
+	void doStep(int segment, int step);
+	void addOutput(const Segment& segment, int chan, float* output, int playPosition, int numSamples);
+
+	std::vector<Segment> segments;
+	std::vector<std::vector<float>> history;	// The last two of the largest partitions of input, per channel.
+	int historyPosition;
+	int position;								// Samples into the smallest partition.
+	int speakerSet;
+	int targetFilter;							// The speaker set's filter ID, as of this block.
+	int fadeLength;
+
+	// [speakerSet][2]: the audio thread plays activeFilters, the loader writes into the other. Filter IDs
+	// are speakerSet * 2 + index, and filtersInUse has a bit set for each one any slot still uses.
+	Filter filters[MONITOR_ROUTING_NUM_SPEAKER_SETS][2];
+	Filter identity;
+	std::atomic<int> requestedFilters[MONITOR_ROUTING_NUM_SPEAKER_SETS];
+	std::atomic<int> activeFilters[MONITOR_ROUTING_NUM_SPEAKER_SETS];
+	std::atomic<uint32> filtersInUse;
+	std::atomic<int> loadedLengths[MONITOR_ROUTING_NUM_SPEAKER_SETS];
+
+	// Design, on the loader or any other thread but the audio thread.
+	CriticalSection designLock;
+	int64 loadedFileTimes[MONITOR_ROUTING_NUM_SPEAKER_SETS];	// Modification time of each file loaded, 0 for none.
+	AudioFormatManager formatManager;
+
+	double sampleRate;
+	int numChannels;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RoomCorrectionProcessor)
+};
@@ -0,0 +1,158 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "SpeakerSetProcessor.h"
+
+#define SPEAKER_SET_CROSSFADE_MS 20.0
+
+SpeakerSetProcessor::SpeakerSetProcessor()
+	: delayLineMask(0), writePosition(0), maxDelaySamples(0.0f), fadeLength(1), fadeSamplesRemaining(0), sampleRate(44100.0)
+{
+	current = previous = target = { 1.0f, 0.0f };
+}
+
+void SpeakerSetProcessor::prepareToPlay(double newSampleRate, int numChannels, float maxDelayMs)
+{
+	sampleRate = newSampleRate;
+	maxDelaySamples = (float)(maxDelayMs * sampleRate / 1000.0);
+	fadeLength = jmax(1, (int)(SPEAKER_SET_CROSSFADE_MS * sampleRate / 1000.0));
+
+	// Power of 2 size so we can wrap with a mask. Extra samples for the interpolator taps.
+	int size = 1;
+	while (size < (int)maxDelaySamples + 8)
+		size <<= 1;
+
+	delayLine.setSize(numChannels, size);
+	delayLineMask = size - 1;
+
+	reset();
+}
+
+void SpeakerSetProcessor::reset()
+{
+	delayLine.clear();
+	writePosition = 0;
+	current = previous = target;
+	fadeSamplesRemaining = 0;
+}
+
+void SpeakerSetProcessor::setTarget(float trimDb, float delayMs)
+{
+	target.gain = Decibels::decibelsToGain(trimDb);
+	target.delaySamples = jlimit(0.0f, maxDelaySamples, (float)(delayMs * sampleRate / 1000.0));
+}
+
+void SpeakerSetProcessor::process(AudioSampleBuffer& buffer, float gain)
+{
+	const int numSamples = buffer.getNumSamples();
+	const int numChannels = jmin(buffer.getNumChannels(), delayLine.getNumChannels());
+
+	// Start a crossfade to the new setting. If one is already running, the new setting waits until it's finished.
+	if (fadeSamplesRemaining == 0 && target != current)
+	{
+		previous = current;
+		current = target;
+		fadeSamplesRemaining = fadeLength;
+	}
+
+	const Taps currentTaps = makeTaps(current.delaySamples);
+	const Taps previousTaps = makeTaps(previous.delaySamples);
+	const float currentGain = current.gain * gain;
+	const float previousGain = previous.gain * gain;
+	int fadeRemaining = fadeSamplesRemaining;
+
+	for (int chan = 0; chan < numChannels; chan++)
+	{
+		float* data = buffer.getWritePointer(chan);
+		float* line = delayLine.getWritePointer(chan);
+		int position = writePosition;
+		fadeRemaining = fadeSamplesRemaining;
+
+		if (fadeRemaining == 0 && current.delaySamples == 0.0f)
+		{
+			// No delay and no crossfade: just keep the delay line fed, and apply gain.
+			for (int sample = 0; sample < numSamples; ++sample)
+			{
+				line[position] = data[sample];
+				position = (position + 1) & delayLineMask;
+			}
+
+			FloatVectorOperations::multiply(data, currentGain, numSamples);
+			continue;
+		}
+
+		for (int sample = 0; sample < numSamples; ++sample)
+		{
+			line[position] = data[sample];
+
+			float y = readDelayed(line, position, currentTaps) * currentGain;
+
+			if (fadeRemaining > 0)
+			{
+				const float oldAmount = (float)fadeRemaining / (float)fadeLength;
+				const float yOld = readDelayed(line, position, previousTaps) * previousGain;
+				y += oldAmount * (yOld - y);
+				fadeRemaining--;
+			}
+
+			data[sample] = y;
+			position = (position + 1) & delayLineMask;
+		}
+	}
+
+	writePosition = (writePosition + numSamples) & delayLineMask;
+	fadeSamplesRemaining = numChannels > 0 ? fadeRemaining : 0;
+
+	// Any channels we don't have a delay line for just get the gain.
+	for (int chan = numChannels; chan < buffer.getNumChannels(); chan++)
+		buffer.applyGain(chan, 0, numSamples, currentGain);
+}
+
+SpeakerSetProcessor::Taps SpeakerSetProcessor::makeTaps(float delaySamples)
+{
+	Taps taps;
+
+	if (delaySamples < 1.0f)
+	{
+		// Linear interpolation between the newest two samples.
+		taps.offset = 0;
+		taps.h[0] = 1.0f - delaySamples;
+		taps.h[1] = delaySamples;
+		taps.h[2] = 0.0f;
+		taps.h[3] = 0.0f;
+	}
+	else
+	{
+		// 3rd order Lagrange interpolation, with the fractional part kept between 1 and 2 samples where it is most accurate.
+		taps.offset = (int)delaySamples - 1;
+		const float d = delaySamples - (float)taps.offset;
+		taps.h[0] = -(d - 1.0f) * (d - 2.0f) * (d - 3.0f) / 6.0f;
+		taps.h[1] = d * (d - 2.0f) * (d - 3.0f) / 2.0f;
+		taps.h[2] = -d * (d - 1.0f) * (d - 3.0f) / 2.0f;
+		taps.h[3] = d * (d - 1.0f) * (d - 2.0f) / 6.0f;
+	}
+
+	return taps;
+}
+
+inline float SpeakerSetProcessor::readDelayed(const float* line, int position, const Taps& taps) const
+{
+	const int p = position - taps.offset;
+
+	return taps.h[0] * line[p & delayLineMask]
+		+ taps.h[1] * line[(p - 1) & delayLineMask]
+		+ taps.h[2] * line[(p - 2) & delayLineMask]
+		+ taps.h[3] * line[(p - 3) & delayLineMask];
+}
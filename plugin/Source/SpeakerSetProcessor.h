@@ -0,0 +1,75 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+	Per speaker set calibration: gain trim and fractional delay for time alignment.
+
+	Whenever the trim or delay changes (e.g. switching between MAIN/ALT1/ALT2/ALT3),
+	the old and new settings are crossfaded so there are no clicks. The delay line is
+	always fed, so switching to a delayed set never plays stale audio.
+*/
+class SpeakerSetProcessor
+{
+public:
+	SpeakerSetProcessor();
+
+	void prepareToPlay(double sampleRate, int numChannels, float maxDelayMs);
+	void reset();
+
+	// Set the trim and delay to use from the next block.
+	void setTarget(float trimDb, float delayMs);
+
+	// Applies delay, trim and the extra gain (e.g. monitor level) in one pass.
+	void process(AudioSampleBuffer& buffer, float gain);
+
+private:
+	struct Setting
+	{
+		float gain;
+		float delaySamples;
+
+		bool operator!= (const Setting& other) const { return gain != other.gain || delaySamples != other.delaySamples; }
+	};
+
+	// Fractional delay read taps: y = sum(h[k] * x[n - offset - k]).
+	struct Taps
+	{
+		int offset;
+		float h[4];
+	};
+
+	static Taps makeTaps(float delaySamples);
+	inline float readDelayed(const float* line, int position, const Taps& taps) const;
+
+	AudioSampleBuffer delayLine;
+	int delayLineMask;
+	int writePosition;
+	float maxDelaySamples;
+
+	Setting current;
+	Setting previous;
+	Setting target;
+	int fadeLength;
+	int fadeSamplesRemaining;
+
+	double sampleRate;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpeakerSetProcessor)
+};
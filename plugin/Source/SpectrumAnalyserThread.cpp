@@ -0,0 +1,158 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "SpectrumAnalyserThread.h"
+
+SpectrumAnalyserThread::SpectrumAnalyserThread()
+	: Thread("Spectrum analyser"), historyPosition(0), powerScale(0.0f), sampleRate(44100.0), msSinceLastFrame(0.0),
+	frameRate(0.0f), numFrames(0)
+{
+	for (auto& level : bandLevels)
+		level = SPECTRUM_ANALYSER_MIN_DB;
+}
+
+SpectrumAnalyserThread::~SpectrumAnalyserThread()
+{
+	stop();
+}
+
+float SpectrumAnalyserThread::getBandCentreFrequency(int band)
+{
+	// Base 2 third octaves (IEC 61260), 1 kHz is band 17.
+	return 1000.0f * std::pow(2.0f, (float)(band - 17) / 3.0f);
+}
+
+void SpectrumAnalyserThread::prepareToPlay(double newSampleRate, int numChannels)
+{
+	stop();
+
+	sampleRate = newSampleRate;
+
+	fifo.prepare(numChannels, (int)(SPECTRUM_ANALYSER_FIFO_SECONDS * sampleRate));
+
+	fft = std::make_unique<dsp::FFT>(SPECTRUM_ANALYSER_FFT_ORDER);
+	const int fftSize = fft->getSize();
+	history.assign(fftSize, 0.0f);
+	historyPosition = 0;
+	fftData.assign(2 * fftSize, 0.0f);
+
+	// Periodic Hann window. The power scale makes a full scale sine read 0 dB: its power,
+	// spread over the main lobe, sums to N * sum(w^2) / 4 over the positive bins.
+	window.resize(fftSize);
+	double windowPower = 0.0;
+	for (int i = 0; i < fftSize; i++)
+	{
+		window[i] = 0.5f - 0.5f * std::cos(2.0f * float_Pi * (float)i / (float)fftSize);
+		windowPower += window[i] * window[i];
+	}
+	powerScale = (float)(4.0 / (fftSize * windowPower));
+
+	// Each band takes the bins it overlaps, in proportion. Low bands are narrower than a bin.
+	const double binWidth = sampleRate / fftSize;
+	bandBins.clear();
+	for (int band = 0; band < SPECTRUM_ANALYSER_NUM_BANDS; band++)
+	{
+		const double centre = getBandCentreFrequency(band);
+		const double low = centre * std::pow(2.0, -1.0 / 6.0);
+		const double high = jmin(centre * std::pow(2.0, 1.0 / 6.0), sampleRate / 2.0);
+
+		for (int bin = jmax(1, (int)(low / binWidth + 0.5)); bin <= fftSize / 2 && (bin - 0.5) * binWidth < high; bin++)
+		{
+			const double overlap = jmin(high, (bin + 0.5) * binWidth) - jmax(low, (bin - 0.5) * binWidth);
+			if (overlap > 0.0)
+				bandBins.push_back({ band, bin, (float)(overlap / binWidth) });
+		}
+	}
+
+	bandPowers.assign(SPECTRUM_ANALYSER_NUM_BANDS, 0.0);
+	for (auto& level : bandLevels)
+		level = SPECTRUM_ANALYSER_MIN_DB;
+	msSinceLastFrame = 0.0;
+
+	startThread();
+}
+
+void SpectrumAnalyserThread::stop()
+{
+	stopThread(-1);
+}
+
+void SpectrumAnalyserThread::run()
+{
+	while (!threadShouldExit())
+	{
+		wait(SPECTRUM_ANALYSER_POLL_MS);
+		drainFifo();
+
+		const float framesPerSecond = frameRate.load(std::memory_order_relaxed);
+		msSinceLastFrame += SPECTRUM_ANALYSER_POLL_MS;
+
+		if (framesPerSecond > 0.0f && msSinceLastFrame >= 1000.0 / framesPerSecond)
+		{
+			msSinceLastFrame = 0.0;
+			analyseFrame();
+		}
+	}
+}
+
+void SpectrumAnalyserThread::drainFifo()
+{
+	const int fftSize = (int)history.size();
+	const int numChannels = fifo.getNumChannels();
+	const float gain = 1.0f / (float)jmax(1, numChannels);
+
+	// Mixed to mono into the history.
+	fifo.read([&](AudioSampleBuffer& block)
+	{
+		for (int sample = 0; sample < block.getNumSamples(); sample++)
+		{
+			float mono = 0.0f;
+			for (int chan = 0; chan < numChannels; chan++)
+				mono += block.getSample(chan, sample);
+
+			history[historyPosition] = mono * gain;
+			historyPosition = (historyPosition + 1) % fftSize;
+		}
+	});
+}
+
+void SpectrumAnalyserThread::analyseFrame()
+{
+	const int fftSize = (int)history.size();
+
+	// Oldest sample first.
+	for (int i = 0; i < fftSize; i++)
+		fftData[i] = history[(historyPosition + i) % fftSize] * window[i];
+	std::fill(fftData.begin() + fftSize, fftData.end(), 0.0f);
+
+	fft->performFrequencyOnlyForwardTransform(fftData.data());
+
+	double framePowers[SPECTRUM_ANALYSER_NUM_BANDS] = {};
+	for (const BandBin& bandBin : bandBins)
+		framePowers[bandBin.band] += bandBin.weight * fftData[bandBin.bin] * fftData[bandBin.bin];
+
+	// Average over frames, with the same time constant whatever the frame rate.
+	const double frameMs = 1000.0 / jmax(0.001f, frameRate.load(std::memory_order_relaxed));
+	const double average = 1.0 - std::exp(-frameMs / SPECTRUM_ANALYSER_AVERAGE_MS);
+
+	for (int band = 0; band < SPECTRUM_ANALYSER_NUM_BANDS; band++)
+	{
+		bandPowers[band] += average * (framePowers[band] * powerScale - bandPowers[band]);
+		bandLevels[band].store(bandPowers[band] > 0.0 ? jmax(SPECTRUM_ANALYSER_MIN_DB, (float)(10.0 * std::log10(bandPowers[band]))) : SPECTRUM_ANALYSER_MIN_DB,
+			std::memory_order_relaxed);
+	}
+
+	numFrames.fetch_add(1, std::memory_order_release);
+}
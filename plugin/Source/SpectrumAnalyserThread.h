@@ -0,0 +1,104 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <JuceHeader.h>
+#include "MultichannelBlockFifo.h"
+
+#define SPECTRUM_ANALYSER_FFT_ORDER 13					// 8192 points: 5.9 Hz bins at 48 kHz.
+#define SPECTRUM_ANALYSER_FIFO_SECONDS 0.5
+#define SPECTRUM_ANALYSER_POLL_MS 10					// The FIFO is drained this often, frames are made at the frame rate.
+#define SPECTRUM_ANALYSER_NUM_BANDS 31					// Third octaves, 20 Hz to 20 kHz.
+#define SPECTRUM_ANALYSER_AVERAGE_MS 250.0				// Band powers are averaged over frames with this time constant.
+#define SPECTRUM_ANALYSER_MIN_DB -100.0f
+
+//==============================================================================
+/**
+	Third octave spectrum of the audio, analysed on its own thread.
+
+	push() is wait-free and only copies the block into a MultichannelBlockFifo; blocks
+	that don't fit are dropped whole and counted, so the history has no splices in it
+	and only the spectrum's accuracy suffers. The worker mixes the channels to mono, and at the frame rate
+	takes a Hann windowed FFT of the last 8192 samples and sums the bin powers into
+	third octave bands.
+
+	Band levels are in dB, scaled so a full scale sine reads 0 dB in its band, and
+	can be read on any thread.
+*/
+class SpectrumAnalyserThread : private Thread
+{
+public:
+	SpectrumAnalyserThread();
+	~SpectrumAnalyserThread();
+
+	// Not real-time: stops the worker, sizes and clears the FIFO and analysis, then starts it again.
+	void prepareToPlay(double sampleRate, int numChannels);
+
+	// Not real-time.
+	void stop();
+
+	// Any thread. Frames per second, 0 for none: push() is then not needed.
+	void setFrameRate(float framesPerSecond) { frameRate = framesPerSecond; }
+	float getFrameRate() const { return frameRate.load(std::memory_order_relaxed); }
+
+	// Audio thread only.
+	void push(const AudioSampleBuffer& block) { fifo.push(block); }
+
+	// Any thread.
+	float getBandLevel(int band) const { return bandLevels[band].load(std::memory_order_relaxed); }
+	int getNumFrames() const { return numFrames.load(std::memory_order_acquire); }
+
+	// Sample frames dropped because the FIFO was full, since prepareToPlay.
+	int64 getNumDroppedFrames() const { return fifo.getNumDroppedFrames(); }
+	static float getBandCentreFrequency(int band);
+
+private:
+	// A bin's share of a band: its power times the fraction of the bin inside the band.
+	struct BandBin
+	{
+		int band;
+		int bin;
+		float weight;
+	};
+
+	void run() override;
+	void drainFifo();
+	void analyseFrame();
+
+	MultichannelBlockFifo fifo;
+
+	// Worker only: the last FFT length of mono samples (circular), and the analysis.
+	std::vector<float> history;
+	int historyPosition;
+	std::unique_ptr<dsp::FFT> fft;
+	std::vector<float> window;
+	std::vector<float> fftData;
+	std::vector<BandBin> bandBins;
+	std::vector<double> bandPowers;
+	float powerScale;
+	double sampleRate;
+	double msSinceLastFrame;
+
+	std::atomic<float> frameRate;
+	std::atomic<float> bandLevels[SPECTRUM_ANALYSER_NUM_BANDS];
+	std::atomic<int> numFrames;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrumAnalyserThread)
+};
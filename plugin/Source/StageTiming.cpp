@@ -0,0 +1,150 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include "StageTiming.h"
+
+#if JUCE_INTEL
+ #if JUCE_MSVC
+  #include <intrin.h>
+ #else
+  #include <x86intrin.h>
+ #endif
+#endif
+
+StageTiming::StageTiming()
+{
+	clear();
+}
+
+void StageTiming::record(Stage stage, uint64 time) noexcept
+{
+	Histogram& histogram = histograms[stage];
+
+	int bucket = 0;
+	while (bucket < STAGE_TIMING_NUM_BUCKETS - 1 && (time >> (bucket + 1)) != 0)
+		bucket++;
+
+	// Single writer, so no compare and swap is needed for the max.
+	histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	histogram.total.fetch_add(time, std::memory_order_relaxed);
+	if (time > histogram.max.load(std::memory_order_relaxed))
+		histogram.max.store(time, std::memory_order_relaxed);
+
+	// Last, so a reader never sees a count without its time.
+	histogram.count.fetch_add(1, std::memory_order_release);
+}
+
+void StageTiming::clear()
+{
+	for (Histogram& histogram : histograms)
+	{
+		for (auto& bucket : histogram.buckets)
+			bucket = 0;
+
+		histogram.count = 0;
+		histogram.total = 0;
+		histogram.max = 0;
+	}
+}
+
+StageTiming::Stats StageTiming::getStats(Stage stage) const
+{
+	const Histogram& histogram = histograms[stage];
+
+	Stats stats;
+	stats.count = histogram.count.load(std::memory_order_acquire);
+
+	uint32 buckets[STAGE_TIMING_NUM_BUCKETS];
+	for (int i = 0; i < STAGE_TIMING_NUM_BUCKETS; i++)
+		buckets[i] = histogram.buckets[i].load(std::memory_order_relaxed);
+
+	stats.max = histogram.max.load(std::memory_order_relaxed);
+	stats.mean = stats.count > 0 ? histogram.total.load(std::memory_order_relaxed) / stats.count : 0;
+	stats.median = jmin(getPercentile(buckets, stats.count, 0.5), stats.max);
+	stats.percentile99 = jmin(getPercentile(buckets, stats.count, 0.99), stats.max);
+	return stats;
+}
+
+uint64 StageTiming::getPercentile(const uint32* buckets, uint64 count, double fraction)
+{
+	const uint64 rank = (uint64)(fraction * (double)count);
+	uint64 seen = 0;
+
+	for (int i = 0; i < STAGE_TIMING_NUM_BUCKETS; i++)
+	{
+		seen += buckets[i];
+		if (seen > rank)
+			return ((uint64)2 << i) - 1;
+	}
+
+	return 0;
+}
+
+String StageTiming::toJson() const
+{
+	DynamicObject::Ptr root = new DynamicObject();
+	root->setProperty("unit", getUnit());
+
+	for (int stage = 0; stage < numStages; stage++)
+	{
+		const Stats stats = getStats((Stage)stage);
+
+		DynamicObject::Ptr item = new DynamicObject();
+		item->setProperty("count", (int64)stats.count);
+		item->setProperty("mean", (int64)stats.mean);
+		item->setProperty("median", (int64)stats.median);
+		item->setProperty("p99", (int64)stats.percentile99);
+		item->setProperty("max", (int64)stats.max);
+		root->setProperty(getStageName((Stage)stage), var(item.get()));
+	}
+
+	return JSON::toString(var(root.get()));
+}
+
+uint64 StageTiming::getTime() noexcept
+{
+#if JUCE_INTEL
+	return (uint64)__rdtsc();
+#else
+	return (uint64)Time::getHighResolutionTicks();
+#endif
+}
+
+const char* StageTiming::getUnit()
+{
+#if JUCE_INTEL
+	return "cycles";
+#else
+	return "ticks";
+#endif
+}
+
+const char* StageTiming::getStageName(Stage stage)
+{
+	switch (stage)
+	{
+	case bandSolo:		return "bandSolo";
+	case midSide:		return "midSide";
+	case loudnessEq:	return "loudnessEq";
+	case lufsMeters:	return "lufsMeters";
+	case ballisticMeters:	return "ballisticMeters";
+	case roomCorrection:	return "roomCorrection";
+	case speakerSet:	return "speakerSet";
+	case processBlock:	return "processBlock";
+	case numStages:		break;
+	}
+
+	return "";
+}
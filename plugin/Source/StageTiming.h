@@ -0,0 +1,119 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+
+#include <JuceHeader.h>
+
+// Per stage timing of the audio callback. Off unless the build turns it on (CMake option
+// DREAMCONTROL_STAGE_TIMING), in which case STAGE_TIMING_SCOPE costs two cycle counter
+// reads and a few relaxed atomic adds per stage and block.
+#ifndef DREAMCONTROL_STAGE_TIMING
+ #define DREAMCONTROL_STAGE_TIMING 0
+#endif
+
+#define STAGE_TIMING_NUM_BUCKETS 40			// Log 2 buckets: bucket n holds times from 2^n to 2^(n+1) - 1.
+
+#if DREAMCONTROL_STAGE_TIMING
+ #define STAGE_TIMING_SCOPE(timing, stage) const StageTiming::ScopedTimer JUCE_JOIN_MACRO (stageTimer, __LINE__) (timing, stage)
+#else
+ #define STAGE_TIMING_SCOPE(timing, stage)
+#endif
+
+//==============================================================================
+/**
+	Timing histograms for the stages of the audio callback.
+
+	The audio thread records with record() (or STAGE_TIMING_SCOPE), any other thread
+	reads with getStats() or toJson(). Only one thread may record, the counters are
+	atomics so reading never blocks it. Times are in CPU cycles where there's a cycle
+	counter (x86), high resolution ticks elsewhere; getUnit() says which.
+*/
+class StageTiming
+{
+public:
+	enum Stage
+	{
+		bandSolo,
+		midSide,
+		loudnessEq,
+		lufsMeters,					// K-weighting, mean square and true peak, in one pass.
+		ballisticMeters,			// Sample peak, RMS, VU and PPM, in one pass.
+		roomCorrection,
+		speakerSet,
+		processBlock,				// The whole callback.
+		numStages
+	};
+
+	struct Stats
+	{
+		uint64 count;
+		uint64 mean;
+		uint64 median;				// Percentiles are the top of their bucket (at most max), so within a factor of 2.
+		uint64 percentile99;
+		uint64 max;
+	};
+
+	class ScopedTimer
+	{
+	public:
+		ScopedTimer(StageTiming* timing, Stage stage) noexcept
+			: timing(timing), stage(stage), start(timing != nullptr ? getTime() : 0) {}
+
+		~ScopedTimer() noexcept
+		{
+			if (timing != nullptr)
+				timing->record(stage, getTime() - start);
+		}
+
+	private:
+		StageTiming* timing;
+		const Stage stage;
+		const uint64 start;
+
+		JUCE_DECLARE_NON_COPYABLE (ScopedTimer)
+	};
+
+	StageTiming();
+
+	void record(Stage stage, uint64 time) noexcept;
+
+	// Not atomic as a whole: call it when nothing is recording (e.g. in prepareToPlay).
+	void clear();
+
+	Stats getStats(Stage stage) const;
+	String toJson() const;
+
+	static uint64 getTime() noexcept;
+	static const char* getUnit();
+	static const char* getStageName(Stage stage);
+
+private:
+	struct Histogram
+	{
+		std::atomic<uint32> buckets[STAGE_TIMING_NUM_BUCKETS];
+		std::atomic<uint64> count;
+		std::atomic<uint64> total;
+		std::atomic<uint64> max;
+	};
+
+	static uint64 getPercentile(const uint32* buckets, uint64 count, double fraction);
+
+	Histogram histograms[numStages];
+
+	JUCE_DECLARE_NON_COPYABLE (StageTiming)
+};
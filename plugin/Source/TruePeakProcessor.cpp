@@ -24,57 +24,56 @@
 // Guidelines for accurate measurement of true-peak level, 
 
 
+#include <limits>
+
 #include "TruePeakProcessor.h"
+#include "AudioFileBlockReader.h"
 
-const float filterPhase0[] =
-{
-    0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f,
-    -0.0594482421875f, 0.1373291015625f, 0.9721679687500f, -0.1022949218750f, 
-    0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f 
-};
+#define TRUE_PEAK_FILE_BLOCK_SIZE 4096
 
-const float filterPhase1[] =
+const float AudioProcessing::s_polyphase4Coefficients[ TRUE_PEAK_NB_PHASES ][ TRUE_PEAK_NB_COEFFS ] =
 {
-    -0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f, 
-    -0.1665039062500f, 0.4650878906250f, 0.7797851562500f, -0.2003173828125f,
-    0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f 
+    {
+        0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f,
+        -0.0594482421875f, 0.1373291015625f, 0.9721679687500f, -0.1022949218750f, 
+        0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f 
+    },
+    {
+        -0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f, 
+        -0.1665039062500f, 0.4650878906250f, 0.7797851562500f, -0.2003173828125f,
+        0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f 
+    },
+    {
+        -0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f, 
+        -0.2003173828125f, 0.7797851562500f, 0.4650878906250f, -0.1665039062500f, 
+        0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f 
+    },
+    {
+        -0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f,
+        -0.1022949218750f, 0.9721679687500f, 0.1373291015625f, -0.0594482421875f, 
+        0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f
+    }
 };
 
-const float filterPhase2[] =
-{
-    -0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f, 
-    -0.2003173828125f, 0.7797851562500f, 0.4650878906250f, -0.1665039062500f, 
-    0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f 
-};
-
-const float filterPhase3[] =
-{
-    -0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f,
-    -0.1022949218750f, 0.9721679687500f, 0.1373291015625f, -0.0594482421875f, 
-    0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f
-};
+const float * const filterPhase0 = AudioProcessing::s_polyphase4Coefficients[ 0 ];
+const float * const filterPhase1 = AudioProcessing::s_polyphase4Coefficients[ 1 ];
+const float * const filterPhase2 = AudioProcessing::s_polyphase4Coefficients[ 2 ];
+const float * const filterPhase3 = AudioProcessing::s_polyphase4Coefficients[ 3 ];
 
 const float * filterPhaseArray[] = { filterPhase0, filterPhase1, filterPhase2, filterPhase3 };
 
-const int numCoeffs = sizeof(filterPhase0) / sizeof(float);
+const int numCoeffs = TRUE_PEAK_NB_COEFFS;
 
-void AudioProcessing::TestOversampling( const juce::File & input )
+bool AudioProcessing::TestOversampling( const juce::File & input )
 {
     juce::AudioFormatManager audioFormatManager;
     audioFormatManager.registerBasicFormats();
 
-    juce::AudioFormatReader * reader = audioFormatManager.createReaderFor( input );
+    AudioFileBlockReader blockReader( audioFormatManager, input, TRUE_PEAK_FILE_BLOCK_SIZE );
+    juce::AudioFormatReader * reader = blockReader.getReader();
 
     if ( reader != nullptr )
     {
-        // read file
-        juce::AudioSampleBuffer origin( (int)reader->numChannels, (int)reader->lengthInSamples );
-        reader->read( &origin, 0, (int)reader->lengthInSamples, 0, true, true );
-
-        // Use polyphase FIR filter with coefficients for upsampling 4 times at 48KHz
-        juce::AudioSampleBuffer output;
-        polyphase4( origin, output );
-
         juce::String outputName = input.getFullPathName().substring(0, input.getFullPathName().length() - 4);
         juce::File outputFile( outputName + "_polyphase4.wav" );
         juce::FileOutputStream * outputStream = new juce::FileOutputStream( outputFile );
@@ -87,45 +86,47 @@ void AudioProcessing::TestOversampling( const juce::File & input )
 
         if ( writer != nullptr )
         {
-            writer->writeFromAudioSampleBuffer( output, 0, output.getNumSamples() );
-            
+            // Use polyphase FIR filter with coefficients for upsampling 4 times at 48KHz.
+            // Each block is preceded by the last numCoeffs input samples, so the output
+            // is the same as filtering the whole file at once.
+            const int numChannels = (int)reader->numChannels;
+            juce::AudioSampleBuffer inputs( numChannels, numCoeffs + TRUE_PEAK_FILE_BLOCK_SIZE );
+            juce::AudioSampleBuffer output;
+            inputs.clear();
+
+            while ( juce::AudioSampleBuffer * block = blockReader.readNextBlock() )
+            {
+                const int numSamples = block->getNumSamples();
+
+                for ( int ch = 0 ; ch < numChannels ; ++ch )
+                    inputs.copyFrom( ch, numCoeffs, *block, ch, 0, numSamples );
+
+                const juce::AudioSampleBuffer source( inputs.getArrayOfWritePointers(), numChannels, 0, numCoeffs + numSamples );
+                polyphase4( source, output );
+
+                writer->writeFromAudioSampleBuffer( output, 4 * numCoeffs, 4 * numSamples );
+
+                // blocks can be smaller than numCoeffs, so source and destination may overlap
+                for ( int ch = 0 ; ch < numChannels ; ++ch )
+                {
+                    float * data = inputs.getWritePointer( ch );
+                    memmove( data, &data[ numSamples ], numCoeffs * sizeof( float ) );
+                }
+            }
+
             delete writer;
+            return !blockReader.hasFailed();
         }
-
-        delete reader;
     }
+
+    return false;
 }
 
 float getDecibelVolumeFromLinearVolume(float _linearVolume );
 
 float AudioProcessing::ProcessTruePeak( const juce::File & input )
 {
-    juce::AudioFormatManager audioFormatManager;
-    audioFormatManager.registerBasicFormats();
-
-    juce::AudioFormatReader * reader = audioFormatManager.createReaderFor( input );
-
-    float truePeakValue = 0.f; 
-
-    if ( reader != nullptr )
-    {
-        // read file
-        juce::AudioSampleBuffer buffer( (int)reader->numChannels, (int)reader->lengthInSamples );
-        reader->read( &buffer, 0, (int)reader->lengthInSamples, 0, true, true );
-
-        AudioProcessing::TruePeak truePeak;
-        TruePeak::LinearValue value = truePeak.process(buffer);
-
-        for (int i = 0 ; i < (int)reader->numChannels ; ++i)
-        {
-            if (truePeakValue < value.m_channelArray[i])
-                truePeakValue = value.m_channelArray[i];
-        }
-
-        delete reader;
-    }
-
-    return getDecibelVolumeFromLinearVolume(truePeakValue);
+    return ProcessTruePeak( input, TRUE_PEAK_FILE_BLOCK_SIZE );
 }
 
 float AudioProcessing::ProcessTruePeak( const juce::File & input, const int bufferSize )
@@ -133,36 +134,29 @@ float AudioProcessing::ProcessTruePeak( const juce::File & input, const int buff
     juce::AudioFormatManager audioFormatManager;
     audioFormatManager.registerBasicFormats();
 
-    juce::AudioFormatReader * reader = audioFormatManager.createReaderFor( input );
+    AudioFileBlockReader blockReader( audioFormatManager, input, bufferSize );
+
+    if ( ! blockReader.isOpen() )
+        return std::numeric_limits<float>::quiet_NaN();
 
     float truePeakValue = 0.f; 
 
-    if ( reader != nullptr )
-    {
-        // read file
-        juce::AudioSampleBuffer buffer( (int)reader->numChannels, (int)reader->lengthInSamples );
-        reader->read( &buffer, 0, (int)reader->lengthInSamples, 0, true, true );
+    AudioProcessing::TruePeak truePeak;
 
-        AudioProcessing::TruePeak truePeak;
+    while ( juce::AudioSampleBuffer * block = blockReader.readNextBlock() )
+    {
+        TruePeak::LinearValue value = truePeak.process( *block );
 
-        int offset = 0;
-        while (offset + bufferSize < (int)reader->lengthInSamples)
+        for (int i = 0 ; i < juce::jmin( block->getNumChannels(), LUFS_TP_MAX_NB_CHANNELS ) ; ++i)
         {
-            juce::AudioSampleBuffer calcBuffer( buffer.getArrayOfWritePointers(), reader->numChannels, offset, bufferSize );
-
-            TruePeak::LinearValue value = truePeak.process(calcBuffer);
-            offset += bufferSize;
-
-            for (int i = 0 ; i < (int)reader->numChannels ; ++i)
-            {
-                if (truePeakValue < value.m_channelArray[i])
-                    truePeakValue = value.m_channelArray[i];
-            }
+            if (truePeakValue < value.m_channelArray[i])
+                truePeakValue = value.m_channelArray[i];
         }
-
-        delete reader;
     }
 
+    if ( blockReader.hasFailed() )
+        return std::numeric_limits<float>::quiet_NaN();
+
     return getDecibelVolumeFromLinearVolume(truePeakValue);
 }
 
@@ -247,40 +241,47 @@ AudioProcessing::TruePeak::TruePeak()
 
 }
 
-AudioProcessing::TruePeak::LinearValue AudioProcessing::TruePeak::process( const juce::AudioSampleBuffer & buffer )
+void AudioProcessing::TruePeak::prepare( int numChannels, int maxBlockSize )
 {
-    if (m_inputs.getNumSamples() >= numCoeffs)
-    {
-        // we have enough data from a previous process 
+    // setSize clears buffer content too
+    m_inputs.setSize( numChannels, numCoeffs + maxBlockSize );
+}
 
-        for ( int ch = 0 ; ch < buffer.getNumChannels() ; ++ch )
-        {
-            m_inputs.copyFrom( ch, 0, &m_inputs.getArrayOfReadPointers()[ch][m_inputs.getNumSamples() - numCoeffs], numCoeffs );
-        }
+AudioProcessing::TruePeak::LinearValue AudioProcessing::TruePeak::process( const juce::AudioSampleBuffer & buffer )
+{
+    const int numChannels = buffer.getNumChannels();
+    const int numSamples = buffer.getNumSamples();
 
-        // resize if necessary
-        if ( m_inputs.getNumSamples() != numCoeffs + buffer.getNumSamples() )
-            m_inputs.setSize( buffer.getNumChannels(), numCoeffs + buffer.getNumSamples(), true, false, true );
-    }
-    else
+    // only grows when a block bigger than any before arrives, keeping the history 
+    // (a bigger size with keepExistingContent always reallocates, even when there would be room)
+    if ( m_inputs.getNumChannels() < numChannels || m_inputs.getNumSamples() < numCoeffs + numSamples )
     {
-        // setSize clears buffer content too
-
-        m_inputs.setSize( buffer.getNumChannels(), numCoeffs + buffer.getNumSamples(), false, true );
+        m_inputs.setSize( juce::jmax( numChannels, m_inputs.getNumChannels() ), numCoeffs + numSamples, true, true );
     }
 
     // copy buffer to inputs with numCoefs offset
-    for ( int ch = 0 ; ch < buffer.getNumChannels() ; ++ch )
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
+    {
+        m_inputs.copyFrom( ch, numCoeffs, buffer, ch, 0, numSamples );
+    }
+
+    const juce::AudioSampleBuffer inputs( m_inputs.getArrayOfWritePointers(), numChannels, numCoeffs + numSamples );
+    LinearValue value = processPolyphase4AbsMax( inputs );
+
+    // keep the last numCoeffs samples as history for next process: blocks can be smaller than numCoeffs, 
+    // so source and destination may overlap
+    for ( int ch = 0 ; ch < numChannels ; ++ch )
     {
-        m_inputs.copyFrom( ch, numCoeffs, buffer, ch, 0, buffer.getNumSamples() );
+        float * data = m_inputs.getWritePointer( ch );
+        memmove( data, &data[ numSamples ], numCoeffs * sizeof( float ) );
     }
 
-    return processPolyphase4AbsMax( m_inputs );
+    return value;
 }
 
 void AudioProcessing::TruePeak::reset()
 {
-    m_inputs.setSize(0, 0);
+    m_inputs.clear();
 }
 
 AudioProcessing::TruePeak::LinearValue AudioProcessing::TruePeak::processPolyphase4AbsMax( const juce::AudioSampleBuffer & buffer )
@@ -293,7 +294,10 @@ AudioProcessing::TruePeak::LinearValue AudioProcessing::TruePeak::processPolypha
     {
         const float * input = buffer.getArrayOfReadPointers()[ ch ];
 
-        for ( int i = 0 ; i < sampleSize ; ++i )
+        // the first numCoeffs samples are the end of the previous buffer, only used as filter history:
+        // their outputs were done with the previous buffer, and filtering them here would only see
+        // part of the filter, which overshoots (about +1 dB on a 1 kHz sine)
+        for ( int i = numCoeffs ; i < sampleSize ; ++i )
         {
             for ( int j = 0 ; j < 4 ; ++j ) // number of polyphase filters
             {
@@ -313,9 +317,9 @@ AudioProcessing::TruePeak::LinearValue AudioProcessing::TruePeak::processPolypha
 
     Coefficients create a 24 kHz low pass filter for a 192 kHz wave
 */
-void AudioProcessing::TestSimpleConvolution( const juce::File & input )
+bool AudioProcessing::TestSimpleConvolution( const juce::File & input )
 {
-    const int polyphase4Size = sizeof(filterPhase0) / sizeof(float);
+    const int polyphase4Size = numCoeffs;
     const int convolutionSize = 4 * polyphase4Size;
     juce::AudioSampleBuffer convolutionFilter( 1, convolutionSize );
 
@@ -331,19 +335,11 @@ void AudioProcessing::TestSimpleConvolution( const juce::File & input )
     juce::AudioFormatManager audioFormatManager;
     audioFormatManager.registerBasicFormats();
 
-    juce::AudioFormatReader * reader = audioFormatManager.createReaderFor( input );
+    AudioFileBlockReader blockReader( audioFormatManager, input, TRUE_PEAK_FILE_BLOCK_SIZE );
+    juce::AudioFormatReader * reader = blockReader.getReader();
 
     if ( reader != nullptr )
     {
-        // read file
-        juce::AudioSampleBuffer origin( (int)reader->numChannels, (int)reader->lengthInSamples );
-        reader->read( &origin, 0, (int)reader->lengthInSamples, 0, true, true );
-
-        // Convolve
-        juce::AudioSampleBuffer output;
-        convolution( origin, convolutionFilter, output );
-        output.applyGain(0.25f); // filter values use sample with 3 zeros per valid sample (1 / 4)
-
         juce::String outputName = input.getFullPathName().substring(0, input.getFullPathName().length() - 4);
         juce::File outputFile( outputName + "_convolution.wav" );
         juce::FileOutputStream * outputStream = new juce::FileOutputStream( outputFile );
@@ -356,11 +352,55 @@ void AudioProcessing::TestSimpleConvolution( const juce::File & input )
 
         if ( writer != nullptr )
         {
-            writer->writeFromAudioSampleBuffer( output, 0, output.getNumSamples() );
+            // Convolve block by block, each block preceded by the last convolutionSize input
+            // samples. A last block of silence writes the filter tail.
+            const int numChannels = (int)reader->numChannels;
+            juce::AudioSampleBuffer inputs( numChannels, convolutionSize + TRUE_PEAK_FILE_BLOCK_SIZE );
+            juce::AudioSampleBuffer silence( numChannels, convolutionSize );
+            juce::AudioSampleBuffer output;
+            inputs.clear();
+            silence.clear();
+
+            juce::AudioSampleBuffer * block = blockReader.readNextBlock();
+            bool isTail = false;
+
+            while ( !isTail )
+            {
+                if ( block == nullptr && blockReader.hasFailed() )
+                    break;
+
+                if ( block == nullptr )
+                {
+                    block = &silence;
+                    isTail = true;
+                }
+
+                const int numSamples = block->getNumSamples();
+
+                for ( int ch = 0 ; ch < numChannels ; ++ch )
+                    inputs.copyFrom( ch, convolutionSize, *block, ch, 0, numSamples );
+
+                const juce::AudioSampleBuffer source( inputs.getArrayOfWritePointers(), numChannels, 0, convolutionSize + numSamples );
+                convolution( source, convolutionFilter, output );
+                output.applyGain(0.25f); // filter values use sample with 3 zeros per valid sample (1 / 4)
+
+                writer->writeFromAudioSampleBuffer( output, convolutionSize, numSamples );
+
+                // blocks can be smaller than convolutionSize, so source and destination may overlap
+                for ( int ch = 0 ; ch < numChannels ; ++ch )
+                {
+                    float * data = inputs.getWritePointer( ch );
+                    memmove( data, &data[ numSamples ], convolutionSize * sizeof( float ) );
+                }
+
+                if ( !isTail )
+                    block = blockReader.readNextBlock();
+            }
 
             delete writer;
+            return !blockReader.hasFailed();
         }
-
-        delete reader;
     }
+
+    return false;
 }
@@ -21,25 +21,30 @@
 
 #pragma once 
 
-#include "../JuceLibraryCode/JuceHeader.h"
+#include <JuceHeader.h>
 
 #define LUFS_TP_MAX_NB_CHANNELS 2
+#define TRUE_PEAK_NB_PHASES 4
+#define TRUE_PEAK_NB_COEFFS 12
 
 class AudioProcessing
 {
 public:
 
-    // oversamples by 4 a wave file using polyphase4 and saves new file to disk
-    static void TestOversampling( const juce::File & input );
+    // polyphase FIR filter coefficients for upsampling 4 times, one set per phase 
+    static const float s_polyphase4Coefficients[ TRUE_PEAK_NB_PHASES ][ TRUE_PEAK_NB_COEFFS ];
 
-    // applies True Peak processing on file
+    // oversamples by 4 a wave file using polyphase4 and saves new file to disk, false if the file can't be read
+    static bool TestOversampling( const juce::File & input );
+
+    // applies True Peak processing on file, NaN if the file can't be opened or read
     static float ProcessTruePeak( const juce::File & input );
 
     // applies True Peak processing on file using bufferSize buffers 
     static float ProcessTruePeak( const juce::File & input, const int bufferSize );
 
-    // applies simple convolution with polyphase params and saves new file to disk
-    static void TestSimpleConvolution( const juce::File & input );
+    // applies simple convolution with polyphase params and saves new file to disk, false if the file can't be read
+    static bool TestSimpleConvolution( const juce::File & input );
 
     // TruePeak class calculates True Peak linear volume for buffer
 
@@ -68,18 +73,72 @@ public:
 
         TruePeak();
 
+        // allocates internal buffers for blocks of up to maxBlockSize samples, 
+        // so process doesn't allocate on the audio thread 
+        void prepare( int numChannels, int maxBlockSize );
+
         // process: since this method needs numCoeffs values more than buffer size, 
         // numCoeffs values from previous process call are used at beginning of buffer
         LinearValue process( const juce::AudioSampleBuffer & buffer );
 
-        // resets internal buffers 
+        // resets internal buffers, keeping their allocation 
         void reset();
 
     private:
 
         LinearValue processPolyphase4AbsMax( const juce::AudioSampleBuffer & buffer );
 
-        juce::AudioSampleBuffer m_inputs; // getPolyphase4AbsMax processes this buffer  
+        juce::AudioSampleBuffer m_inputs; // numCoeffs samples of history then the block, getPolyphase4AbsMax processes this buffer  
+    };
+
+    // TruePeakChannel calculates True Peak linear volume of one channel, one sample at a time, 
+    // for kernels that do other work on the same samples. Same filter and results as TruePeak.
+
+    class TruePeakChannel
+    {
+    public:
+        TruePeakChannel()
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            memset( m_history, 0, sizeof( m_history ) );
+            m_position = 0;
+        }
+
+        // returns the max absolute value of the 4 oversampled values ending at sample
+        inline float process( const float sample )
+        {
+            // the history is written twice, so the last numCoeffs samples are always contiguous, 
+            // most recent first
+            m_position = ( m_position == 0 ) ? TRUE_PEAK_NB_COEFFS - 1 : m_position - 1;
+            m_history[ m_position ] = sample;
+            m_history[ m_position + TRUE_PEAK_NB_COEFFS ] = sample;
+
+            const float * input = &m_history[ m_position ];
+            float absMax = 0.f;
+
+            for ( int phase = 0 ; phase < TRUE_PEAK_NB_PHASES ; ++phase )
+            {
+                const float * coefficients = s_polyphase4Coefficients[ phase ];
+                float sum = 0.f;
+
+                for ( int j = 0 ; j < TRUE_PEAK_NB_COEFFS ; ++j )
+                    sum += ( input[j] * coefficients[j] );
+
+                const float absSample = fabsf( sum );
+                if ( absSample > absMax )
+                    absMax = absSample;
+            }
+
+            return absMax;
+        }
+
+    private:
+        float m_history[ 2 * TRUE_PEAK_NB_COEFFS ];
+        int m_position;
     };
 
 private:
@@ -89,6 +148,5 @@ private:
 
     static void polyphase4( const juce::AudioSampleBuffer & source, juce::AudioSampleBuffer & result );
     static float polyphase4ComputeSum( const float * input, int offset, int maxOffset, const float* coefficients, int numCoeff );
-
 };
 
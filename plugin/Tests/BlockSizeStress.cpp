@@ -0,0 +1,289 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include <cmath>
+
+#include "BlockSizeStress.h"
+#include "MonitorChain.h"
+
+#define BLOCK_SIZE_STRESS_ANNOUNCED_BLOCK_SIZE 512		// What the host says in prepareToPlay, and the fixed block size.
+#define BLOCK_SIZE_STRESS_MAX_BLOCK_SIZE 8192
+#define BLOCK_SIZE_STRESS_SMALL_BLOCK_SIZE 64			// Half the random blocks are this size or less.
+#define BLOCK_SIZE_STRESS_SWITCH_SECONDS 0.5			// Parameter changes, longer than the speaker set crossfade.
+#define BLOCK_SIZE_STRESS_UPDATE_BLOCKS 8				// Meters are read every few blocks, as the plugin's timer does.
+#define BLOCK_SIZE_STRESS_NUM_BANDS 4
+#define BLOCK_SIZE_STRESS_ROOM_IR_SAMPLES 10000			// Long enough to reach all of the room correction's segments.
+#define BLOCK_SIZE_STRESS_HOLD_SECONDS 0.5f				// Ballistic meter peak hold.
+#define BLOCK_SIZE_STRESS_SPECTRUM_RATE 30.0f			// Spectrum frames per second, so push() runs.
+
+const double blockSizeStressSampleRates[] = { 44100.0, 96000.0, 48000.0 };
+
+// Speaker set trim (dB) and delay (ms), switched in turn.
+const float blockSizeStressSpeakerSets[][2] = { { 0.0f, 0.0f }, { -3.0f, 1.7f }, { -6.5f, 0.0f }, { 2.0f, 12.3f } };
+
+// Band solo masks, switched in turn: none, one band, two, and all of them.
+const int blockSizeStressSoloMasks[] = { 0, 1 << 1, (1 << 0) | (1 << 2), (1 << BLOCK_SIZE_STRESS_NUM_BANDS) - 1 };
+const float blockSizeStressCrossovers[MULTIBAND_CROSSOVER_MAX_CROSSOVERS] = { 150.0f, 900.0f, 5000.0f, 20000.0f, 20000.0f, 20000.0f, 20000.0f };
+
+//==============================================================================
+// The plugin's audio processing, with its own routing table.
+struct BlockSizeStress::Chain
+{
+	Chain() : monitorChain(monitorRouting, LUFS_TP_MAX_NB_CHANNELS) {}
+
+	MonitorRouting monitorRouting;
+	MonitorChain monitorChain;
+};
+
+BlockSizeStress::BlockSizeStress(double secondsPerRound, int64 seed)
+	: secondsPerRound(secondsPerRound), seed(seed)
+{
+}
+
+std::vector<BlockSizeStress::Result> BlockSizeStress::run(const AllocationCounter& countAllocations) const
+{
+	std::vector<Result> results;
+
+	// Each chain is kept from one sample rate to the next, as in a host.
+	Chain fixedChain;
+	Chain randomChain;
+	Random blockSizes(seed);
+
+	for (int round = 0; round < numElementsInArray(blockSizeStressSampleRates); round++)
+	{
+		const double sampleRate = blockSizeStressSampleRates[round];
+
+		AudioSampleBuffer signal(2, (int)(secondsPerRound * sampleRate));
+		Random random(seed + round + 1);
+		fillSignal(signal, random);
+
+		Measurements expected, measured;
+		runChain(fixedChain, signal, sampleRate, nullptr, countAllocations, expected);
+		runChain(randomChain, signal, sampleRate, &blockSizes, countAllocations, measured);
+
+		Result result;
+		result.sampleRate = sampleRate;
+		result.numBlocks = measured.numBlocks;
+		result.minBlockSize = measured.minBlockSize;
+		result.maxBlockSize = measured.maxBlockSize;
+		result.numAllocatingBlocks = measured.numAllocatingBlocks + expected.numAllocatingBlocks;
+
+		result.numMismatches = compare(expected.momentary, measured.momentary, "momentary", result.firstMismatch)
+			+ compare(expected.shortTerm, measured.shortTerm, "short term", result.firstMismatch)
+			+ compare(expected.truePeak[0], measured.truePeak[0], "true peak left", result.firstMismatch)
+			+ compare(expected.truePeak[1], measured.truePeak[1], "true peak right", result.firstMismatch)
+			+ compare(expected.ballistics, measured.ballistics, "ballistic hold, correlation or balance", result.firstMismatch);
+
+		if (expected.integrated != measured.integrated || expected.rangeMin != measured.rangeMin || expected.rangeMax != measured.rangeMax)
+		{
+			if (result.firstMismatch.isEmpty())
+				result.firstMismatch = "integrated or range";
+			result.numMismatches++;
+		}
+
+		for (int chan = 0; chan < signal.getNumChannels(); chan++)
+		{
+			for (int sample = 0; sample < signal.getNumSamples(); sample++)
+			{
+				if (expected.output.getSample(chan, sample) != measured.output.getSample(chan, sample))
+				{
+					if (result.firstMismatch.isEmpty())
+						result.firstMismatch = "output channel " + String(chan) + " sample " + String(sample);
+					result.numMismatches++;
+				}
+			}
+		}
+
+		result.passed = result.numMismatches == 0 && result.numAllocatingBlocks == 0;
+		results.push_back(result);
+	}
+
+	return results;
+}
+
+bool BlockSizeStress::allPassed(const std::vector<Result>& results)
+{
+	for (const Result& result : results)
+	{
+		if (!result.passed)
+			return false;
+	}
+
+	return true;
+}
+
+void BlockSizeStress::fillSignal(AudioSampleBuffer& signal, Random& random)
+{
+	// Noise in the left channel and a sine with a little noise in the right, at a different
+	// level in every section, with some silence, so the meters and gates all have work to do.
+	const int sectionLength = jmax(1, signal.getNumSamples() / 16);
+	float gain = 0.0f;
+
+	for (int sample = 0; sample < signal.getNumSamples(); sample++)
+	{
+		if (sample % sectionLength == 0)
+			gain = random.nextInt(5) == 0 ? 0.0f : Decibels::decibelsToGain(-40.0f + 36.0f * random.nextFloat());
+
+		const float noise = random.nextFloat() * 2.0f - 1.0f;
+		signal.setSample(0, sample, gain * noise);
+		signal.setSample(1, sample, gain * (0.9f * (float)std::sin(0.0712 * sample) + 0.1f * noise));
+	}
+}
+
+void BlockSizeStress::runChain(Chain& chain, const AudioSampleBuffer& signal, double sampleRate, Random* blockSizes, const AllocationCounter& countAllocations, Measurements& measurements)
+{
+	const int numChannels = signal.getNumChannels();
+	const int numSamples = signal.getNumSamples();
+	const int switchLength = (int)(BLOCK_SIZE_STRESS_SWITCH_SECONDS * sampleRate);
+
+	MonitorChain& monitorChain = chain.monitorChain;
+	LufsProcessor& lufsProcessor = monitorChain.getLufsProcessor();
+	BallisticMeterProcessor& ballisticMeterProcessor = monitorChain.getBallisticMeterProcessor();
+	MeterAnalysisThread& meterAnalysisThread = monitorChain.getMeterAnalysisThread();
+
+	// Each speaker set's trim and delay, read by the chain from the routing table.
+	MonitorRouting::Table table = MonitorRouting::getDefaultTable();
+	for (int speakerSet = 0; speakerSet < MONITOR_ROUTING_NUM_SPEAKER_SETS; speakerSet++)
+	{
+		table.speakerSets[speakerSet].trimDb = blockSizeStressSpeakerSets[speakerSet][0];
+		table.speakerSets[speakerSet].delayMs = blockSizeStressSpeakerSets[speakerSet][1];
+	}
+	chain.monitorRouting.setTable(table);
+
+	monitorChain.prepareToPlay(sampleRate, BLOCK_SIZE_STRESS_ANNOUNCED_BLOCK_SIZE, numChannels);
+	monitorChain.setCrossovers(BLOCK_SIZE_STRESS_NUM_BANDS, blockSizeStressCrossovers);
+	ballisticMeterProcessor.setEnabled(true);
+	ballisticMeterProcessor.setHoldTime(BLOCK_SIZE_STRESS_HOLD_SECONDS);
+	monitorChain.getSpectrumAnalyser().setFrameRate(BLOCK_SIZE_STRESS_SPECTRUM_RATE);
+
+	// Room correction for MAIN and ALT1, the same in both runs: decaying noise. ALT2 and ALT3 pass through.
+	for (int speakerSet = 0; speakerSet < 2; speakerSet++)
+	{
+		AudioSampleBuffer impulseResponse(numChannels, BLOCK_SIZE_STRESS_ROOM_IR_SAMPLES);
+		Random random(speakerSet + 1);
+		for (int chan = 0; chan < numChannels; chan++)
+			for (int tap = 0; tap < impulseResponse.getNumSamples(); tap++)
+				impulseResponse.setSample(chan, tap, (random.nextFloat() - 0.5f) * std::exp(-tap / 2000.0f));
+
+		monitorChain.getRoomCorrectionProcessor().setImpulseResponse(speakerSet, impulseResponse, sampleRate);
+	}
+
+	measurements.output.makeCopyOf(signal);
+	measurements.numBlocks = 0;
+	measurements.minBlockSize = numSamples;
+	measurements.maxBlockSize = 0;
+	measurements.numAllocatingBlocks = 0;
+
+	for (int start = 0; start < numSamples;)
+	{
+		int blockSize = BLOCK_SIZE_STRESS_ANNOUNCED_BLOCK_SIZE;
+		if (blockSizes != nullptr)
+		{
+			const int maxBlockSize = blockSizes->nextBool() ? BLOCK_SIZE_STRESS_SMALL_BLOCK_SIZE : BLOCK_SIZE_STRESS_MAX_BLOCK_SIZE;
+			blockSize = 1 + blockSizes->nextInt(maxBlockSize);
+		}
+
+		// Parameters change at the same positions in both runs: blocks are cut there,
+		// as a host with sample accurate automation does.
+		const int section = start / switchLength;
+		blockSize = jmin(blockSize, (section + 1) * switchLength - start, numSamples - start);
+
+		MonitorChain::Settings settings;
+		settings.soloMask = blockSizeStressSoloMasks[section % numElementsInArray(blockSizeStressSoloMasks)];
+		settings.linearPhase = (section / 4) % 2 == 1;
+		settings.midSolo = section % 3 == 1;
+		settings.sideSolo = section % 3 == 2;
+		settings.meterOnAnalysisThread = (section / 3) % 2 == 1;
+		settings.loudnessEq = section % 2 == 1;
+		settings.listeningLevel = -7.5f * (section % 5);
+		settings.gain = section % 3 == 2 ? Decibels::decibelsToGain(-20.0f) : 1.0f;
+		settings.speakerSet = section % (MONITOR_ROUTING_NUM_SPEAKER_SETS + 1) - 1;	// -1 is monitors off.
+		settings.roomCorrection = (section / 2) % 3 != 0;
+
+		// The analysis thread must not drop anything, or the meters would differ: the test waits for
+		// it, where a host wouldn't. After switching back, blocks still go to it until it's done.
+		if (settings.meterOnAnalysisThread || meterAnalysisThread.isBusy())
+		{
+			while (meterAnalysisThread.getFreeSpace() < blockSize)
+				Thread::sleep(1);
+		}
+
+		float* channels[2];
+		for (int chan = 0; chan < numChannels; chan++)
+			channels[chan] = measurements.output.getWritePointer(chan, start);
+
+		AudioSampleBuffer block(channels, numChannels, blockSize);
+		const int64 allocationsBefore = countAllocations ? countAllocations() : 0;
+
+		monitorChain.process(block, settings);
+
+		if (countAllocations && countAllocations() != allocationsBefore)
+			measurements.numAllocatingBlocks++;
+
+		measurements.numBlocks++;
+		measurements.minBlockSize = jmin(measurements.minBlockSize, blockSize);
+		measurements.maxBlockSize = jmax(measurements.maxBlockSize, blockSize);
+		start += blockSize;
+
+		if (measurements.numBlocks % BLOCK_SIZE_STRESS_UPDATE_BLOCKS == 0)
+			lufsProcessor.update();
+	}
+
+	// Everything pushed to the analysis thread is metered before reading.
+	while (meterAnalysisThread.isBusy())
+		Thread::sleep(1);
+
+	lufsProcessor.update();
+
+	const int validSize = lufsProcessor.getValidSize();
+	measurements.momentary.assign(lufsProcessor.getMomentaryVolumeArray(), lufsProcessor.getMomentaryVolumeArray() + validSize);
+	measurements.shortTerm.assign(lufsProcessor.getShortTermVolumeArray(), lufsProcessor.getShortTermVolumeArray() + validSize);
+	for (int chan = 0; chan < LUFS_TP_MAX_NB_CHANNELS; chan++)
+		measurements.truePeak[chan].assign(lufsProcessor.getTruePeakChannelArray(chan), lufsProcessor.getTruePeakChannelArray(chan) + validSize);
+
+	measurements.integrated = lufsProcessor.getIntegratedVolume();
+	measurements.rangeMin = lufsProcessor.getRangeMinVolume();
+	measurements.rangeMax = lufsProcessor.getRangeMaxVolume();
+
+	// The ballistic levels are each block's highest, so only the holds and the stereo means are compared.
+	measurements.ballistics.clear();
+	for (int chan = 0; chan < BALLISTIC_METER_MAX_CHANNELS; chan++)
+		for (int ballistics = 0; ballistics < BallisticMeterProcessor::numBallistics; ballistics++)
+			measurements.ballistics.push_back(ballisticMeterProcessor.getHold(chan, (BallisticMeterProcessor::Ballistics)ballistics));
+	measurements.ballistics.push_back(ballisticMeterProcessor.getCorrelation());
+	measurements.ballistics.push_back(ballisticMeterProcessor.getBalance());
+
+	monitorChain.releaseResources();
+}
+
+int BlockSizeStress::compare(const std::vector<float>& expected, const std::vector<float>& measured, const char* name, String& firstMismatch)
+{
+	int numMismatches = jmax(0, (int)expected.size() - (int)measured.size()) + jmax(0, (int)measured.size() - (int)expected.size());
+
+	for (size_t i = 0; i < jmin(expected.size(), measured.size()); i++)
+	{
+		if (expected[i] != measured[i])
+		{
+			if (firstMismatch.isEmpty())
+				firstMismatch = String(name) + " position " + String((int)i);
+			numMismatches++;
+		}
+	}
+
+	if (numMismatches > 0 && firstMismatch.isEmpty())
+		firstMismatch = String(name) + " length";
+
+	return numMismatches;
+}
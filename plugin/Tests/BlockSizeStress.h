@@ -0,0 +1,88 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+	Stress test for the real-time path with variable host block sizes.
+
+	Runs the plugin's audio processing (MonitorChain: spectrum tap, IIR and linear phase
+	band solo, M/S solo, LUFS/true peak and ballistic meters here or on the analysis
+	thread, loudness EQ, room correction, speaker set trim and delay from the routing
+	table) on a synthetic signal twice: once in fixed size blocks, and once in random
+	blocks of 1 to 8192 samples, bigger than announced in prepareToPlay too, as some hosts
+	send. Every setting is switched at the same sample positions in both runs, and the
+	sample rate changes between rounds.
+
+	The meters and the output must be identical in both runs, and no block may allocate.
+	The allocations are counted by whoever runs the test (DreamControlTests wraps
+	malloc), as the test itself can't see them.
+*/
+class BlockSizeStress
+{
+public:
+	struct Result
+	{
+		double sampleRate;
+		int numBlocks;
+		int minBlockSize;
+		int maxBlockSize;
+		int numMismatches;				// Meter positions and output samples different from the fixed size run.
+		int numAllocatingBlocks;
+		String firstMismatch;
+		bool passed;
+	};
+
+	// Returns the number of heap allocations so far.
+	typedef std::function<int64()> AllocationCounter;
+
+	BlockSizeStress(double secondsPerRound, int64 seed);
+
+	std::vector<Result> run(const AllocationCounter& countAllocations) const;
+
+	static bool allPassed(const std::vector<Result>& results);
+
+private:
+	struct Chain;
+
+	struct Measurements
+	{
+		std::vector<float> momentary;
+		std::vector<float> shortTerm;
+		std::vector<float> truePeak[2];
+		std::vector<float> ballistics;		// Holds, then correlation and balance.
+		float integrated;
+		float rangeMin;
+		float rangeMax;
+		AudioSampleBuffer output;
+		int numBlocks;
+		int minBlockSize;
+		int maxBlockSize;
+		int numAllocatingBlocks;
+	};
+
+	static void fillSignal(AudioSampleBuffer& signal, Random& random);
+	static void runChain(Chain& chain, const AudioSampleBuffer& signal, double sampleRate, Random* blockSizes, const AllocationCounter& countAllocations, Measurements& measurements);
+	static int compare(const std::vector<float>& expected, const std::vector<float>& measured, const char* name, String& firstMismatch);
+
+	double secondsPerRound;
+	int64 seed;
+};
@@ -0,0 +1,265 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include <cmath>
+
+#include "ConvolutionCheck.h"
+#include "LinearPhaseCrossover.h"
+#include "RoomCorrectionProcessor.h"
+
+#define CONVOLUTION_CHECK_SEED 3341
+#define CONVOLUTION_CHECK_NUM_CHANNELS 2
+#define CONVOLUTION_CHECK_TOLERANCE_DB -80.0f			// Float transforms are good to -120 dB or so, a wrong tap or sample is far worse.
+#define CONVOLUTION_CHECK_PHASE_SAMPLES 32768			// Room correction: samples per speaker set, enough to settle after the switch.
+#define CONVOLUTION_CHECK_IR_A_SAMPLES 12000			// Long enough to reach all of the room correction's segments.
+#define CONVOLUTION_CHECK_IR_B_SAMPLES 9000
+#define CONVOLUTION_CHECK_CROSSOVER_SAMPLES 32768
+#define CONVOLUTION_CHECK_NUM_BANDS 4
+
+const float convolutionCheckCrossovers[CONVOLUTION_CHECK_NUM_BANDS - 1] = { 100.0f, 400.0f, 4000.0f };
+
+ConvolutionCheck::ConvolutionCheck()
+{
+	sampleRates.add(44100.0);
+	sampleRates.add(96000.0);
+
+	blockSizes.add(1);
+	blockSizes.add(37);
+	blockSizes.add(64);
+	blockSizes.add(500);
+	blockSizes.add(4096);
+}
+
+ConvolutionCheck::ConvolutionCheck(const Array<double>& sampleRates, const Array<int>& blockSizes)
+	: sampleRates(sampleRates), blockSizes(blockSizes)
+{
+}
+
+std::vector<ConvolutionCheck::Result> ConvolutionCheck::run() const
+{
+	std::vector<Result> results;
+
+	for (double sampleRate : sampleRates)
+	{
+		checkRoomCorrection(sampleRate, results);
+		checkLinearPhaseCrossover(sampleRate, results);
+	}
+
+	return results;
+}
+
+void ConvolutionCheck::checkRoomCorrection(double sampleRate, std::vector<Result>& results) const
+{
+	Random random(CONVOLUTION_CHECK_SEED);
+	const int numChannels = CONVOLUTION_CHECK_NUM_CHANNELS;
+	const int phaseLength = CONVOLUTION_CHECK_PHASE_SAMPLES;
+
+	// Decaying noise, different in each channel, at the session's rate so nothing is resampled.
+	AudioSampleBuffer impulseResponses[2] = { AudioSampleBuffer(numChannels, CONVOLUTION_CHECK_IR_A_SAMPLES),
+		AudioSampleBuffer(numChannels, CONVOLUTION_CHECK_IR_B_SAMPLES) };
+
+	for (AudioSampleBuffer& impulseResponse : impulseResponses)
+	{
+		fillNoise(impulseResponse, random);
+		for (int chan = 0; chan < numChannels; chan++)
+		{
+			for (int tap = 0; tap < impulseResponse.getNumSamples(); tap++)
+				impulseResponse.setSample(chan, tap, impulseResponse.getSample(chan, tap) * 0.1f * std::exp(-4.0f * (float)tap / impulseResponse.getNumSamples()));
+		}
+	}
+
+	// Set 0 (A), then set 1 (B), then set 2, which has no file and passes through.
+	AudioSampleBuffer signal(numChannels, 3 * phaseLength);
+	fillNoise(signal, random);
+
+	RoomCorrectionProcessor roomCorrection;
+	const int latency = roomCorrection.getLatencySamples();
+
+	// Every segment has the new filter's output within a few of the largest partitions, and then fades.
+	const int largestPartitionSize = ROOM_CORRECTION_FIRST_PARTITION_SIZE * ROOM_CORRECTION_PARTITION_GROWTH * ROOM_CORRECTION_PARTITION_GROWTH;
+	const int settleLength = 4 * largestPartitionSize + (int)std::ceil(ROOM_CORRECTION_CROSSFADE_MS * sampleRate / 1000.0) + latency;
+	jassert(settleLength < phaseLength);
+
+	// Direct convolution, only where it is checked.
+	AudioSampleBuffer expected(numChannels, signal.getNumSamples());
+	expected.clear();
+
+	for (int chan = 0; chan < numChannels; chan++)
+	{
+		const float* input = signal.getReadPointer(chan);
+		float* output = expected.getWritePointer(chan);
+
+		for (int phase = 0; phase < 3; phase++)
+		{
+			const int start = phase * phaseLength + (phase > 0 ? settleLength : 0);
+			const int end = (phase + 1) * phaseLength;
+
+			for (int sample = start; sample < end; sample++)
+			{
+				const int delayed = sample - latency;
+				if (phase == 2)
+				{
+					output[sample] = delayed >= 0 ? input[delayed] : 0.0f;
+					continue;
+				}
+
+				const float* taps = impulseResponses[phase].getReadPointer(chan);
+				const int numTaps = jmin(impulseResponses[phase].getNumSamples(), delayed + 1);
+				double sum = 0.0;
+				for (int tap = 0; tap < numTaps; tap++)
+					sum += (double)taps[tap] * input[delayed - tap];
+				output[sample] = (float)sum;
+			}
+		}
+	}
+
+	const char* const phaseNames[] = { "room correction: impulse response A", "room correction: switched to B", "room correction: switched to none" };
+
+	for (int blockSize : blockSizes)
+	{
+		roomCorrection.prepareToPlay(sampleRate, numChannels);
+		roomCorrection.setImpulseResponse(0, impulseResponses[0], sampleRate);
+		roomCorrection.setImpulseResponse(1, impulseResponses[1], sampleRate);
+
+		AudioSampleBuffer measured(signal);
+
+		// Blocks are cut at the switches, as a host's parameter changes land between blocks.
+		for (int phase = 0; phase < 3; phase++)
+		{
+			roomCorrection.setSpeakerSet(phase);
+
+			for (int start = phase * phaseLength; start < (phase + 1) * phaseLength; start += blockSize)
+			{
+				const int numSamples = jmin(blockSize, (phase + 1) * phaseLength - start);
+				AudioSampleBuffer block(measured.getArrayOfWritePointers(), numChannels, start, numSamples);
+				roomCorrection.process(block);
+			}
+		}
+
+		for (int phase = 0; phase < 3; phase++)
+		{
+			const int start = phase * phaseLength + (phase > 0 ? settleLength : 0);
+			results.push_back(makeResult(phaseNames[phase], sampleRate, blockSize, getErrorDb(expected, measured, start, (phase + 1) * phaseLength)));
+		}
+	}
+}
+
+void ConvolutionCheck::checkLinearPhaseCrossover(double sampleRate, std::vector<Result>& results) const
+{
+	Random random(CONVOLUTION_CHECK_SEED);
+	const int numChannels = CONVOLUTION_CHECK_NUM_CHANNELS;
+	const int length = CONVOLUTION_CHECK_CROSSOVER_SAMPLES;
+
+	AudioSampleBuffer signal(numChannels, length);
+	fillNoise(signal, random);
+
+	LinearPhaseCrossover crossover;
+	crossover.prepareToPlay(sampleRate, numChannels, CONVOLUTION_CHECK_NUM_BANDS);
+	crossover.setNumBands(CONVOLUTION_CHECK_NUM_BANDS);
+	for (int i = 0; i < CONVOLUTION_CHECK_NUM_BANDS - 1; i++)
+		crossover.setCrossoverFrequency(i, convolutionCheckCrossovers[i]);
+	crossover.update();
+
+	const int latency = crossover.getLatencySamples();
+
+	AudioSampleBuffer expected(numChannels, length);
+	expected.clear();
+	for (int chan = 0; chan < numChannels; chan++)
+		expected.copyFrom(chan, latency, signal, chan, 0, length - latency);
+
+	const int allBands = (1 << CONVOLUTION_CHECK_NUM_BANDS) - 1;
+
+	for (int blockSize : blockSizes)
+	{
+		// Each band on its own, summed, then none and all of them, from a cleared history each time.
+		AudioSampleBuffer bandSum(numChannels, length);
+		bandSum.clear();
+
+		for (int soloMask = 0; soloMask <= allBands; soloMask++)
+		{
+			const bool singleBand = soloMask != 0 && (soloMask & (soloMask - 1)) == 0;
+			if (soloMask != 0 && soloMask != allBands && !singleBand)
+				continue;
+
+			crossover.reset();
+			AudioSampleBuffer measured(signal);
+
+			for (int start = 0; start < length; start += blockSize)
+			{
+				AudioSampleBuffer block(measured.getArrayOfWritePointers(), numChannels, start, jmin(blockSize, length - start));
+				crossover.process(block, soloMask);
+			}
+
+			if (singleBand)
+			{
+				for (int chan = 0; chan < numChannels; chan++)
+					bandSum.addFrom(chan, 0, measured, chan, 0, length);
+			}
+			else
+			{
+				results.push_back(makeResult(soloMask == 0 ? "linear phase: none soloed" : "linear phase: all soloed",
+					sampleRate, blockSize, getErrorDb(expected, measured, 0, length)));
+			}
+		}
+
+		results.push_back(makeResult("linear phase: bands summed", sampleRate, blockSize, getErrorDb(expected, bandSum, 0, length)));
+	}
+}
+
+void ConvolutionCheck::fillNoise(AudioSampleBuffer& buffer, Random& random)
+{
+	for (int chan = 0; chan < buffer.getNumChannels(); chan++)
+	{
+		for (int sample = 0; sample < buffer.getNumSamples(); sample++)
+			buffer.setSample(chan, sample, 0.5f * (random.nextFloat() * 2.0f - 1.0f));
+	}
+}
+
+float ConvolutionCheck::getErrorDb(const AudioSampleBuffer& expected, const AudioSampleBuffer& measured, int start, int end)
+{
+	float peak = 0.0f;
+	float error = 0.0f;
+
+	for (int chan = 0; chan < expected.getNumChannels(); chan++)
+	{
+		for (int sample = start; sample < end; sample++)
+		{
+			peak = jmax(peak, std::abs(expected.getSample(chan, sample)));
+
+			// Written so a NaN fails.
+			const float difference = std::abs(measured.getSample(chan, sample) - expected.getSample(chan, sample));
+			if (!(difference <= error))
+				error = difference;
+		}
+	}
+
+	return Decibels::gainToDecibels(error / jmax(peak, 1.0e-6f), -200.0f);
+}
+
+ConvolutionCheck::Result ConvolutionCheck::makeResult(const String& check, double sampleRate, int blockSize, float errorDb)
+{
+	return { check, sampleRate, blockSize, errorDb, errorDb <= CONVOLUTION_CHECK_TOLERANCE_DB };
+}
+
+bool ConvolutionCheck::allPassed(const std::vector<Result>& results)
+{
+	for (const Result& result : results)
+	{
+		if (!result.passed)
+			return false;
+	}
+
+	return true;
+}
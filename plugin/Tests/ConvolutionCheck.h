@@ -0,0 +1,69 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+	Correctness checks for the convolution engines, against the plain sums they
+	stand in for.
+
+	RoomCorrectionProcessor must give the direct time domain convolution with each
+	speaker set's impulse response, delayed by getLatencySamples(). The set is switched
+	mid-stream, from one response to another and then to one with no file, so the
+	output after the switch must match the new response (or a pure delay) once every
+	segment has faded to it. The crossfades themselves aren't checked.
+
+	LinearPhaseCrossover's bands, each soloed on its own and summed, must give the
+	input delayed by getLatencySamples(), as must soloing none of them or all of them.
+
+	Every check runs at each sample rate and block size asked for, and the worst
+	sample must be within CONVOLUTION_CHECK_TOLERANCE_DB of the expected peak.
+*/
+class ConvolutionCheck
+{
+public:
+	struct Result
+	{
+		String check;
+		double sampleRate;
+		int blockSize;
+		float errorDb;			// The worst sample's error, against the expected output's peak.
+		bool passed;
+	};
+
+	// Default matrix: two sample rates, with block sizes from one sample to the largest partition.
+	ConvolutionCheck();
+	ConvolutionCheck(const Array<double>& sampleRates, const Array<int>& blockSizes);
+
+	std::vector<Result> run() const;
+
+	static bool allPassed(const std::vector<Result>& results);
+
+private:
+	void checkRoomCorrection(double sampleRate, std::vector<Result>& results) const;
+	void checkLinearPhaseCrossover(double sampleRate, std::vector<Result>& results) const;
+
+	static void fillNoise(AudioSampleBuffer& buffer, Random& random);
+	static float getErrorDb(const AudioSampleBuffer& expected, const AudioSampleBuffer& measured, int start, int end);
+	static Result makeResult(const String& check, double sampleRate, int blockSize, float errorDb);
+
+	Array<double> sampleRates;
+	Array<int> blockSizes;
+};
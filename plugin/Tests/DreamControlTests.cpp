@@ -0,0 +1,232 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*
+*
+*  DSP correctness tests, run by CTest. Each prints its results and the process
+*  exits with 1 if any check failed.
+*
+*  --conformance runs the meter engine against the EBU Tech 3341 and 3342 signals (see
+*  LoudnessConformance), at 44.1, 48 and 96 kHz and block sizes 1 to 4096.
+*
+*  --stress runs the block size stress test (see BlockSizeStress): random host block
+*  sizes must give the same meters and output as fixed ones, without allocating.
+*
+*  --convolution runs the convolution correctness checks (see ConvolutionCheck): room
+*  correction against direct convolution, and the linear phase bands' sum against a
+*  pure delay.
+*
+*  With none of these, all three run.
+*
+*  Usage: DreamControlTests [--json] [--conformance] [--stress [--seed <n>]] [--convolution]
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <JuceHeader.h>
+
+#include "BlockSizeStress.h"
+#include "ConvolutionCheck.h"
+#include "LoudnessConformance.h"
+
+#define TESTS_STRESS_SECONDS 20.0						// Per sample rate.
+
+//==============================================================================
+// Heap allocation counter for the stress test. With glibc, malloc itself is wrapped, which
+// also catches AudioBuffer's HeapBlock; elsewhere only operator new is counted. Counted per
+// thread, so the stress test sees only the audio thread's, not the analysis threads'.
+static thread_local int64 numAllocations = 0;
+
+#if defined(__GLIBC__)
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* data, size_t size);
+
+extern "C" void* malloc(size_t size) { ++numAllocations; return __libc_malloc(size); }
+extern "C" void* calloc(size_t count, size_t size) { ++numAllocations; return __libc_calloc(count, size); }
+extern "C" void* realloc(void* data, size_t size) { ++numAllocations; return __libc_realloc(data, size); }
+#else
+void* operator new(size_t size)
+{
+	++numAllocations;
+	if (void* data = std::malloc(size))
+		return data;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* data) noexcept { std::free(data); }
+void operator delete[](void* data) noexcept { std::free(data); }
+#endif
+
+//==============================================================================
+static bool runConformance(bool json)
+{
+	const std::vector<LoudnessConformance::Result> results = LoudnessConformance().run();
+	const bool passed = LoudnessConformance::allPassed(results);
+
+	if (json)
+	{
+		var resultArray;
+		for (const auto& result : results)
+		{
+			DynamicObject::Ptr item = new DynamicObject();
+			item->setProperty("signal", result.signal);
+			item->setProperty("measurement", LoudnessConformance::getMeasurementName(result.measurement));
+			item->setProperty("sampleRate", result.sampleRate);
+			item->setProperty("blockSize", result.blockSize);
+			item->setProperty("expected", result.expected);
+			item->setProperty("measured", result.measured);
+			item->setProperty("passed", result.passed);
+			resultArray.append(var(item.get()));
+		}
+
+		DynamicObject::Ptr root = new DynamicObject();
+		root->setProperty("conformance", resultArray);
+		root->setProperty("passed", passed);
+		printf("%s\n", JSON::toString(var(root.get())).toRawUTF8());
+		return passed;
+	}
+
+	int numFailed = 0;
+	for (const auto& result : results)
+	{
+		if (!result.passed)
+			numFailed++;
+
+		printf("%-40s %-9s %6.0f %5d %8.2f %8.2f  %s\n", result.signal.toRawUTF8(),
+			LoudnessConformance::getMeasurementName(result.measurement).toRawUTF8(), result.sampleRate,
+			result.blockSize, result.expected, result.measured, result.passed ? "ok" : "FAILED");
+	}
+
+	printf("Conformance: %d checks, %d failed\n\n", (int)results.size(), numFailed);
+	return passed;
+}
+
+static bool runStress(int64 seed, bool json)
+{
+	const std::vector<BlockSizeStress::Result> results = BlockSizeStress(TESTS_STRESS_SECONDS, seed).run([] { return numAllocations; });
+	const bool passed = BlockSizeStress::allPassed(results);
+
+	if (json)
+	{
+		var resultArray;
+		for (const auto& result : results)
+		{
+			DynamicObject::Ptr item = new DynamicObject();
+			item->setProperty("sampleRate", result.sampleRate);
+			item->setProperty("numBlocks", result.numBlocks);
+			item->setProperty("minBlockSize", result.minBlockSize);
+			item->setProperty("maxBlockSize", result.maxBlockSize);
+			item->setProperty("mismatches", result.numMismatches);
+			item->setProperty("firstMismatch", result.firstMismatch);
+			item->setProperty("allocatingBlocks", result.numAllocatingBlocks);
+			item->setProperty("passed", result.passed);
+			resultArray.append(var(item.get()));
+		}
+
+		DynamicObject::Ptr root = new DynamicObject();
+		root->setProperty("seed", seed);
+		root->setProperty("stress", resultArray);
+		root->setProperty("passed", passed);
+		printf("%s\n", JSON::toString(var(root.get())).toRawUTF8());
+		return passed;
+	}
+
+	printf("Block size stress, seed %lld\n", (long long)seed);
+	printf("%9s %8s %11s %11s %11s  %s\n", "rate", "blocks", "block sizes", "mismatches", "allocating", "");
+
+	for (const auto& result : results)
+		printf("%9.0f %8d %5d-%-5d %11d %11d  %s %s\n", result.sampleRate, result.numBlocks, result.minBlockSize, result.maxBlockSize,
+			result.numMismatches, result.numAllocatingBlocks, result.passed ? "ok" : "FAILED", result.firstMismatch.toRawUTF8());
+
+	return passed;
+}
+
+static bool runConvolutionCheck(bool json)
+{
+	const std::vector<ConvolutionCheck::Result> results = ConvolutionCheck().run();
+	const bool passed = ConvolutionCheck::allPassed(results);
+
+	if (json)
+	{
+		var resultArray;
+		for (const auto& result : results)
+		{
+			DynamicObject::Ptr item = new DynamicObject();
+			item->setProperty("check", result.check);
+			item->setProperty("sampleRate", result.sampleRate);
+			item->setProperty("blockSize", result.blockSize);
+			item->setProperty("errorDb", result.errorDb);
+			item->setProperty("passed", result.passed);
+			resultArray.append(var(item.get()));
+		}
+
+		DynamicObject::Ptr root = new DynamicObject();
+		root->setProperty("convolution", resultArray);
+		root->setProperty("passed", passed);
+		printf("%s\n", JSON::toString(var(root.get())).toRawUTF8());
+		return passed;
+	}
+
+	printf("%-40s %9s %6s %9s\n", "check", "rate", "block", "error dB");
+
+	int numFailed = 0;
+	for (const auto& result : results)
+	{
+		if (!result.passed)
+			numFailed++;
+
+		printf("%-40s %9.0f %6d %9.1f  %s\n", result.check.toRawUTF8(), result.sampleRate, result.blockSize,
+			result.errorDb, result.passed ? "ok" : "FAILED");
+	}
+
+	printf("Convolution: %d checks, %d failed\n", (int)results.size(), numFailed);
+	return passed;
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+	StringArray args;
+	for (int i = 1; i < argc; i++)
+		args.add(argv[i]);
+
+	if (args.contains("--help"))
+	{
+		printf("Usage: DreamControlTests [--json] [--conformance] [--stress [--seed <n>]] [--convolution]\n");
+		return 0;
+	}
+
+	const bool json = args.contains("--json");
+	const bool all = !args.contains("--conformance") && !args.contains("--stress") && !args.contains("--convolution");
+	bool passed = true;
+
+	if (all || args.contains("--conformance"))
+		passed = runConformance(json) && passed;
+
+	if (all || args.contains("--stress"))
+	{
+		// A different seed each time unless asked, printed so failures can be reproduced.
+		const int64 seed = args.indexOf("--seed") >= 0 ? args[args.indexOf("--seed") + 1].getLargeIntValue() : Time::currentTimeMillis();
+		passed = runStress(seed, json) && passed;
+	}
+
+	if (all || args.contains("--convolution"))
+		passed = runConvolutionCheck(json) && passed;
+
+	return passed ? 0 : 1;
+}
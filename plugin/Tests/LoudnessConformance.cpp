@@ -0,0 +1,271 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#include <cmath>
+
+#include "LoudnessConformance.h"
+#include "LufsProcessor.h"
+#include "TruePeakProcessor.h"
+
+#define LOUDNESS_CONFORMANCE_FADE_IN_SECONDS 0.01		// So the true peak oversampling filter doesn't ring on the first step.
+
+LoudnessConformance::LoudnessConformance()
+{
+	sampleRates.add(44100.0);
+	sampleRates.add(48000.0);
+	sampleRates.add(96000.0);
+
+	blockSizes.add(1);
+	blockSizes.add(37);
+	blockSizes.add(512);
+	blockSizes.add(4096);
+}
+
+LoudnessConformance::LoudnessConformance(const Array<double>& sampleRates, const Array<int>& blockSizes)
+	: sampleRates(sampleRates), blockSizes(blockSizes)
+{
+}
+
+LoudnessConformance LoudnessConformance::quick()
+{
+	Array<double> quickSampleRates;
+	quickSampleRates.add(48000.0);
+
+	Array<int> quickBlockSizes;
+	quickBlockSizes.add(37);
+	quickBlockSizes.add(4096);
+
+	return LoudnessConformance(quickSampleRates, quickBlockSizes);
+}
+
+std::vector<LoudnessConformance::Signal> LoudnessConformance::getSignals()
+{
+	// Stereo 1 kHz sines unless said otherwise, levels are the sine peak in each channel.
+	// Tolerances are the EBU ones: +-0.1 LU for loudness, +-1 LU for loudness range,
+	// +0.2/-0.4 dB for true peak.
+	std::vector<Signal> signals;
+
+	signals.push_back({ "3341 case 1: -23 dBFS",
+		{ { 20.0, -23.0f, 1000.0, 0.0 } },
+		{ { integrated, -23.0f, 0.1f, 0.1f }, { maxMomentary, -23.0f, 0.1f, 0.1f }, { maxShortTerm, -23.0f, 0.1f, 0.1f } },
+		false });
+
+	signals.push_back({ "3341 case 2: -33 dBFS",
+		{ { 20.0, -33.0f, 1000.0, 0.0 } },
+		{ { integrated, -33.0f, 0.1f, 0.1f }, { maxMomentary, -33.0f, 0.1f, 0.1f }, { maxShortTerm, -33.0f, 0.1f, 0.1f } },
+		false });
+
+	signals.push_back({ "3341 case 3: relative gate",
+		{ { 10.0, -36.0f, 1000.0, 0.0 }, { 60.0, -23.0f, 1000.0, 0.0 }, { 10.0, -36.0f, 1000.0, 0.0 } },
+		{ { integrated, -23.0f, 0.1f, 0.1f } },
+		false });
+
+	signals.push_back({ "3341 case 4: absolute and relative gates",
+		{ { 10.0, -72.0f, 1000.0, 0.0 }, { 10.0, -36.0f, 1000.0, 0.0 }, { 60.0, -23.0f, 1000.0, 0.0 },
+		  { 10.0, -36.0f, 1000.0, 0.0 }, { 10.0, -72.0f, 1000.0, 0.0 } },
+		{ { integrated, -23.0f, 0.1f, 0.1f } },
+		false });
+
+	signals.push_back({ "3341 case 5: -26/-20/-26 dBFS",
+		{ { 20.0, -26.0f, 1000.0, 0.0 }, { 20.1, -20.0f, 1000.0, 0.0 }, { 20.0, -26.0f, 1000.0, 0.0 } },
+		{ { integrated, -23.0f, 0.1f, 0.1f } },
+		false });
+
+	// Short term loudness must stay at -23 once the 3 s window is full.
+	Signal shortTerm = { "3341 case 9: short term window", {},
+		{ { minShortTerm, -23.0f, 0.1f, 0.1f }, { maxShortTerm, -23.0f, 0.1f, 0.1f } },
+		false };
+
+	for (int i = 0; i < 20; i++)
+	{
+		shortTerm.tones.push_back({ 1.34, -20.0f, 1000.0, 0.0 });
+		shortTerm.tones.push_back({ 1.66, -30.0f, 1000.0, 0.0 });
+	}
+	signals.push_back(shortTerm);
+
+	// A 400 ms burst on a 100 ms boundary fills the momentary window exactly once.
+	signals.push_back({ "momentary window: 400 ms burst",
+		{ { 1.0, DEFAULT_MIN_VOLUME, 1000.0, 0.0 }, { 0.4, -23.0f, 1000.0, 0.0 }, { 1.0, DEFAULT_MIN_VOLUME, 1000.0, 0.0 } },
+		{ { maxMomentary, -23.0f, 0.1f, 0.1f } },
+		false });
+
+	signals.push_back({ "3342 case 1: -20/-30 dBFS",
+		{ { 20.0, -20.0f, 1000.0, 0.0 }, { 20.0, -30.0f, 1000.0, 0.0 } },
+		{ { loudnessRange, 10.0f, 1.0f, 1.0f } },
+		false });
+
+	signals.push_back({ "3342 case 2: -20/-15 dBFS",
+		{ { 20.0, -20.0f, 1000.0, 0.0 }, { 20.0, -15.0f, 1000.0, 0.0 } },
+		{ { loudnessRange, 5.0f, 1.0f, 1.0f } },
+		false });
+
+	signals.push_back({ "3342 case 3: -40/-20 dBFS",
+		{ { 20.0, -40.0f, 1000.0, 0.0 }, { 20.0, -20.0f, 1000.0, 0.0 } },
+		{ { loudnessRange, 20.0f, 1.0f, 1.0f } },
+		false });
+
+	signals.push_back({ "3342 case 4: -50/-35/-20/-35/-50 dBFS",
+		{ { 20.0, -50.0f, 1000.0, 0.0 }, { 20.0, -35.0f, 1000.0, 0.0 }, { 20.0, -20.0f, 1000.0, 0.0 },
+		  { 20.0, -35.0f, 1000.0, 0.0 }, { 20.0, -50.0f, 1000.0, 0.0 } },
+		{ { loudnessRange, 15.0f, 1.0f, 1.0f } },
+		false });
+
+	// True peak: -6 dBFS sines with their peaks between samples.
+	const Check truePeakChecks[] = { { truePeak, -6.0f, 0.4f, 0.2f }, { truePeakOfBlocks, -6.0f, 0.4f, 0.2f } };
+
+	signals.push_back({ "true peak: 1 kHz", { { 1.0, -6.0f, 1000.0, 0.0 } },
+		{ truePeakChecks[0], truePeakChecks[1] }, true });
+
+	signals.push_back({ "true peak: fs/4 at 45 degrees", { { 1.0, -6.0f, 12000.0, 45.0 } },
+		{ truePeakChecks[0], truePeakChecks[1] }, true });
+
+	signals.push_back({ "true peak: fs/6 at 60 degrees", { { 1.0, -6.0f, 8000.0, 60.0 } },
+		{ truePeakChecks[0], truePeakChecks[1] }, true });
+
+	signals.push_back({ "true peak: fs/8 at 67.5 degrees", { { 1.0, -6.0f, 6000.0, 67.5 } },
+		{ truePeakChecks[0], truePeakChecks[1] }, true });
+
+	return signals;
+}
+
+std::vector<LoudnessConformance::Result> LoudnessConformance::run() const
+{
+	std::vector<Result> results;
+
+	for (const Signal& signal : getSignals())
+	{
+		for (double sampleRate : sampleRates)
+		{
+			if (signal.only48kHz && sampleRate != 48000.0)
+				continue;
+
+			for (int blockSize : blockSizes)
+				runSignal(signal, sampleRate, blockSize, results);
+		}
+	}
+
+	return results;
+}
+
+void LoudnessConformance::runSignal(const Signal& signal, double sampleRate, int blockSize, std::vector<Result>& results) const
+{
+	std::vector<int64> toneEnds;
+	int64 length = 0;
+	for (const Tone& tone : signal.tones)
+	{
+		length += (int64)std::llround(tone.seconds * sampleRate);
+		toneEnds.push_back(length);
+	}
+
+	LufsProcessor lufsProcessor(LUFS_TP_MAX_NB_CHANNELS);
+	lufsProcessor.prepareToPlay(sampleRate, blockSize);
+
+	AudioProcessing::TruePeak truePeakProcessor;
+	float blockTruePeak = 0.0f;
+
+	const int fadeInLength = (int)(LOUDNESS_CONFORMANCE_FADE_IN_SECONDS * sampleRate);
+
+	AudioSampleBuffer buffer(LUFS_TP_MAX_NB_CHANNELS, blockSize);
+	size_t toneIndex = 0;
+
+	for (int64 start = 0; start < length; start += blockSize)
+	{
+		const int numSamples = (int)jmin((int64)blockSize, length - start);
+
+		for (int i = 0; i < numSamples; i++)
+		{
+			const int64 sample = start + i;
+			while (sample >= toneEnds[toneIndex])
+				toneIndex++;
+
+			// Phase runs on from one tone to the next, as in the EBU files.
+			const Tone& tone = signal.tones[toneIndex];
+			const double phase = 2.0 * double_Pi * tone.frequency * (double)sample / sampleRate + tone.phaseDegrees * double_Pi / 180.0;
+			float value = Decibels::decibelsToGain(tone.level, DEFAULT_MIN_VOLUME) * (float)std::sin(phase);
+
+			if (sample < fadeInLength)
+				value *= 0.5f - 0.5f * (float)std::cos(double_Pi * (double)sample / fadeInLength);
+
+			for (int chan = 0; chan < buffer.getNumChannels(); chan++)
+				buffer.getWritePointer(chan)[i] = value;
+		}
+
+		AudioSampleBuffer block(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), numSamples);
+		lufsProcessor.processBlock(block);
+		blockTruePeak = jmax(blockTruePeak, truePeakProcessor.process(block).getMax());
+	}
+
+	lufsProcessor.update();
+
+	const LufsGatingState& gatingState = lufsProcessor.getGatingState();
+	float rangeMin, rangeMax;
+	gatingState.getRange(rangeMin, rangeMax);
+
+	float shortTermMin = 0.0f;
+	const float* shortTerm = lufsProcessor.getShortTermVolumeArray();
+	for (int position = 30; position < lufsProcessor.getValidSize(); position++)
+		shortTermMin = position == 30 ? shortTerm[position] : jmin(shortTermMin, shortTerm[position]);
+
+	for (const Check& check : signal.checks)
+	{
+		Result result;
+		result.signal = signal.name;
+		result.measurement = check.measurement;
+		result.sampleRate = sampleRate;
+		result.blockSize = blockSize;
+		result.expected = check.expected;
+
+		switch (check.measurement)
+		{
+		case integrated:		result.measured = gatingState.getIntegratedVolume(); break;
+		case loudnessRange:		result.measured = rangeMax - rangeMin; break;
+		case maxMomentary:		result.measured = gatingState.getMaxMomentaryVolume(); break;
+		case maxShortTerm:		result.measured = gatingState.getMaxShortTermVolume(); break;
+		case minShortTerm:		result.measured = shortTermMin; break;
+		case truePeak:			result.measured = gatingState.getTruePeak(); break;
+		case truePeakOfBlocks:	result.measured = Decibels::gainToDecibels(blockTruePeak, DEFAULT_MIN_VOLUME); break;
+		}
+
+		result.passed = result.measured >= check.expected - check.toleranceBelow && result.measured <= check.expected + check.toleranceAbove;
+		results.push_back(result);
+	}
+}
+
+bool LoudnessConformance::allPassed(const std::vector<Result>& results)
+{
+	for (const Result& result : results)
+	{
+		if (!result.passed)
+			return false;
+	}
+
+	return true;
+}
+
+String LoudnessConformance::getMeasurementName(Measurement measurement)
+{
+	switch (measurement)
+	{
+	case integrated:		return "I";
+	case loudnessRange:		return "LRA";
+	case maxMomentary:		return "M max";
+	case maxShortTerm:		return "S max";
+	case minShortTerm:		return "S min";
+	case truePeak:			return "TP";
+	case truePeakOfBlocks:	return "TP blocks";
+	}
+
+	return String();
+}
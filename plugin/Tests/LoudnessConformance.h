@@ -0,0 +1,99 @@
+/*
+*        ~|  DreamControl |~
+*
+*	    Studio MIDI controller
+*
+*			 VST plugin
+*
+* ==========================================================================
+*
+*  Copyright (C) 2018 Dave Evans (dave@propertech.co.uk)
+*  Licensed for personal non-commercial use only. All other rights reserved.
+*
+* ==========================================================================
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+	Conformance checks for the meter engine (LufsProcessor and TruePeak), against
+	the EBU Tech 3341 (loudness, true peak) and Tech 3342 (loudness range) test signals.
+
+	The signals are synthesized, not read from the EBU files, so the checks are
+	deterministic and need nothing but the DSP library. Each signal is measured at
+	every sample rate and block size asked for, and every measurement must be within
+	the EBU tolerance. Run them before trusting any change to the meter engine.
+*/
+class LoudnessConformance
+{
+public:
+	enum Measurement
+	{
+		integrated,
+		loudnessRange,
+		maxMomentary,
+		maxShortTerm,
+		minShortTerm,			// Once the 3 s window is full.
+		truePeak,				// From LufsProcessor.
+		truePeakOfBlocks		// From AudioProcessing::TruePeak, fed the host blocks directly.
+	};
+
+	struct Result
+	{
+		String signal;
+		Measurement measurement;
+		double sampleRate;
+		int blockSize;
+		float expected;
+		float measured;
+		bool passed;
+	};
+
+	// Default matrix: common sample rates, with block sizes from odd and tiny to large.
+	// It takes a minute or two, quick() is 48 kHz with an odd and a large block size.
+	LoudnessConformance();
+	LoudnessConformance(const Array<double>& sampleRates, const Array<int>& blockSizes);
+
+	static LoudnessConformance quick();
+
+	std::vector<Result> run() const;
+
+	static bool allPassed(const std::vector<Result>& results);
+	static String getMeasurementName(Measurement measurement);
+
+private:
+	struct Tone
+	{
+		double seconds;
+		float level;			// dBFS (sine peak), same in both channels.
+		double frequency;
+		double phaseDegrees;
+	};
+
+	struct Check
+	{
+		Measurement measurement;
+		float expected;
+		float toleranceBelow;
+		float toleranceAbove;
+	};
+
+	struct Signal
+	{
+		String name;
+		std::vector<Tone> tones;
+		std::vector<Check> checks;
+		bool only48kHz;			// The true peak oversampling filter is designed for 48 kHz.
+	};
+
+	static std::vector<Signal> getSignals();
+	void runSignal(const Signal& signal, double sampleRate, int blockSize, std::vector<Result>& results) const;
+
+	Array<double> sampleRates;
+	Array<int> blockSizes;
+};